@@ -0,0 +1,603 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "io.h"
+#include "node.h"
+#include "engine.h"
+#include "lctrie.h"
+#include "fib.h"
+#include "timing.h"
+#include "simd.h"
+#include "cache.h"
+#include "build.h"
+
+/**********************************************************************
+ * BENCHMARK
+ * Runs every lookup engine (or the one chosen with -e) on synthetic
+ * destinations generated from the FIB, and reports the throughput, the
+ * latency percentiles, the build time and the memory of each engine.
+ * Every engine is built from the compressed trie, so its build time
+ * includes the time to build that trie from the FIB.
+ * The next hops are checked against the first engine (patricia), built
+ * from the FIB as it is even when the others use the aggregated one
+ * (-a). With -C every engine runs behind a front cache of that many
+ * entries, emptied before every workload. The trie is also built in a
+ * single pass (`create_compressed_trie_from_fib`) and, with -P, with
+ * `create_trie_parallel` on that many threads; the build times are
+ * reported along with whether the tries are the same.
+ *
+ *      bench [-n lookups] [-s seed] [-e engine] [-f fill_factor]
+ *            [-r root_branch] [-b batch_size] [-o table|csv|json]
+ *            [-t tsc|clock] [-k auto|scalar|avx2|avx512] [-a]
+ *            [-C cache_entries] [-K ip|24] [-P build_threads] [FIB]
+ **********************************************************************/
+
+#define BENCH_DEFAULT_FIB "routing_table.txt"
+#define BENCH_DEFAULT_LOOKUPS 4000000
+#define BENCH_ZIPF_EXPONENT 1.0
+#define BENCH_WORST_FRACTION 100  // Worst case: the longest 1% of the prefixes
+
+typedef enum {
+    FORMAT_TABLE,
+    FORMAT_CSV,
+    FORMAT_JSON,
+} Format;
+
+typedef struct {
+    char *fib_file;
+    const Engine *engine;
+    EngineOptions options;
+    size_t lookups;
+    uint64_t seed;
+    int batch_size;
+    Format format;
+    TimerSource timer;
+    SimdKernel kernel;
+    int aggregate;
+    size_t cache_entries;
+    CacheKey cache_key;
+    int build_threads;
+} Args;
+
+/* xorshift64*: the benchmark must give the same traffic on every run */
+typedef struct {
+    uint64_t state;
+} Rng;
+
+static uint64_t rng_next(Rng *rng)
+{
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t rng_ip(Rng *rng)
+{
+    return rng_next(rng) >> 32;
+}
+
+/* Uniform in [0, n) */
+static size_t rng_below(Rng *rng, size_t n)
+{
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0) * n;
+}
+
+/* Random address inside a prefix */
+static uint32_t ip_in(const FibEntry *entry, Rng *rng)
+{
+    uint32_t host = entry->prefix_length < 32 ? 0xFFFFFFFFU >> entry->prefix_length : 0;
+    return (entry->prefix & ~host) | (rng_ip(rng) & host);
+}
+
+/**********************************************************************
+ * TRAFFIC GENERATORS
+ * Fill ips[0..n) with destinations. The FIB has at least one entry.
+ **********************************************************************/
+typedef struct {
+    const char *name;
+    void (*generate)(const Fib *fib, Rng *rng, uint32_t *ips, size_t n);
+} Workload;
+
+/* Any address, most of them miss or take the default route */
+static void generate_uniform(const Fib *fib, Rng *rng, uint32_t *ips, size_t n)
+{
+    (void)fib;
+    for (size_t i = 0; i < n; ++i)
+        ips[i] = rng_ip(rng);
+}
+
+/* A random route of the FIB, every route equally likely */
+static void generate_prefix(const Fib *fib, Rng *rng, uint32_t *ips, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        ips[i] = ip_in(&fib->entries[rng_below(rng, fib->size)], rng);
+}
+
+/* Routes ranked in a random order, the k-th one chosen with probability ~ 1/k^s */
+static void generate_zipf(const Fib *fib, Rng *rng, uint32_t *ips, size_t n)
+{
+    size_t *rank = malloc(fib->size * sizeof(size_t));
+    double *cdf = malloc(fib->size * sizeof(double));
+    if (!rank || !cdf) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    double sum = 0;
+    for (size_t k = 0; k < fib->size; ++k) {
+        rank[k] = k;
+        sum += 1 / pow(k + 1, BENCH_ZIPF_EXPONENT);
+        cdf[k] = sum;
+    }
+    for (size_t k = fib->size - 1; k > 0; --k) {
+        size_t j = rng_below(rng, k + 1), tmp = rank[k];
+        rank[k] = rank[j];
+        rank[j] = tmp;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        double u = (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0) * sum;
+        size_t low = 0, high = fib->size - 1;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (cdf[mid] < u) low = mid + 1;
+            else high = mid;
+        }
+        ips[i] = ip_in(&fib->entries[rank[low]], rng);
+    }
+    free(rank);
+    free(cdf);
+}
+
+static int by_length_desc(const void *a, const void *b)
+{
+    return ((const FibEntry *)b)->prefix_length - ((const FibEntry *)a)->prefix_length;
+}
+
+/* Inside the longest prefixes: the deepest walks of the tries */
+static void generate_worst(const Fib *fib, Rng *rng, uint32_t *ips, size_t n)
+{
+    FibEntry *longest = malloc(fib->size * sizeof(FibEntry));
+    if (!longest) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    memcpy(longest, fib->entries, fib->size * sizeof(FibEntry));
+    qsort(longest, fib->size, sizeof(FibEntry), by_length_desc);
+    size_t count = fib->size / BENCH_WORST_FRACTION;
+    if (!count) count = 1;
+    for (size_t i = 0; i < n; ++i)
+        ips[i] = ip_in(&longest[rng_below(rng, count)], rng);
+    free(longest);
+}
+
+static const Workload workloads[] = {
+    { .name = "uniform", .generate = generate_uniform },
+    { .name = "prefix", .generate = generate_prefix },
+    { .name = "zipf", .generate = generate_zipf },
+    { .name = "worst", .generate = generate_worst },
+};
+static const int workload_count = sizeof(workloads) / sizeof(workloads[0]);
+
+/* Results of an engine on a workload */
+typedef struct {
+    const char *engine;
+    const char *workload;
+    size_t lookups;
+    double mlookups_per_sec;
+    double p50, p99, p999;
+    double average_accesses;
+    double build_time;
+    size_t memory;
+    size_t mismatches;
+    double hit_rate;
+} Result;
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/**********************************************************************
+ * Run an engine on a trace: one untimed pass for the throughput (in
+ * batches if batch_size > 0), then one pass timing every lookup for
+ * the latencies. Both go through the cache, if any; the hit rate is
+ * the one of the first pass.
+ * Args:
+ *  - ifaces, accesses: output, next hop and accesses of every IP.
+ *  - latencies: output, reset first.
+ **********************************************************************/
+static void run_engine(const Engine *engine, const void *table, FrontCache *cache,
+                       const uint32_t *ips, size_t n, int batch_size, int *ifaces, int *accesses,
+                       Histogram *latencies, Result *result)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    if (batch_size > 0) {
+        for (size_t first = 0; first < n; first += batch_size) {
+            size_t count = n - first < (size_t)batch_size ? n - first : (size_t)batch_size;
+            if (cache)
+                cache_lookup_batch(cache, engine, table, ips + first, ifaces + first,
+                                   accesses + first, count);
+            else
+                engine_lookup_batch(engine, table, ips + first, ifaces + first, accesses + first,
+                                    count);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            accesses[i] = 0;
+            ifaces[i] = cache ? cache_lookup(cache, engine, table, ips[i], &accesses[i])
+                              : engine->lookup(table, ips[i], &accesses[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    double total_time = elapsed_ns(&start, &end);
+    result->mlookups_per_sec = total_time > 0 ? n / total_time * 1e3 : 0;
+
+    double total_accesses = 0;
+    for (size_t i = 0; i < n; ++i)
+        total_accesses += accesses[i];
+    result->average_accesses = n ? total_accesses / n : 0;
+    result->hit_rate = cache && n ? 100.0 * cache->hits / n : 0;
+
+    histogram_reset(latencies);
+    for (size_t i = 0; i < n; ++i) {
+        int dummy = 0;
+        uint64_t before = timer_now();
+        if (cache) cache_lookup(cache, engine, table, ips[i], &dummy);
+        else engine->lookup(table, ips[i], &dummy);
+        uint64_t after = timer_now();
+        histogram_record(latencies, timer_elapsed_ns(before, after));
+    }
+    result->p50 = histogram_percentile(latencies, 0.50);
+    result->p99 = histogram_percentile(latencies, 0.99);
+    result->p999 = histogram_percentile(latencies, 0.999);
+    result->lookups = n;
+}
+
+static void print_header(Format format)
+{
+    switch (format) {
+    case FORMAT_TABLE:
+        printf("%-14s %-8s %10s %9s %9s %9s %9s %10s %12s %10s %7s\n", "engine", "workload",
+               "Mlookups/s", "p50(ns)", "p99(ns)", "p99.9(ns)", "accesses", "build(ms)",
+               "memory(KB)", "mismatches", "hit(%)");
+        break;
+    case FORMAT_CSV:
+        printf("engine,workload,lookups,mlookups_per_sec,p50_ns,p99_ns,p999_ns,"
+               "average_accesses,build_ms,memory_kb,mismatches,hit_rate\n");
+        break;
+    case FORMAT_JSON:
+        printf("[\n");
+        break;
+    }
+}
+
+static void print_result(Format format, const Result *r, int first)
+{
+    switch (format) {
+    case FORMAT_TABLE:
+        printf("%-14s %-8s %10.2f %9.0f %9.0f %9.0f %9.2f %10.2f %12zu %10zu %7.2f\n", r->engine,
+               r->workload, r->mlookups_per_sec, r->p50, r->p99, r->p999, r->average_accesses,
+               r->build_time / 1e6, r->memory / 1024, r->mismatches, r->hit_rate);
+        break;
+    case FORMAT_CSV:
+        printf("%s,%s,%zu,%.3f,%.0f,%.0f,%.0f,%.3f,%.3f,%zu,%zu,%.3f\n", r->engine, r->workload,
+               r->lookups, r->mlookups_per_sec, r->p50, r->p99, r->p999, r->average_accesses,
+               r->build_time / 1e6, r->memory / 1024, r->mismatches, r->hit_rate);
+        break;
+    case FORMAT_JSON:
+        printf("%s  {\"engine\": \"%s\", \"workload\": \"%s\", \"lookups\": %zu, "
+               "\"mlookups_per_sec\": %.3f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, "
+               "\"p999_ns\": %.0f, \"average_accesses\": %.3f, \"build_ms\": %.3f, "
+               "\"memory_kb\": %zu, \"mismatches\": %zu, \"hit_rate\": %.3f}",
+               first ? "" : ",\n", r->engine, r->workload, r->lookups, r->mlookups_per_sec,
+               r->p50, r->p99, r->p999, r->average_accesses, r->build_time / 1e6,
+               r->memory / 1024, r->mismatches, r->hit_rate);
+        break;
+    }
+}
+
+static void print_footer(Format format)
+{
+    if (format == FORMAT_JSON)
+        printf("\n]\n");
+}
+
+static void usage(char *cmd, char *errmsg)
+{
+    fprintf(stderr, "Usage: %s [-n lookups] [-s seed] [-e engine] [-f fill_factor] [-r root_branch] [-b batch_size] [-o table|csv|json] [-t tsc|clock] [-k auto|scalar|avx2|avx512] [-a] [-C cache_entries] [-K ip|24] [-P build_threads] [FIB]\n", cmd);
+    fputs("Engines:", stderr);
+    for (int i = 0; i < engine_count; ++i)
+        fprintf(stderr, " %s", engines[i].name);
+    fputs(" (default: all)\n", stderr);
+    fputs(errmsg, stderr);
+}
+
+static char *shift(int *ac, char ***av)
+{
+    char *result = **av;
+    *av += 1;
+    *ac -= 1;
+    return result;
+}
+
+static int parse_cmdline_opts(int argc, char **argv, Args *args)
+{
+    char *command = shift(&argc, &argv);
+    args->fib_file = BENCH_DEFAULT_FIB;
+    args->lookups = BENCH_DEFAULT_LOOKUPS;
+    args->seed = 1;
+    args->timer = TIMER_TSC;
+    args->kernel = SIMD_AUTO;
+    args->options.fill_factor = LC_DEFAULT_FILL_FACTOR;
+    args->options.root_branch = LC_DEFAULT_ROOT_BRANCH;
+    while (argc && argv[0][0] == '-') {
+        char *flag = shift(&argc, &argv);
+        if (strlen(flag) != 2 || !strchr("nsefrbotkaCKP", flag[1])) {
+            usage(command, "ERROR: unknown option\n");
+            return -1;
+        }
+        if (flag[1] == 'a') {  // The only option without value
+            args->aggregate = 1;
+            continue;
+        }
+        if (!argc) {
+            usage(command, "ERROR: option without value\n");
+            return -1;
+        }
+        char *value = shift(&argc, &argv);
+        switch (flag[1]) {
+        case 'n':
+            args->lookups = strtoul(value, NULL, 10);
+            if (!args->lookups) {
+                usage(command, "ERROR: invalid number of lookups\n");
+                return -1;
+            }
+            break;
+        case 's':
+            args->seed = strtoull(value, NULL, 10);
+            if (!args->seed) {
+                usage(command, "ERROR: the seed cannot be 0\n");
+                return -1;
+            }
+            break;
+        case 'e':
+            args->engine = find_engine(value);
+            if (!args->engine) {
+                usage(command, "ERROR: unknown engine\n");
+                return -1;
+            }
+            break;
+        case 'f':
+            args->options.fill_factor = atof(value);
+            if (args->options.fill_factor <= 0 || args->options.fill_factor > 1) {
+                usage(command, "ERROR: the fill factor must be in (0, 1]\n");
+                return -1;
+            }
+            break;
+        case 'r':
+            args->options.root_branch = atoi(value);
+            if (args->options.root_branch < 0 || args->options.root_branch > LC_MAX_BRANCH) {
+                usage(command, "ERROR: invalid root branching factor\n");
+                return -1;
+            }
+            break;
+        case 'b':
+            args->batch_size = atoi(value);
+            if (args->batch_size < 0) {
+                usage(command, "ERROR: invalid batch size\n");
+                return -1;
+            }
+            break;
+        case 'o':
+            if (!strcmp(value, "table")) args->format = FORMAT_TABLE;
+            else if (!strcmp(value, "csv")) args->format = FORMAT_CSV;
+            else if (!strcmp(value, "json")) args->format = FORMAT_JSON;
+            else {
+                usage(command, "ERROR: unknown output format\n");
+                return -1;
+            }
+            break;
+        case 't':
+            if (!strcmp(value, "tsc")) args->timer = TIMER_TSC;
+            else if (!strcmp(value, "clock")) args->timer = TIMER_CLOCK;
+            else {
+                usage(command, "ERROR: unknown timer\n");
+                return -1;
+            }
+            break;
+        case 'C':
+            args->cache_entries = strtoul(value, NULL, 10);
+            if (!args->cache_entries) {
+                usage(command, "ERROR: invalid cache size\n");
+                return -1;
+            }
+            break;
+        case 'K':
+            if (!strcmp(value, "ip")) args->cache_key = CACHE_KEY_IP;
+            else if (!strcmp(value, "24")) args->cache_key = CACHE_KEY_24;
+            else {
+                usage(command, "ERROR: unknown cache key\n");
+                return -1;
+            }
+            break;
+        case 'P':
+            args->build_threads = atoi(value);
+            if (args->build_threads < 1) {
+                usage(command, "ERROR: invalid number of build threads\n");
+                return -1;
+            }
+            break;
+        case 'k': {
+            int kernel = simd_find_kernel(value);
+            if (kernel < 0) {
+                usage(command, "ERROR: unknown SIMD kernel\n");
+                return -1;
+            }
+            args->kernel = kernel;
+            break;
+        }
+        }
+    }
+    if (argc)
+        args->fib_file = shift(&argc, &argv);
+    if (argc) {
+        usage(command, "ERROR: too many arguments\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Args args = {0};
+    if (parse_cmdline_opts(argc, argv, &args) < 0)
+        return 1;
+
+    Fib fib;
+    int result = load_fib(args.fib_file, &fib);
+    if (result < 0) {
+        printIOExplanationError(result);
+        return 1;
+    }
+    if (!fib.size) {
+        fprintf(stderr, "ERROR: the FIB is empty\n");
+        fib_free(&fib);
+        return 1;
+    }
+    /* The engines store next hop indexes if they fit, like in
+     * my_route_lookup. Otherwise the interfaces, and the engines with
+     * 16-bit next hops reject the FIB */
+    NextHopTable nexthops;
+    nexthop_init(&nexthops);
+    if (nexthop_intern_all(&nexthops, &fib.entries[0].out_iface, fib.size, sizeof(FibEntry)) < 0)
+        nexthop_free(&nexthops);
+    else
+        nexthop_compress(&nexthops, &fib.entries[0].out_iface, fib.size, sizeof(FibEntry));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    Node *reference_root = compress_trie(create_trie_from_fib(fib.entries, fib.size));
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    double serial = elapsed_ns(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    Node *fused_root = create_compressed_trie_from_fib(fib.entries, fib.size);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    double trie_time = elapsed_ns(&start, &end);  // As my_route_lookup builds it
+    fprintf(stderr, "Trie build: serial %.1f ms, fused %.1f ms (%s)", serial / 1e6, trie_time / 1e6,
+            trie_equal(reference_root, fused_root) ? "same trie" : "DIFFERENT TRIES");
+    free_nodes(fused_root);
+    if (args.build_threads) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        Node *parallel_root = create_trie_parallel(fib.entries, fib.size, args.build_threads, 1);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        fprintf(stderr, ", %d threads %.1f ms (x%.2f, %s)", args.build_threads,
+                elapsed_ns(&start, &end) / 1e6, serial / elapsed_ns(&start, &end),
+                trie_equal(reference_root, parallel_root) ? "same trie" : "DIFFERENT TRIES");
+        free_nodes(parallel_root);
+    }
+    fputs("\n", stderr);
+    Node *root = reference_root;
+    if (args.aggregate) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        root = compress_trie(aggregate_trie(create_trie_from_fib(fib.entries, fib.size)));
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        trie_time = elapsed_ns(&start, &end);
+    }
+
+    /* The best kernel the CPU has, unless a smaller one is asked for */
+    SimdKernel kernel = simd_init(args.kernel);
+    if (args.kernel != SIMD_AUTO && kernel != args.kernel)
+        fprintf(stderr, "WARNING: no %s on this CPU, using %s\n", simd_kernel_name(args.kernel),
+                simd_kernel_name(kernel));
+    fprintf(stderr, "SIMD kernel: %s\n", simd_kernel_name(kernel));
+
+    /* Engines to run. The reference is always built, for the mismatches */
+    const Engine *reference = &engines[0];
+    void *reference_table = reference->build(reference_root, &args.options);
+    const Engine *selected = args.engine;
+    int first_engine = selected ? selected - engines : 0;
+    int last_engine = selected ? first_engine : engine_count - 1;
+    void *tables[engine_count];
+    Result builds[engine_count];
+    for (int e = 0; e < engine_count; ++e) {
+        tables[e] = NULL;
+        if (e < first_engine || e > last_engine)
+            continue;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        tables[e] = engines[e].build(root, &args.options);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        if (!tables[e]) {
+            fprintf(stderr, "ERROR: could not build the %s engine\n", engines[e].name);
+            for (int i = 0; i < e; ++i)
+                if (tables[i]) engines[i].destroy(tables[i]);
+            reference->destroy(reference_table);
+            nexthop_free(&nexthops);
+            fib_free(&fib);
+            node_pool_destroy();
+            return 1;
+        }
+        builds[e].build_time = trie_time + elapsed_ns(&start, &end);
+        builds[e].memory = engines[e].memory(tables[e]);
+    }
+
+    size_t n = args.lookups;
+    uint32_t *ips = malloc(n * sizeof(uint32_t));
+    int *expected = malloc(n * sizeof(int));
+    int *ifaces = malloc(n * sizeof(int));
+    int *accesses = malloc(n * sizeof(int));
+    Histogram *latencies = malloc(sizeof(Histogram));
+    if (!ips || !expected || !ifaces || !accesses || !latencies) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    timer_init(args.timer);
+    int first = 1;
+    print_header(args.format);
+    for (int w = 0; w < workload_count; ++w) {
+        Rng rng = { args.seed };
+        workloads[w].generate(&fib, &rng, ips, n);
+        for (size_t i = 0; i < n; ++i) {
+            int dummy = 0;
+            expected[i] = reference->lookup(reference_table, ips[i], &dummy);
+        }
+        for (int e = first_engine; e <= last_engine; ++e) {
+            Result r = builds[e];
+            r.engine = engines[e].name;
+            r.workload = workloads[w].name;
+            FrontCache cache;
+            if (args.cache_entries)
+                cache_init(&cache, args.cache_entries, args.cache_key, root, NULL);
+            run_engine(&engines[e], tables[e], args.cache_entries ? &cache : NULL, ips, n,
+                       args.batch_size, ifaces, accesses, latencies, &r);
+            if (args.cache_entries)
+                cache_free(&cache);
+            r.mismatches = 0;
+            for (size_t i = 0; i < n; ++i)
+                r.mismatches += ifaces[i] != expected[i];
+            print_result(args.format, &r, first);
+            first = 0;
+            fflush(stdout);
+        }
+    }
+    print_footer(args.format);
+
+    free(ips);
+    free(expected);
+    free(ifaces);
+    free(accesses);
+    free(latencies);
+    for (int e = 0; e < engine_count; ++e)
+        if (tables[e]) engines[e].destroy(tables[e]);
+    reference->destroy(reference_table);
+    nexthop_free(&nexthops);
+    fib_free(&fib);
+    node_pool_destroy();
+    return 0;
+}
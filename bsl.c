@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include "bsl.h"
+#include "utils.h"
+
+/* A prefix or a marker to put in the table of a level */
+typedef struct {
+    int level;
+    uint32_t key;
+} BslKey;
+
+typedef struct {
+    BslKey *items;
+    size_t size;
+    size_t capacity;
+} BslKeys;
+
+#define length_mask(length) ((length) ? 0xFFFFFFFFU << (32 - (length)) : 0)
+
+/* Finalizer of MurmurHash3: neighbouring prefixes must not land in neighbouring slots */
+static inline uint32_t mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Slot of a key in the table of its level, before probing */
+#define home_slot(level, key) \
+    ((uint32_t)hash(mix((key) >> (32 - (level)->length)), (level)->size))
+
+static void *bsl_realloc(void *ptr, size_t size)
+{
+    void *new = realloc(ptr, size);
+    if (!new) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return new;
+}
+
+static void append_key(BslKeys *keys, int level, uint32_t key)
+{
+    if (keys->size == keys->capacity) {
+        keys->capacity = keys->capacity ? 2 * keys->capacity : 1024;
+        keys->items = bsl_realloc(keys->items, keys->capacity * sizeof(BslKey));
+    }
+    keys->items[keys->size++] = (BslKey) { .level = level, .key = key };
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Find the prefix lengths of the FIB (lengths[l] is set if there is a
+ * /l route) and check that the next hops fit in a slot.
+ **********************************************************************/
+static int find_lengths(const Node *node, int *lengths)
+{
+    if (!node) return 0;
+    if (node->out_iface != NO_IFACE) {
+        if (node->out_iface < 0) {
+            fprintf(stderr, "ERROR: output interface %d does not fit in a hash slot\n", node->out_iface);
+            return -1;
+        }
+        lengths[node->prefix_length] = 1;
+    }
+    if (find_lengths(node->left, lengths) < 0) return -1;
+    return find_lengths(node->right, lengths);
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Add every prefix of the FIB to the table of its level, and a marker
+ * to the table of every level where the binary search must go on to
+ * longer lengths to find it.
+ **********************************************************************/
+static void collect_keys(BslKeys *keys, const Node *node, const int *level_of,
+                         const BslLevel *levels, int level_count)
+{
+    if (!node) return;
+    if (node->out_iface != NO_IFACE && node->prefix_length) {
+        int target = level_of[node->prefix_length];
+        int low = 0, high = level_count - 1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            if (mid == target) break;
+            if (mid < target) {
+                append_key(keys, mid, node->prefix & length_mask(levels[mid].length));
+                low = mid + 1;
+            } else {
+                high = mid - 1;
+            }
+        }
+        append_key(keys, target, node->prefix);
+    }
+    collect_keys(keys, node->left, level_of, levels, level_count);
+    collect_keys(keys, node->right, level_of, levels, level_count);
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    const BslKey *x = a, *y = b;
+    if (x->level != y->level) return x->level - y->level;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/* Next hop of the longest prefix of the trie containing key/length */
+static int best_matching_prefix(const Node *root, uint32_t key, int length)
+{
+    int best = NO_IFACE;
+    const Node *node = root;
+    while (node && node->prefix_length <= length) {
+        uint32_t mask = length_mask(node->prefix_length);
+        if ((key & mask) != (node->prefix & mask))
+            break;
+        if (node->out_iface != NO_IFACE)
+            best = node->out_iface;
+        if (node->prefix_length == 32)
+            break;
+        node = node->child[(key >> (31 - node->prefix_length)) & 1];
+    }
+    return best;
+}
+
+/**********************************************************************
+ * Build the tables with the prefixes of a (compressed) Patricia trie.
+ **********************************************************************/
+BslTable *bsl_create(Node *root)
+{
+    int lengths[IP_ADDRESS_LENGTH + 1] = {0};
+    if (find_lengths(root, lengths) < 0)
+        return NULL;
+
+    BslTable *table = calloc(1, sizeof(BslTable));
+    BslLevel *levels = calloc(IP_ADDRESS_LENGTH, sizeof(BslLevel));
+    if (!table || !levels) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    /* The /0 route is not looked for, it is where every search starts */
+    int level_of[IP_ADDRESS_LENGTH + 1];
+    int level_count = 0;
+    for (int length = 1; length <= IP_ADDRESS_LENGTH; ++length) {
+        level_of[length] = level_count;
+        if (lengths[length])
+            levels[level_count++].length = length;
+    }
+    table->header.default_iface = best_matching_prefix(root, 0, 0);
+    table->header.level_count = level_count;
+
+    BslKeys keys = {0};
+    collect_keys(&keys, root, level_of, levels, level_count);
+    qsort(keys.items, keys.size, sizeof(BslKey), compare_keys);
+
+    /* Tables at most half full, in level order */
+    size_t slot_count = 0;
+    for (size_t i = 0, j; i < keys.size; i = j) {
+        size_t entries = 0;
+        for (j = i; j < keys.size && keys.items[j].level == keys.items[i].level; ++j)
+            entries += j == i || keys.items[j].key != keys.items[j - 1].key;
+        BslLevel *level = &levels[keys.items[i].level];
+        level->size = 1;
+        while (level->size < 2 * entries)
+            level->size <<= 1;
+        level->first = slot_count;
+        slot_count += level->size;
+    }
+
+    BslSlot *slots = bsl_realloc(NULL, (slot_count ? slot_count : 1) * sizeof(BslSlot));
+    for (size_t i = 0; i < slot_count; ++i)
+        slots[i] = (BslSlot) { .bmp = BSL_EMPTY };
+    for (size_t i = 0; i < keys.size; ++i) {
+        if (i && !compare_keys(&keys.items[i], &keys.items[i - 1]))
+            continue;
+        const BslLevel *level = &levels[keys.items[i].level];
+        uint32_t key = keys.items[i].key;
+        uint32_t slot = home_slot(level, key);
+        while (slots[level->first + slot].bmp != BSL_EMPTY)
+            slot = (slot + 1) & (level->size - 1);
+        slots[level->first + slot] = (BslSlot) {
+            .key = key,
+            .bmp = best_matching_prefix(root, key, level->length),
+        };
+        table->header.entries += 1;
+    }
+    free(keys.items);
+
+    table->levels = levels;
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return table;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one.
+ **********************************************************************/
+int bsl_lookup(const BslTable *table, uint32_t ip, int *accesses)
+{
+    int best = table->header.default_iface;
+    int low = 0, high = table->header.level_count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        const BslLevel *level = &table->levels[mid];
+        const BslSlot *slots = table->slots + level->first;
+        uint32_t key = ip & length_mask(level->length);
+        uint32_t slot = home_slot(level, key);
+        int found = 0;
+        for (;;) {
+            *accesses += 1;
+            if (slots[slot].bmp == BSL_EMPTY)
+                break;
+            if (slots[slot].key == key) {
+                found = 1;
+                break;
+            }
+            slot = (slot + 1) & (level->size - 1);
+        }
+        if (found) {
+            best = slots[slot].bmp;  // Already takes the shorter prefixes into account
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return best;
+}
+
+/**********************************************************************
+ * Check the levels of tables read from a snapshot.
+ **********************************************************************/
+int bsl_validate(const BslTable *table)
+{
+    if (table->header.level_count < 0 || table->header.level_count > IP_ADDRESS_LENGTH)
+        return -1;
+    for (int l = 0; l < table->header.level_count; ++l) {
+        const BslLevel *level = &table->levels[l];
+        if (!level->size || level->size & (level->size - 1) ||
+            level->first + (size_t)level->size > table->slot_count ||
+            level->length < 1 || level->length > IP_ADDRESS_LENGTH)
+            return -1;
+        uint32_t free_slots = 0;
+        for (uint32_t s = 0; s < level->size; ++s)
+            free_slots += table->slots[level->first + s].bmp == BSL_EMPTY;
+        if (!free_slots)
+            return -1;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Free the tables.
+ **********************************************************************/
+void bsl_free(BslTable *table)
+{
+    if (!table) return;
+    free(table->levels);
+    free(table->slots);
+    free(table);
+}
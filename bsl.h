@@ -0,0 +1,104 @@
+#ifndef BSL_H
+#define BSL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "node.h"
+
+#define BSL_EMPTY -1
+
+/**********************************************************************
+ * BSL SLOT
+ * Entry of the hash table of a prefix length: a prefix of the FIB or a
+ * marker left on the way to a longer one.
+ * Fields:
+ *  - key: the prefix, with the bits past the length cleared.
+ *  - bmp: best matching prefix, the next hop of the longest prefix of
+ *  the FIB that is no longer than the level and contains the key.
+ *  BSL_EMPTY if the slot is free.
+ **********************************************************************/
+typedef struct {
+    uint32_t key;
+    int32_t bmp;
+} BslSlot;
+
+/**********************************************************************
+ * BSL LEVEL
+ * Hash table of one prefix length, stored in the common slot array.
+ * Fields:
+ *  - first: index of its first slot.
+ *  - size: number of slots, a power of two.
+ *  - length: the prefix length.
+ **********************************************************************/
+typedef struct {
+    uint32_t first;
+    uint32_t size;
+    uint32_t length;
+} BslLevel;
+
+/**********************************************************************
+ * BSL HEADER
+ * Fields:
+ *  - default_iface: next hop of the /0 route, NO_IFACE if there is none.
+ *  - level_count: number of levels, sorted by length.
+ *  - entries: slots in use, prefixes and markers.
+ **********************************************************************/
+typedef struct {
+    int32_t default_iface;
+    int32_t level_count;
+    int32_t entries;
+    int32_t reserved;
+} BslHeader;
+
+/**********************************************************************
+ * BINARY SEARCH ON LENGTHS (Waldvogel, Varghese, Turner & Plattner)
+ * One open-addressing hash table per prefix length in the FIB, and a
+ * binary search over the lengths: a hit goes on with the longer half,
+ * a miss with the shorter one. The prefixes leave markers in the
+ * tables the search visits before reaching their length, and every
+ * entry knows its best matching prefix, so the search never has to
+ * backtrack. About log2(levels) + 1 probes per lookup.
+ * Fields:
+ *  - header: see above.
+ *  - levels: the levels, by length.
+ *  - slots: the hash tables of every level, one after another.
+ *  - slot_count: number of slots.
+ **********************************************************************/
+typedef struct {
+    BslHeader header;
+    BslLevel *levels;
+    BslSlot *slots;
+    size_t slot_count;
+} BslTable;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Build the tables with the prefixes of a (compressed) Patricia trie.
+ * Returns NULL if a next hop does not fit in a slot.
+ **********************************************************************/
+BslTable *bsl_create(Node *root);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one.
+ * Args:
+ *  - const BslTable *table: the tables.
+ *  - uint32_t ip: the IP for which to look up a next hop.
+ *  - int *accesses: variable declared outside the function, the
+ *  number of hash slots probed is added to it.
+ **********************************************************************/
+int bsl_lookup(const BslTable *table, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * Check that the levels are inside the slot array, with a power of two
+ * of slots and a valid length, and that every level has a free slot to
+ * end the probes of a missing key. Returns 0, or -1 if it is broken.
+ **********************************************************************/
+int bsl_validate(const BslTable *table);
+
+/**********************************************************************
+ * Free the tables.
+ **********************************************************************/
+void bsl_free(BslTable *table);
+
+#endif // BSL_H
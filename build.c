@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "build.h"
+#include "utils.h"
+
+#define BUILD_BUCKETS (1 << BUILD_PARTITION_BITS)
+#define SORT_KEY_BITS 40  // 32 bits of prefix and 8 of length
+
+/* A route as it is sorted: masked prefix << 8 | length */
+typedef struct {
+    uint64_t key;
+    int out_iface;
+} SortedRoute;
+
+#define route_prefix(route) ((uint32_t)((route).key >> 8))
+#define route_length(route) ((int)((route).key & 0xFF))
+
+/* What a thread needs to build subtries */
+typedef struct {
+    const SortedRoute *routes;
+    const size_t *bucket_start;  // Routes of bucket b: [bucket_start[b], bucket_start[b + 1])
+    Node **subtries;
+    atomic_int *next_bucket;
+    int compress;
+    NodePool pool;
+} BuildWorker;
+
+static void *build_alloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return p;
+}
+
+/**********************************************************************
+ * Stable LSD radix sort of the routes by key, a byte per pass. The
+ * passes where every key has the same byte are skipped.
+ **********************************************************************/
+static void radix_sort(SortedRoute *routes, size_t count)
+{
+    SortedRoute *buffer = build_alloc(count * sizeof(SortedRoute));
+    SortedRoute *from = routes, *to = buffer;
+    for (int shift = 0; shift < SORT_KEY_BITS; shift += 8) {
+        size_t start[256] = {0};
+        for (size_t i = 0; i < count; ++i)
+            start[(from[i].key >> shift) & 0xFF] += 1;
+        if (start[(from[0].key >> shift) & 0xFF] == count)
+            continue;
+        size_t sum = 0;
+        for (int d = 0; d < 256; ++d) {
+            size_t n = start[d];
+            start[d] = sum;
+            sum += n;
+        }
+        for (size_t i = 0; i < count; ++i)
+            to[start[(from[i].key >> shift) & 0xFF]++] = from[i];
+        SortedRoute *tmp = from;
+        from = to;
+        to = tmp;
+    }
+    if (from != routes) {
+        for (size_t i = 0; i < count; ++i)
+            routes[i] = from[i];
+    }
+    free(buffer);
+}
+
+static void insert_route(Node *root, const SortedRoute *route, int compress)
+{
+    if (compress) {
+        insert_compressed(root, route_prefix(*route), route_length(*route), route->out_iface);
+        return;
+    }
+    Node new_node = (Node) {
+        .prefix = route_prefix(*route),
+        .prefix_length = route_length(*route),
+        .out_iface = route->out_iface,
+    };
+    insert_node(root, &new_node);
+}
+
+/**********************************************************************
+ * Build the subtries of the buckets taken from the shared counter, with
+ * the nodes of the pool of the worker. Compressed subtries are built
+ * compressed from the start (see `insert_compressed`).
+ **********************************************************************/
+static void *build_thread(void *arg)
+{
+    BuildWorker *worker = arg;
+    node_pool_use(&worker->pool);
+    for (;;) {
+        int b = atomic_fetch_add(worker->next_bucket, 1);
+        if (b >= BUILD_BUCKETS)
+            break;
+        size_t first = worker->bucket_start[b], last = worker->bucket_start[b + 1];
+        if (first == last)
+            continue;
+        Node *subtrie = node_alloc();
+        subtrie->prefix_length = BUILD_PARTITION_BITS;
+        subtrie->prefix = (uint32_t)b << (IP_ADDRESS_LENGTH - BUILD_PARTITION_BITS);
+        for (size_t i = first; i < last; ++i)
+            insert_route(subtrie, &worker->routes[i], worker->compress);
+        if (worker->compress)
+            subtrie = compress_root(subtrie);
+        worker->subtries[b] = subtrie;
+    }
+    node_pool_use(NULL);
+    return NULL;
+}
+
+/**********************************************************************
+ * Hang a subtrie of a bucket under the root, with the in-between nodes
+ * `insert_node` would have made on the way.
+ **********************************************************************/
+static void stitch(Node *root, uint32_t prefix, Node *subtrie)
+{
+    Node *node = root;
+    for (int length = 0; length < BUILD_PARTITION_BITS - 1; ++length) {
+        int bit = (prefix >> (31 - length)) & 1;
+        if (!node->child[bit]) {
+            Node *child = node_alloc();
+            child->prefix_length = length + 1;
+            child->prefix = node->prefix | ((uint32_t)bit << (31 - length));
+            node->child[bit] = child;
+        }
+        node = node->child[bit];
+    }
+    node->child[(prefix >> (32 - BUILD_PARTITION_BITS)) & 1] = subtrie;
+}
+
+/**********************************************************************
+ * Bulk-build the Patricia trie of a FIB with several threads.
+ **********************************************************************/
+Node *create_trie_parallel(const FibEntry *entries, size_t count, int threads, int compress)
+{
+    if (threads < 1) threads = 1;
+    if (threads > BUILD_BUCKETS) threads = BUILD_BUCKETS;
+
+    SortedRoute *routes = build_alloc(count * sizeof(SortedRoute));
+    for (size_t i = 0; i < count; ++i) {
+        int length = entries[i].prefix_length;
+        uint32_t mask = length ? 0xFFFFFFFFU << (IP_ADDRESS_LENGTH - length) : 0;
+        routes[i].key = (uint64_t)(entries[i].prefix & mask) << 8 | (uint64_t)length;
+        routes[i].out_iface = entries[i].out_iface;
+    }
+    if (count)
+        radix_sort(routes, count);
+
+    /* The copies of a route are together, in file order: keep the last
+     * one. The short routes go to the root, the rest stay sorted, which
+     * leaves the buckets one after another. */
+    Node *root = node_alloc();
+    size_t kept = 0;
+    size_t bucket_start[BUILD_BUCKETS + 1] = {0};
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 1 < count && routes[i + 1].key == routes[i].key)
+            continue;
+        if (route_length(routes[i]) < BUILD_PARTITION_BITS) {
+            insert_route(root, &routes[i], 0);
+            continue;
+        }
+        bucket_start[(route_prefix(routes[i]) >> (IP_ADDRESS_LENGTH - BUILD_PARTITION_BITS)) + 1] += 1;
+        routes[kept++] = routes[i];
+    }
+    for (int b = 0; b < BUILD_BUCKETS; ++b)
+        bucket_start[b + 1] += bucket_start[b];
+
+    Node **subtries = build_alloc(BUILD_BUCKETS * sizeof(Node *));
+    BuildWorker *workers = build_alloc(threads * sizeof(BuildWorker));
+    pthread_t *ids = build_alloc(threads * sizeof(pthread_t));
+    atomic_int next_bucket = 0;
+    for (int b = 0; b < BUILD_BUCKETS; ++b)
+        subtries[b] = NULL;
+    for (int t = 0; t < threads; ++t) {
+        workers[t] = (BuildWorker) {
+            .routes = routes,
+            .bucket_start = bucket_start,
+            .subtries = subtries,
+            .next_bucket = &next_bucket,
+            .compress = compress,
+        };
+    }
+
+    /* The calling thread builds too, so the buckets a thread that could
+     * not be created would have taken are not lost */
+    int started = 1;
+    while (started < threads && !pthread_create(&ids[started], NULL, build_thread, &workers[started]))
+        started += 1;
+    build_thread(&workers[0]);
+    for (int t = 1; t < started; ++t)
+        pthread_join(ids[t], NULL);
+
+    for (int t = 0; t < threads; ++t)
+        node_pool_merge(&workers[t].pool);
+    for (int b = 0; b < BUILD_BUCKETS; ++b)
+        if (subtries[b])
+            stitch(root, (uint32_t)b << (IP_ADDRESS_LENGTH - BUILD_PARTITION_BITS), subtries[b]);
+    if (compress)
+        root = compress_trie_above(root, BUILD_PARTITION_BITS);
+
+    free(ids);
+    free(workers);
+    free(subtries);
+    free(routes);
+    return root;
+}
@@ -0,0 +1,30 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+#include <stddef.h>
+#include "node.h"
+#include "fib.h"
+
+/* Bits of the prefixes that choose the subtrie a route is built in */
+#define BUILD_PARTITION_BITS 8
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Bulk-build the Patricia trie of a FIB with `threads` threads (the
+ * calling one included). The routes are radix sorted by prefix and
+ * length, and the ones longer than BUILD_PARTITION_BITS are split by
+ * their first bits in subtries that are built, each one in a node pool
+ * of its thread, and compressed in parallel. The subtries are then
+ * stitched under the root, which holds the shorter routes.
+ * The trie is the same, node by node, as the one of
+ * `create_trie_from_fib` (and `compress_trie` if `compress`). When a
+ * route is repeated in the FIB, the last next hop wins, as well.
+ * Args:
+ *  - const FibEntry *entries, size_t count: the FIB, in file order.
+ *  - int threads: number of threads.
+ *  - int compress: 1 to return the trie compressed, 0 to return it as
+ *  `create_trie_from_fib` does (for `aggregate_trie`).
+ **********************************************************************/
+Node *create_trie_parallel(const FibEntry *entries, size_t count, int threads, int compress);
+
+#endif // BUILD_H
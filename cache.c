@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cache.h"
+
+#define CACHE_LINE 64
+_Static_assert(CACHE_WAYS * sizeof(CacheEntry) == CACHE_LINE, "a set must be a cache line");
+
+typedef struct {
+    uint32_t *items;
+    size_t size;
+    size_t capacity;
+} Subnets;
+
+static void *cache_realloc(void *ptr, size_t size)
+{
+    void *new = realloc(ptr, size);
+    if (!new) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return new;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Collect the /24s of the routes longer than /24.
+ **********************************************************************/
+static void find_long_routes(Subnets *subnets, const Node *node)
+{
+    if (!node) return;
+    if (node->prefix_length > 24 && node->out_iface != NO_IFACE) {
+        if (subnets->size == subnets->capacity) {
+            subnets->capacity = subnets->capacity ? 2 * subnets->capacity : 256;
+            subnets->items = cache_realloc(subnets->items, subnets->capacity * sizeof(uint32_t));
+        }
+        subnets->items[subnets->size++] = node->prefix >> 8;
+    }
+    find_long_routes(subnets, node->left);
+    find_long_routes(subnets, node->right);
+}
+
+static int compare_subnets(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**********************************************************************
+ * Create an empty cache.
+ **********************************************************************/
+void cache_init(FrontCache *cache, size_t entries, CacheKey key, Node *root,
+                const _Atomic uint32_t *generation)
+{
+    size_t sets = 1;
+    while (sets * CACHE_WAYS < entries)
+        sets <<= 1;
+    *cache = (FrontCache) {
+        .set_mask = sets - 1,
+        .key = key,
+        .generation = generation,
+    };
+    cache->entries = aligned_alloc(CACHE_LINE, sets * CACHE_WAYS * sizeof(CacheEntry));
+    if (!cache->entries) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < sets * CACHE_WAYS; ++i)
+        cache->entries[i] = (CacheEntry) { .out_iface = CACHE_EMPTY };
+
+    if (key == CACHE_KEY_24) {
+        Subnets subnets = {0};
+        find_long_routes(&subnets, root);
+        qsort(subnets.items, subnets.size, sizeof(uint32_t), compare_subnets);
+        size_t unique = 0;
+        for (size_t i = 0; i < subnets.size; ++i)
+            if (!unique || subnets.items[i] != subnets.items[unique - 1])
+                subnets.items[unique++] = subnets.items[i];
+        cache->excluded = subnets.items;
+        cache->excluded_count = unique;
+    }
+}
+
+static inline uint32_t key_of(const FrontCache *cache, uint32_t ip)
+{
+    return cache->key == CACHE_KEY_24 ? ip >> 8 : ip;
+}
+
+static inline CacheEntry *set_of(const FrontCache *cache, uint32_t key)
+{
+    return &cache->entries[((key * 2654435761U) >> 7 & cache->set_mask) * CACHE_WAYS];
+}
+
+static inline uint32_t current_generation(const FrontCache *cache)
+{
+    return cache->generation ? atomic_load(cache->generation) : 0;
+}
+
+/* Cached result of an IP, or CACHE_EMPTY */
+static inline int probe(FrontCache *cache, uint32_t ip, uint32_t generation)
+{
+    uint32_t key = key_of(cache, ip);
+    CacheEntry *set = set_of(cache, key);
+    for (int way = 0; way < CACHE_WAYS; ++way) {
+        if (set[way].key == key && set[way].out_iface != CACHE_EMPTY &&
+            set[way].generation == generation) {
+            set[way].stamp = ++cache->clock;
+            cache->hits += 1;
+            return set[way].out_iface;
+        }
+    }
+    cache->misses += 1;
+    return CACHE_EMPTY;
+}
+
+static int is_excluded(const FrontCache *cache, uint32_t key)
+{
+    return cache->excluded_count &&
+           bsearch(&key, cache->excluded, cache->excluded_count, sizeof(uint32_t), compare_subnets);
+}
+
+/* Cache the result of an IP, in place of the least recently used way */
+static void insert(FrontCache *cache, uint32_t ip, int out_iface, uint32_t generation)
+{
+    uint32_t key = key_of(cache, ip);
+    if (cache->key == CACHE_KEY_24 && is_excluded(cache, key))
+        return;
+    CacheEntry *set = set_of(cache, key);
+    CacheEntry *victim = &set[0];
+    for (int way = 0; way < CACHE_WAYS; ++way) {
+        if (set[way].out_iface == CACHE_EMPTY || set[way].key == key) {
+            victim = &set[way];  // A free way, or a stale copy of this key
+            break;
+        }
+        if (set[way].stamp < victim->stamp)
+            victim = &set[way];
+    }
+    if (victim->out_iface != CACHE_EMPTY && victim->key != key)
+        cache->evictions += 1;
+    *victim = (CacheEntry) {
+        .key = key,
+        .out_iface = out_iface,
+        .generation = generation,
+        .stamp = ++cache->clock,
+    };
+}
+
+/**********************************************************************
+ * Look up an IP through the cache.
+ **********************************************************************/
+int cache_lookup(FrontCache *cache, const Engine *engine, const void *table, uint32_t ip,
+                 int *accesses)
+{
+    /* Read before the lookup: a result is never newer than its generation */
+    uint32_t generation = current_generation(cache);
+    *accesses += 1;
+    int out_iface = probe(cache, ip, generation);
+    if (out_iface != CACHE_EMPTY)
+        return out_iface;
+    out_iface = engine->lookup(table, ip, accesses);
+    insert(cache, ip, out_iface, generation);
+    return out_iface;
+}
+
+/**********************************************************************
+ * Look up a batch of IPs through the cache.
+ **********************************************************************/
+void cache_lookup_batch(FrontCache *cache, const Engine *engine, const void *table,
+                        const uint32_t *ips, int *ifaces, int *accesses, size_t n)
+{
+    if (n > cache->miss_capacity) {
+        cache->miss_capacity = n;
+        cache->miss_ips = cache_realloc(cache->miss_ips, n * sizeof(uint32_t));
+        cache->miss_ifaces = cache_realloc(cache->miss_ifaces, n * sizeof(int));
+        cache->miss_accesses = cache_realloc(cache->miss_accesses, n * sizeof(int));
+        cache->miss_index = cache_realloc(cache->miss_index, n * sizeof(size_t));
+    }
+    uint32_t generation = current_generation(cache);
+    size_t misses = 0;
+    for (size_t i = 0; i < n; ++i) {
+        accesses[i] = 1;
+        ifaces[i] = probe(cache, ips[i], generation);
+        if (ifaces[i] == CACHE_EMPTY) {
+            cache->miss_ips[misses] = ips[i];
+            cache->miss_index[misses++] = i;
+        }
+    }
+    if (!misses)
+        return;
+    engine_lookup_batch(engine, table, cache->miss_ips, cache->miss_ifaces,
+                        cache->miss_accesses, misses);
+    for (size_t m = 0; m < misses; ++m) {
+        size_t i = cache->miss_index[m];
+        ifaces[i] = cache->miss_ifaces[m];
+        accesses[i] += cache->miss_accesses[m];
+        insert(cache, ips[i], ifaces[i], generation);
+    }
+}
+
+/**********************************************************************
+ * Free the cache.
+ **********************************************************************/
+void cache_free(FrontCache *cache)
+{
+    free(cache->entries);
+    free(cache->excluded);
+    free(cache->miss_ips);
+    free(cache->miss_ifaces);
+    free(cache->miss_accesses);
+    free(cache->miss_index);
+    *cache = (FrontCache) {0};
+}
@@ -0,0 +1,108 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "engine.h"
+
+#define CACHE_WAYS 4
+#define CACHE_EMPTY -1
+
+/**********************************************************************
+ * CACHE KEY
+ *  - CACHE_KEY_IP: the exact destination.
+ *  - CACHE_KEY_24: the /24 of the destination, so one entry serves a
+ *  whole subnet. The /24s with longer routes are never cached.
+ **********************************************************************/
+typedef enum {
+    CACHE_KEY_IP,
+    CACHE_KEY_24,
+} CacheKey;
+
+/**********************************************************************
+ * CACHE ENTRY
+ * Fields:
+ *  - key: the IP, or its /24 (IP >> 8).
+ *  - out_iface: the result of the lookup, CACHE_EMPTY if the entry is
+ *  free.
+ *  - generation: of the routes when the lookup was done.
+ *  - stamp: last use, for LRU replacement inside the set.
+ **********************************************************************/
+typedef struct {
+    uint32_t key;
+    int32_t out_iface;
+    uint32_t generation;
+    uint32_t stamp;
+} CacheEntry;
+
+/**********************************************************************
+ * FRONT CACHE
+ * Set-associative cache of lookup results in front of any engine:
+ * CACHE_WAYS entries (one cache line) per set, LRU inside the set.
+ * A cache is used by a single thread.
+ * Fields:
+ *  - entries: the sets, one after another.
+ *  - set_mask: sets - 1, the number of sets is a power of two.
+ *  - key: see CacheKey.
+ *  - excluded, excluded_count: sorted /24s that have longer routes.
+ *  - generation: generation of the routes (see `RcuTrie`), NULL if they
+ *  never change. Entries of an older generation are misses.
+ *  - clock: source of the stamps.
+ *  - miss_ips, miss_ifaces, miss_accesses, miss_index, miss_capacity:
+ *  the misses of a batch, looked up together.
+ *  - hits, misses, evictions: counters for the summary.
+ **********************************************************************/
+typedef struct {
+    CacheEntry *entries;
+    uint32_t set_mask;
+    CacheKey key;
+    uint32_t *excluded;
+    size_t excluded_count;
+    const _Atomic uint32_t *generation;
+    uint32_t clock;
+    uint32_t *miss_ips;
+    int *miss_ifaces;
+    int *miss_accesses;
+    size_t *miss_index;
+    size_t miss_capacity;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} FrontCache;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create an empty cache.
+ * Args:
+ *  - size_t entries: capacity, rounded up to a power of two number of
+ *  sets.
+ *  - CacheKey key: see CacheKey.
+ *  - Node *root: the compressed trie, to find the /24s that cannot be
+ *  cached. Only needed with CACHE_KEY_24.
+ *  - const _Atomic uint32_t *generation: see FrontCache.
+ **********************************************************************/
+void cache_init(FrontCache *cache, size_t entries, CacheKey key, Node *root,
+                const _Atomic uint32_t *generation);
+
+/**********************************************************************
+ * Look up an IP through the cache: a hit costs one access, a miss one
+ * access plus the lookup of the engine, whose result is cached.
+ * Same contract as `lookup`.
+ **********************************************************************/
+int cache_lookup(FrontCache *cache, const Engine *engine, const void *table, uint32_t ip,
+                 int *accesses);
+
+/**********************************************************************
+ * Look up a batch of IPs through the cache: the misses are looked up
+ * together with `engine_lookup_batch`. Same contract as `lookup_batch`.
+ **********************************************************************/
+void cache_lookup_batch(FrontCache *cache, const Engine *engine, const void *table,
+                        const uint32_t *ips, int *ifaces, int *accesses, size_t n);
+
+/**********************************************************************
+ * Free the cache.
+ **********************************************************************/
+void cache_free(FrontCache *cache);
+
+#endif // CACHE_H
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include "dir248.h"
+
+static void *dir248_calloc(size_t count, size_t size)
+{
+    void *new = calloc(count, size);
+    if (!new) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return new;
+}
+
+/**********************************************************************
+ * Allocate an empty table (every entry is NO_IFACE).
+ **********************************************************************/
+Dir248 *dir248_alloc(void)
+{
+    Dir248 *dir = dir248_calloc(1, sizeof(Dir248));
+    dir->tbl24 = dir248_calloc(DIR248_TBL24_SIZE, sizeof(uint16_t));
+    dir->len24 = dir248_calloc(DIR248_TBL24_SIZE, sizeof(uint8_t));
+    return dir;
+}
+
+/* Write the entries [first, first + count) of a block shorter or equal than prefix_length */
+static void paint_block(Dir248 *dir, int block, uint32_t first, uint32_t count,
+                        int prefix_length, int out_iface)
+{
+    uint32_t base = (uint32_t)block << 8;
+    for (uint32_t i = base + first; i < base + first + count; ++i) {
+        if (dir->len_long[i] <= prefix_length) {
+            dir->tbllong[i] = out_iface;
+            dir->len_long[i] = prefix_length;
+        }
+    }
+}
+
+/* Move a tbl24 entry to a new block of tbllong. Returns the block */
+static int expand_entry(Dir248 *dir, uint32_t index)
+{
+    if (dir->long_blocks == DIR248_MAX_BLOCKS)
+        return -1;
+    if (dir->long_blocks == dir->long_capacity) {
+        dir->long_capacity = dir->long_capacity ? 2 * dir->long_capacity : 64;
+        dir->tbllong = realloc(dir->tbllong, ((size_t)dir->long_capacity << 8) * sizeof(uint16_t));
+        dir->len_long = realloc(dir->len_long, (size_t)dir->long_capacity << 8);
+        if (!dir->tbllong || !dir->len_long) {
+            fprintf(stderr, "Buy more RAM lol\n");
+            exit(1);
+        }
+    }
+    int block = dir->long_blocks++;
+    for (uint32_t i = (uint32_t)block << 8; i < ((uint32_t)block + 1) << 8; ++i) {
+        dir->tbllong[i] = dir->tbl24[index];
+        dir->len_long[i] = dir->len24[index];
+    }
+    dir->tbl24[index] = DIR248_LONG_FLAG | block;
+    return block;
+}
+
+/**********************************************************************
+ * Insert a FIB entry. The entries can come in any order: an entry only
+ * overwrites the ones written by shorter (or equal) prefixes.
+ * Returns 0, or -1 if the entry does not fit in the table.
+ **********************************************************************/
+int dir248_insert(Dir248 *dir, uint32_t prefix, int prefix_length, int out_iface)
+{
+    if (out_iface < 0 || out_iface > DIR248_MAX_IFACE) {
+        fprintf(stderr, "ERROR: output interface %d does not fit in a DIR-24-8 entry\n", out_iface);
+        return -1;
+    }
+
+    if (prefix_length <= 24) {
+        uint32_t first = prefix_length ? prefix >> 8 & (0xFFFFFFu << (24 - prefix_length)) : 0;
+        uint32_t count = 1U << (24 - prefix_length);
+        for (uint32_t i = first; i < first + count; ++i) {
+            if (dir->tbl24[i] & DIR248_LONG_FLAG) {
+                paint_block(dir, dir->tbl24[i] & ~DIR248_LONG_FLAG, 0, 256, prefix_length, out_iface);
+            } else if (dir->len24[i] <= prefix_length) {
+                dir->tbl24[i] = out_iface;
+                dir->len24[i] = prefix_length;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t index = prefix >> 8;
+    int block = dir->tbl24[index] & DIR248_LONG_FLAG
+              ? dir->tbl24[index] & ~DIR248_LONG_FLAG
+              : expand_entry(dir, index);
+    if (block < 0) {
+        fprintf(stderr, "ERROR: too many prefixes longer than /24 for DIR-24-8\n");
+        return -1;
+    }
+    uint32_t count = 1U << (32 - prefix_length);
+    paint_block(dir, block, prefix & 0xFF & ~(count - 1), count, prefix_length, out_iface);
+    return 0;
+}
+
+/**********************************************************************
+ * Free the data only needed for the insertions.
+ **********************************************************************/
+void dir248_finish(Dir248 *dir)
+{
+    free(dir->len24);
+    free(dir->len_long);
+    dir->len24 = NULL;
+    dir->len_long = NULL;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Insert every node with a next hop of the trie.
+ **********************************************************************/
+static int insert_trie(Dir248 *dir, Node *node)
+{
+    if (!node) return 0;
+    if (node->out_iface != NO_IFACE &&
+        dir248_insert(dir, node->prefix, node->prefix_length, node->out_iface) < 0)
+        return -1;
+    if (insert_trie(dir, node->left) < 0) return -1;
+    return insert_trie(dir, node->right);
+}
+
+/**********************************************************************
+ * Build the table with the FIB entries stored in a Patricia trie.
+ **********************************************************************/
+Dir248 *dir248_create(Node *root)
+{
+    Dir248 *dir = dir248_alloc();
+    if (insert_trie(dir, root) < 0) {
+        dir248_free(dir);
+        return NULL;
+    }
+    dir248_finish(dir);
+    return dir;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one. It takes 1 or 2 memory accesses.
+ **********************************************************************/
+int dir248_lookup(const Dir248 *dir, uint32_t ip, int *accesses)
+{
+    uint16_t entry = dir->tbl24[ip >> 8];
+    *accesses += 1;
+    if (entry & DIR248_LONG_FLAG) {
+        entry = dir->tbllong[(uint32_t)(entry & ~DIR248_LONG_FLAG) << 8 | (ip & 0xFF)];
+        *accesses += 1;
+    }
+    return entry;
+}
+
+/**********************************************************************
+ * Look up a batch of IPs, prefetching a group at a time.
+ **********************************************************************/
+void dir248_lookup_batch(const Dir248 *dir, const uint32_t *ips, int *ifaces,
+                         int *accesses, size_t n)
+{
+    for (size_t first = 0; first < n; first += LOOKUP_BATCH_GROUP) {
+        size_t last = first + LOOKUP_BATCH_GROUP < n ? first + LOOKUP_BATCH_GROUP : n;
+        for (size_t i = first; i < last; ++i)
+            __builtin_prefetch(&dir->tbl24[ips[i] >> 8]);
+        for (size_t i = first; i < last; ++i) {
+            uint16_t entry = dir->tbl24[ips[i] >> 8];
+            ifaces[i] = entry;
+            accesses[i] = 1;
+            if (entry & DIR248_LONG_FLAG)
+                __builtin_prefetch(&dir->tbllong[(uint32_t)(entry & ~DIR248_LONG_FLAG) << 8 | (ips[i] & 0xFF)]);
+        }
+        for (size_t i = first; i < last; ++i) {
+            if (ifaces[i] & DIR248_LONG_FLAG) {
+                ifaces[i] = dir->tbllong[(uint32_t)(ifaces[i] & ~DIR248_LONG_FLAG) << 8 | (ips[i] & 0xFF)];
+                accesses[i] = 2;
+            }
+        }
+    }
+}
+
+/**********************************************************************
+ * Check the long block indexes of a table read from a snapshot.
+ **********************************************************************/
+int dir248_validate(const Dir248 *dir)
+{
+    for (uint32_t i = 0; i < DIR248_TBL24_SIZE; ++i) {
+        uint16_t entry = dir->tbl24[i];
+        if (entry & DIR248_LONG_FLAG && (int)(entry & ~DIR248_LONG_FLAG) >= dir->long_blocks)
+            return -1;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Free the table.
+ **********************************************************************/
+void dir248_free(Dir248 *dir)
+{
+    if (!dir) return;
+    dir248_finish(dir);
+    free(dir->tbl24);
+    free(dir->tbllong);
+    free(dir);
+}
@@ -0,0 +1,82 @@
+#ifndef DIR248_H
+#define DIR248_H
+
+#include <stdint.h>
+#include "node.h"
+
+#define DIR248_TBL24_SIZE (1 << 24)
+#define DIR248_LONG_FLAG 0x8000
+#define DIR248_MAX_IFACE 0x7FFF
+#define DIR248_MAX_BLOCKS 0x8000
+
+/**********************************************************************
+ * DIR-24-8 TABLE (Gupta, Lin & McKeown)
+ * Fields:
+ *  - tbl24: indexed by the 24 most significant bits of the IP. If the
+ *  DIR248_LONG_FLAG bit is clear, the entry is the next hop. Otherwise
+ *  the other 15 bits are the number of a 256-entry block in tbllong.
+ *  - tbllong: blocks for the prefixes longer than /24, indexed by the
+ *  8 least significant bits of the IP.
+ *  - long_blocks, long_capacity: blocks in use/allocated in tbllong.
+ *  - len24, len_long: length of the prefix that wrote each entry. Only
+ *  needed while inserting, freed by `dir248_finish`.
+ **********************************************************************/
+typedef struct {
+    uint16_t *tbl24;
+    uint16_t *tbllong;
+    int long_blocks;
+    int long_capacity;
+    uint8_t *len24;
+    uint8_t *len_long;
+} Dir248;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Allocate an empty table (every entry is NO_IFACE).
+ **********************************************************************/
+Dir248 *dir248_alloc(void);
+
+/**********************************************************************
+ * Insert a FIB entry. The entries can come in any order: an entry only
+ * overwrites the ones written by shorter (or equal) prefixes.
+ * Returns 0, or -1 if the entry does not fit in the table.
+ **********************************************************************/
+int dir248_insert(Dir248 *dir, uint32_t prefix, int prefix_length, int out_iface);
+
+/**********************************************************************
+ * Free the data only needed for the insertions.
+ **********************************************************************/
+void dir248_finish(Dir248 *dir);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Build the table with the FIB entries stored in a Patricia trie.
+ * Returns NULL if they do not fit in the table.
+ **********************************************************************/
+Dir248 *dir248_create(Node *root);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one. It takes 1 or 2 memory accesses.
+ **********************************************************************/
+int dir248_lookup(const Dir248 *dir, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * Look up a batch of IPs. Groups of LOOKUP_BATCH_GROUP IPs prefetch
+ * their tbl24 entries, then their tbllong entries, before reading them.
+ **********************************************************************/
+void dir248_lookup_batch(const Dir248 *dir, const uint32_t *ips, int *ifaces,
+                         int *accesses, size_t n);
+
+/**********************************************************************
+ * Check that every TBL24 entry with DIR248_LONG_FLAG points to one of
+ * the long blocks. Returns 0, or -1 if one does not.
+ **********************************************************************/
+int dir248_validate(const Dir248 *dir);
+
+/**********************************************************************
+ * Free the table.
+ **********************************************************************/
+void dir248_free(Dir248 *dir);
+
+#endif // DIR248_H
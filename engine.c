@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "lctrie.h"
+#include "dir248.h"
+#include "frozen.h"
+#include "simd.h"
+#include "bsl.h"
+#include "poptrie.h"
+#include "utils.h"
+#include "rcu.h"
+
+/**********************************************************************
+ * Patricia trie: the table is the compressed trie itself, which is
+ * owned (and freed) by the caller.
+ **********************************************************************/
+static void *patricia_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return root;
+}
+
+static int patricia_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return lookup((Node *)table, ip, accesses);
+}
+
+static int patricia_fast_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return lookup_fast((Node *)table, ip, accesses);
+}
+
+static void patricia_lookup_batch(const void *table, const uint32_t *ips, int *ifaces,
+                                  int *accesses, size_t n)
+{
+    lookup_batch((Node *)table, ips, ifaces, accesses, n);
+}
+
+/* The live nodes: the trie is the only one left in the pool */
+static int patricia_node_count(const void *table)
+{
+    (void)table;
+    return node_pool.in_use;
+}
+
+static size_t patricia_memory(const void *table)
+{
+    (void)table;
+    return node_pool.in_use * sizeof(Node);
+}
+
+static void patricia_destroy(void *table)
+{
+    (void)table;
+}
+
+/**********************************************************************
+ * LC-trie
+ **********************************************************************/
+static void *lc_build(Node *root, const EngineOptions *options)
+{
+    return lc_create(root, options->fill_factor, options->root_branch);
+}
+
+static int lc_engine_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return lc_lookup(table, ip, accesses);
+}
+
+static void lc_engine_lookup_batch(const void *table, const uint32_t *ips, int *ifaces,
+                                   int *accesses, size_t n)
+{
+    lc_lookup_batch(table, ips, ifaces, accesses, n);
+}
+
+static int lc_node_count(const void *table)
+{
+    return ((const LCTrie *)table)->size;
+}
+
+static size_t lc_memory(const void *table)
+{
+    return sizeof(LCTrie) + ((const LCTrie *)table)->capacity * sizeof(LCNode);
+}
+
+static void lc_destroy(void *table)
+{
+    lc_free(table);
+}
+
+static int lc_save(const void *table, SnapshotSection *sections)
+{
+    const LCTrie *trie = table;
+    sections[0] = (SnapshotSection) { trie->nodes, trie->size * sizeof(LCNode) };
+    return 1;
+}
+
+static void *lc_attach(const SnapshotSection *sections, int count)
+{
+    if (count != 1 || !sections[0].size || sections[0].size % sizeof(LCNode))
+        return NULL;
+    LCTrie *trie = malloc(sizeof(LCTrie));
+    if (!trie) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    trie->nodes = (LCNode *)sections[0].data;  // Only read by the lookups
+    trie->size = trie->capacity = sections[0].size / sizeof(LCNode);
+    if (lc_validate(trie) < 0) {
+        free(trie);
+        return NULL;
+    }
+    return trie;
+}
+
+/**********************************************************************
+ * DIR-24-8
+ **********************************************************************/
+static void *dir248_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return dir248_create(root);
+}
+
+static int dir248_engine_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return dir248_lookup(table, ip, accesses);
+}
+
+static void dir248_engine_lookup_batch(const void *table, const uint32_t *ips, int *ifaces,
+                                       int *accesses, size_t n)
+{
+    dir248_lookup_batch(table, ips, ifaces, accesses, n);
+}
+
+static int dir248_node_count(const void *table)
+{
+    return DIR248_TBL24_SIZE + (((const Dir248 *)table)->long_blocks << 8);
+}
+
+static size_t dir248_memory(const void *table)
+{
+    const Dir248 *dir = table;
+    return sizeof(Dir248) + DIR248_TBL24_SIZE * sizeof(uint16_t) +
+           ((size_t)dir->long_capacity << 8) * sizeof(uint16_t);
+}
+
+static void dir248_destroy(void *table)
+{
+    dir248_free(table);
+}
+
+static int dir248_save(const void *table, SnapshotSection *sections)
+{
+    const Dir248 *dir = table;
+    sections[0] = (SnapshotSection) { dir->tbl24, DIR248_TBL24_SIZE * sizeof(uint16_t) };
+    sections[1] = (SnapshotSection) { dir->tbllong, ((size_t)dir->long_blocks << 8) * sizeof(uint16_t) };
+    return 2;
+}
+
+static void *dir248_attach(const SnapshotSection *sections, int count)
+{
+    size_t block_size = 256 * sizeof(uint16_t);
+    if (count != 2 || sections[0].size != DIR248_TBL24_SIZE * sizeof(uint16_t) ||
+        sections[1].size % block_size || sections[1].size / block_size > DIR248_MAX_BLOCKS)
+        return NULL;
+    Dir248 *dir = calloc(1, sizeof(Dir248));
+    if (!dir) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    dir->tbl24 = (uint16_t *)sections[0].data;
+    dir->tbllong = (uint16_t *)sections[1].data;
+    dir->long_blocks = dir->long_capacity = sections[1].size / block_size;
+    if (dir248_validate(dir) < 0) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+/**********************************************************************
+ * Frozen trie, in BFS and van Emde Boas order
+ **********************************************************************/
+static void *frozen_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return freeze_trie(root, FROZEN_BFS);
+}
+
+static void *frozen_veb_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return freeze_trie(root, FROZEN_VEB);
+}
+
+static int frozen_engine_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return frozen_lookup(table, ip, accesses);
+}
+
+static void frozen_engine_lookup_batch(const void *table, const uint32_t *ips, int *ifaces,
+                                       int *accesses, size_t n)
+{
+    frozen_lookup_batch(table, ips, ifaces, accesses, n);
+}
+
+static int frozen_node_count(const void *table)
+{
+    return ((const FrozenTrie *)table)->size;
+}
+
+static size_t frozen_memory(const void *table)
+{
+    return sizeof(FrozenTrie) + ((const FrozenTrie *)table)->size * sizeof(FrozenNode);
+}
+
+static void frozen_destroy(void *table)
+{
+    frozen_free(table);
+}
+
+static int frozen_save(const void *table, SnapshotSection *sections)
+{
+    const FrozenTrie *trie = table;
+    sections[0] = (SnapshotSection) { trie->nodes, trie->size * sizeof(FrozenNode) };
+    return 1;
+}
+
+static void *frozen_attach(const SnapshotSection *sections, int count)
+{
+    if (count != 1 || !sections[0].size || sections[0].size % sizeof(FrozenNode))
+        return NULL;
+    FrozenTrie *trie = malloc(sizeof(FrozenTrie));
+    if (!trie) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    trie->nodes = (FrozenNode *)sections[0].data;
+    trie->size = sections[0].size / sizeof(FrozenNode);
+    if (frozen_validate(trie) < 0) {
+        free(trie);
+        return NULL;
+    }
+    return trie;
+}
+
+/**********************************************************************
+ * Frozen trie in BFS order, looked up in batches by the SIMD kernels.
+ * The kernel is chosen on the first build or attach, unless `simd_init`
+ * was called before.
+ **********************************************************************/
+static void *frozen_simd_build(Node *root, const EngineOptions *options)
+{
+    if (simd_kernel == SIMD_AUTO)
+        simd_init(SIMD_AUTO);
+    return frozen_build(root, options);
+}
+
+static void frozen_simd_lookup_batch(const void *table, const uint32_t *ips, int *ifaces,
+                                     int *accesses, size_t n)
+{
+    simd_lookup_batch(table, ips, ifaces, accesses, n);
+}
+
+static void *frozen_simd_attach(const SnapshotSection *sections, int count)
+{
+    if (simd_kernel == SIMD_AUTO)
+        simd_init(SIMD_AUTO);
+    return frozen_attach(sections, count);
+}
+
+/**********************************************************************
+ * Binary search on prefix lengths, one hash table per length. The
+ * accesses are the hash slots probed.
+ **********************************************************************/
+static void *bsl_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return bsl_create(root);
+}
+
+static int bsl_engine_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return bsl_lookup(table, ip, accesses);
+}
+
+static int bsl_node_count(const void *table)
+{
+    return ((const BslTable *)table)->header.entries;
+}
+
+static size_t bsl_memory(const void *table)
+{
+    const BslTable *bsl = table;
+    return sizeof(BslTable) + bsl->header.level_count * sizeof(BslLevel) +
+           bsl->slot_count * sizeof(BslSlot);
+}
+
+static void bsl_destroy(void *table)
+{
+    bsl_free(table);
+}
+
+static int bsl_save(const void *table, SnapshotSection *sections)
+{
+    const BslTable *bsl = table;
+    sections[0] = (SnapshotSection) { &bsl->header, sizeof(BslHeader) };
+    sections[1] = (SnapshotSection) { bsl->levels, bsl->header.level_count * sizeof(BslLevel) };
+    sections[2] = (SnapshotSection) { bsl->slots, bsl->slot_count * sizeof(BslSlot) };
+    return 3;
+}
+
+static void *bsl_attach(const SnapshotSection *sections, int count)
+{
+    if (count != 3 || sections[0].size != sizeof(BslHeader) || sections[2].size % sizeof(BslSlot))
+        return NULL;
+    const BslHeader *header = sections[0].data;
+    if (header->level_count < 0 || header->level_count > IP_ADDRESS_LENGTH ||
+        sections[1].size != header->level_count * sizeof(BslLevel))
+        return NULL;
+    BslTable *bsl = malloc(sizeof(BslTable));
+    if (!bsl) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    bsl->header = *header;
+    bsl->levels = (BslLevel *)sections[1].data;
+    bsl->slots = (BslSlot *)sections[2].data;
+    bsl->slot_count = sections[2].size / sizeof(BslSlot);
+    if (bsl_validate(bsl) < 0) {
+        free(bsl);
+        return NULL;
+    }
+    return bsl;
+}
+
+/**********************************************************************
+ * Poptrie
+ **********************************************************************/
+static void *poptrie_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return poptrie_create(root);
+}
+
+static int poptrie_engine_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return poptrie_lookup(table, ip, accesses);
+}
+
+static int poptrie_node_count(const void *table)
+{
+    const Poptrie *trie = table;
+    return trie->node_count + trie->leaf_count;
+}
+
+static size_t poptrie_memory(const void *table)
+{
+    const Poptrie *trie = table;
+    return sizeof(Poptrie) + trie->node_count * sizeof(PoptrieNode) +
+           trie->leaf_count * sizeof(uint16_t);
+}
+
+static void poptrie_destroy(void *table)
+{
+    poptrie_free(table);
+}
+
+static int poptrie_save(const void *table, SnapshotSection *sections)
+{
+    const Poptrie *trie = table;
+    sections[0] = (SnapshotSection) { trie->nodes, trie->node_count * sizeof(PoptrieNode) };
+    sections[1] = (SnapshotSection) { trie->leaves, trie->leaf_count * sizeof(uint16_t) };
+    return 2;
+}
+
+static void *poptrie_attach(const SnapshotSection *sections, int count)
+{
+    if (count != 2 || !sections[0].size || sections[0].size % sizeof(PoptrieNode) ||
+        !sections[1].size || sections[1].size % sizeof(uint16_t))
+        return NULL;
+    Poptrie *trie = malloc(sizeof(Poptrie));
+    if (!trie) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    trie->nodes = (PoptrieNode *)sections[0].data;
+    trie->leaves = (uint16_t *)sections[1].data;
+    trie->node_count = sections[0].size / sizeof(PoptrieNode);
+    trie->leaf_count = sections[1].size / sizeof(uint16_t);
+    if (poptrie_validate(trie) < 0) {
+        free(trie);
+        return NULL;
+    }
+    return trie;
+}
+
+/**********************************************************************
+ * Patricia trie that can be updated while it is looked up. The nodes
+ * stay in the node pool, so the count is the number of live nodes.
+ **********************************************************************/
+static void *rcu_build(Node *root, const EngineOptions *options)
+{
+    (void)options;
+    return rcu_create(root);
+}
+
+static int rcu_engine_lookup(const void *table, uint32_t ip, int *accesses)
+{
+    return rcu_lookup((RcuTrie *)table, ip, accesses);
+}
+
+static void rcu_engine_lookup_batch(const void *table, const uint32_t *ips, int *ifaces,
+                                    int *accesses, size_t n)
+{
+    rcu_lookup_batch((RcuTrie *)table, ips, ifaces, accesses, n);
+}
+
+static int rcu_node_count(const void *table)
+{
+    (void)table;
+    return node_pool.in_use;
+}
+
+static size_t rcu_memory(const void *table)
+{
+    const RcuTrie *trie = table;
+    return sizeof(RcuTrie) + node_pool.in_use * sizeof(Node) +
+           trie->retired_capacity * (sizeof(Node *) + sizeof(uint64_t));
+}
+
+static void rcu_destroy(void *table)
+{
+    rcu_free(table);
+}
+
+const Engine engines[] = {
+    {
+        .name = "patricia",
+        .build = patricia_build,
+        .lookup = patricia_lookup,
+        .lookup_batch = patricia_lookup_batch,
+        .node_count = patricia_node_count,
+        .keeps_trie = 1,
+        .memory = patricia_memory,
+        .destroy = patricia_destroy,
+    },
+    {
+        .name = "patricia-fast",
+        .build = patricia_build,
+        .lookup = patricia_fast_lookup,
+        .node_count = patricia_node_count,
+        .keeps_trie = 1,
+        .memory = patricia_memory,
+        .destroy = patricia_destroy,
+    },
+    {
+        .name = "lc",
+        .build = lc_build,
+        .lookup = lc_engine_lookup,
+        .lookup_batch = lc_engine_lookup_batch,
+        .node_count = lc_node_count,
+        .memory = lc_memory,
+        .destroy = lc_destroy,
+        .save = lc_save,
+        .attach = lc_attach,
+    },
+    {
+        .name = "dir248",
+        .build = dir248_build,
+        .lookup = dir248_engine_lookup,
+        .lookup_batch = dir248_engine_lookup_batch,
+        .node_count = dir248_node_count,
+        .narrow_nexthops = 1,
+        .memory = dir248_memory,
+        .destroy = dir248_destroy,
+        .save = dir248_save,
+        .attach = dir248_attach,
+    },
+    {
+        .name = "frozen",
+        .build = frozen_build,
+        .lookup = frozen_engine_lookup,
+        .lookup_batch = frozen_engine_lookup_batch,
+        .node_count = frozen_node_count,
+        .narrow_nexthops = 1,
+        .memory = frozen_memory,
+        .destroy = frozen_destroy,
+        .save = frozen_save,
+        .attach = frozen_attach,
+    },
+    {
+        .name = "frozen-veb",
+        .build = frozen_veb_build,
+        .lookup = frozen_engine_lookup,
+        .lookup_batch = frozen_engine_lookup_batch,
+        .node_count = frozen_node_count,
+        .narrow_nexthops = 1,
+        .memory = frozen_memory,
+        .destroy = frozen_destroy,
+        .save = frozen_save,
+        .attach = frozen_attach,
+    },
+    {
+        .name = "frozen-simd",
+        .build = frozen_simd_build,
+        .lookup = frozen_engine_lookup,
+        .lookup_batch = frozen_simd_lookup_batch,
+        .node_count = frozen_node_count,
+        .narrow_nexthops = 1,
+        .memory = frozen_memory,
+        .destroy = frozen_destroy,
+        .save = frozen_save,
+        .attach = frozen_simd_attach,
+    },
+    {
+        .name = "bsl",
+        .build = bsl_build,
+        .lookup = bsl_engine_lookup,
+        .node_count = bsl_node_count,
+        .memory = bsl_memory,
+        .destroy = bsl_destroy,
+        .save = bsl_save,
+        .attach = bsl_attach,
+    },
+    {
+        .name = "poptrie",
+        .build = poptrie_build,
+        .lookup = poptrie_engine_lookup,
+        .node_count = poptrie_node_count,
+        .narrow_nexthops = 1,
+        .memory = poptrie_memory,
+        .destroy = poptrie_destroy,
+        .save = poptrie_save,
+        .attach = poptrie_attach,
+    },
+    {
+        .name = "rcu",
+        .build = rcu_build,
+        .lookup = rcu_engine_lookup,
+        .lookup_batch = rcu_engine_lookup_batch,
+        .node_count = rcu_node_count,
+        .keeps_trie = 1,
+        .memory = rcu_memory,
+        .destroy = rcu_destroy,
+    },
+};
+const int engine_count = sizeof(engines) / sizeof(engines[0]);
+
+/**********************************************************************
+ * Find an engine by name. Returns NULL if there is none.
+ **********************************************************************/
+const Engine *find_engine(const char *name)
+{
+    for (int i = 0; i < engine_count; ++i)
+        if (!strcmp(engines[i].name, name))
+            return &engines[i];
+    return NULL;
+}
+
+/**********************************************************************
+ * Look up a batch of IPs with the engine, one by one if it has no
+ * batch lookup.
+ **********************************************************************/
+void engine_lookup_batch(const Engine *engine, const void *table, const uint32_t *ips,
+                         int *ifaces, int *accesses, size_t n)
+{
+    if (engine->lookup_batch) {
+        engine->lookup_batch(table, ips, ifaces, accesses, n);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        accesses[i] = 0;
+        ifaces[i] = engine->lookup(table, ips[i], &accesses[i]);
+    }
+}
+
+/**********************************************************************
+ * IPv6 Patricia trie: the table is the compressed trie itself, owned
+ * by the caller like the IPv4 one.
+ **********************************************************************/
+static void *patricia6_build(Node6 *root)
+{
+    return root;
+}
+
+static int patricia6_lookup(const void *table, Ip6 ip, int *accesses)
+{
+    return lookup6(table, ip, accesses);
+}
+
+static int patricia6_node_count(const void *table)
+{
+    (void)table;
+    return node6_pool.in_use;
+}
+
+static size_t patricia6_memory(const void *table)
+{
+    (void)table;
+    return node6_pool.in_use * sizeof(Node6);
+}
+
+static void patricia6_destroy(void *table)
+{
+    (void)table;  // The nodes go with node6_pool_destroy
+}
+
+/**********************************************************************
+ * IPv6 Poptrie: multibit nodes of 6 bits.
+ **********************************************************************/
+static void *poptrie6_build(Node6 *root)
+{
+    return poptrie6_create(root);
+}
+
+static int poptrie6_engine_lookup(const void *table, Ip6 ip, int *accesses)
+{
+    return poptrie6_lookup(table, ip, accesses);
+}
+
+const Engine6 engines6[] = {
+    {
+        .name = "patricia",
+        .build = patricia6_build,
+        .lookup = patricia6_lookup,
+        .node_count = patricia6_node_count,
+        .memory = patricia6_memory,
+        .destroy = patricia6_destroy,
+    },
+    {
+        .name = "poptrie",
+        .build = poptrie6_build,
+        .lookup = poptrie6_engine_lookup,
+        .node_count = poptrie_node_count,
+        .memory = poptrie_memory,
+        .destroy = poptrie_destroy,
+    },
+};
+const int engine6_count = sizeof(engines6) / sizeof(engines6[0]);
+
+/**********************************************************************
+ * Find an IPv6 engine by name. Returns NULL if there is none.
+ **********************************************************************/
+const Engine6 *find_engine6(const char *name)
+{
+    for (int i = 0; i < engine6_count; ++i)
+        if (!strcmp(engines6[i].name, name))
+            return &engines6[i];
+    return NULL;
+}
@@ -0,0 +1,113 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "node.h"
+#include "node6.h"
+
+/**********************************************************************
+ * ENGINE OPTIONS
+ * Tunables of the lookup engines, set from the command line.
+ * Fields:
+ *  - fill_factor: LC-trie fill factor.
+ *  - root_branch: LC-trie branching factor of the root.
+ **********************************************************************/
+typedef struct {
+    double fill_factor;
+    int root_branch;
+} EngineOptions;
+
+/**********************************************************************
+ * SNAPSHOT SECTION
+ * One of the arrays of a lookup structure, as stored in a compiled FIB
+ * snapshot (see snapshot.h). The arrays hold indexes, never pointers.
+ **********************************************************************/
+#define SNAPSHOT_MAX_SECTIONS 4
+
+typedef struct {
+    const void *data;
+    size_t size;  // bytes
+} SnapshotSection;
+
+/**********************************************************************
+ * LOOKUP ENGINE
+ * Every engine is built from the compressed Patricia trie, which is
+ * always created first, and must return the same next hops as
+ * `lookup`.
+ * Fields:
+ *  - name: name used to select the engine from the command line.
+ *  - build: create the lookup structure. Returns NULL on error.
+ *  - lookup: same contract as `lookup` in node.h.
+ *  - lookup_batch: same contract as `lookup_batch` in node.h. May be
+ *  NULL, see `engine_lookup_batch`.
+ *  - node_count: number of nodes for the summary.
+ *  - narrow_nexthops: the next hops are stored in 16 bits, so the trie
+ *  should hold next hop indexes (see nexthop.h) rather than interfaces.
+ *  - keeps_trie: the lookup structure points into the Patricia trie,
+ *  which must outlive it. The others let the caller free the trie.
+ *  - memory: bytes taken by the lookup structure.
+ *  - destroy: free the lookup structure.
+ *  - save: describe the arrays of the lookup structure. Returns how
+ *  many (at most SNAPSHOT_MAX_SECTIONS). NULL if the engine is built
+ *  on pointers and cannot be compiled.
+ *  - attach: create a lookup structure that uses the arrays given by
+ *  `save` where they are (e.g. in a read-only mapping). Returns NULL if
+ *  they are not valid: their sizes, and every index they hold, are
+ *  checked once so a broken snapshot cannot make a lookup read out of
+ *  bounds. Free it with free(), not with destroy.
+ **********************************************************************/
+typedef struct {
+    const char *name;
+    void *(*build)(Node *root, const EngineOptions *options);
+    int (*lookup)(const void *table, uint32_t ip, int *accesses);
+    void (*lookup_batch)(const void *table, const uint32_t *ips, int *ifaces,
+                         int *accesses, size_t n);
+    int (*node_count)(const void *table);
+    int narrow_nexthops;
+    int keeps_trie;
+    size_t (*memory)(const void *table);
+    void (*destroy)(void *table);
+    int (*save)(const void *table, SnapshotSection *sections);
+    void *(*attach)(const SnapshotSection *sections, int count);
+} Engine;
+
+extern const Engine engines[];
+extern const int engine_count;
+
+/**********************************************************************
+ * Find an engine by name. Returns NULL if there is none.
+ **********************************************************************/
+const Engine *find_engine(const char *name);
+
+/**********************************************************************
+ * Look up a batch of IPs with the engine, one by one if it has no
+ * batch lookup.
+ **********************************************************************/
+void engine_lookup_batch(const Engine *engine, const void *table, const uint32_t *ips,
+                         int *ifaces, int *accesses, size_t n);
+
+/**********************************************************************
+ * IPv6 LOOKUP ENGINE
+ * Same as Engine, over 128-bit keys, built from the compressed IPv6
+ * Patricia trie (see node6.h). A family of its own, so the IPv4 engines
+ * keep their 32-bit code.
+ **********************************************************************/
+typedef struct {
+    const char *name;
+    void *(*build)(Node6 *root);
+    int (*lookup)(const void *table, Ip6 ip, int *accesses);
+    int (*node_count)(const void *table);
+    size_t (*memory)(const void *table);
+    void (*destroy)(void *table);
+} Engine6;
+
+extern const Engine6 engines6[];
+extern const int engine6_count;
+
+/**********************************************************************
+ * Find an IPv6 engine by name. Returns NULL if there is none.
+ **********************************************************************/
+const Engine6 *find_engine6(const char *name);
+
+#endif // ENGINE_H
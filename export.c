@@ -0,0 +1,243 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "export.h"
+#include "utils.h"
+
+#define MAX_NODE_TEXT 160  // The longest node and edge lines of any format
+#define EXPORT_STACK_SIZE (IP_ADDRESS_LENGTH + 2)
+#define netmask(length) ((length) ? 0xFFFFFFFFU << (32 - (length)) : 0)
+
+/* Output buffer, written to the file when it is full */
+typedef struct {
+    int fd;
+    size_t used;
+    int error;
+    char data[EXPORT_BUFFER_SIZE];
+} ExportBuffer;
+
+/* A node waiting on the stack: its parent row, its depth and the chain skipped above it */
+typedef struct {
+    const Node *node;
+    long parent;
+    int depth;
+    int skipped;
+} ExportFrame;
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Write v in decimal at p, returns the position after it */
+static char *put_uint(char *p, uint64_t v)
+{
+    char digits[20];
+    char *d = digits + sizeof(digits);
+    while (v >= 100) {
+        const char *pair = &digit_pairs[2 * (v % 100)];
+        v /= 100;
+        *--d = pair[1];
+        *--d = pair[0];
+    }
+    if (v >= 10) {
+        *--d = digit_pairs[2 * v + 1];
+        *--d = digit_pairs[2 * v];
+    } else {
+        *--d = '0' + v;
+    }
+    size_t length = digits + sizeof(digits) - d;
+    memcpy(p, d, length);
+    return p + length;
+}
+
+static char *put_text(char *p, const char *text)
+{
+    size_t length = strlen(text);
+    memcpy(p, text, length);
+    return p + length;
+}
+
+/* a.b.c.d/len */
+static char *put_prefix(char *p, uint32_t prefix, int prefix_length)
+{
+    p = put_uint(p, prefix >> 24);
+    *p++ = '.';
+    p = put_uint(p, (prefix >> 16) & 0xFF);
+    *p++ = '.';
+    p = put_uint(p, (prefix >> 8) & 0xFF);
+    *p++ = '.';
+    p = put_uint(p, prefix & 0xFF);
+    *p++ = '/';
+    return put_uint(p, prefix_length);
+}
+
+/* Write the whole buffer, retrying on short writes */
+static void flush(ExportBuffer *out)
+{
+    const char *data = out->data;
+    size_t size = out->used;
+    while (size && !out->error) {
+        ssize_t n = write(out->fd, data, size);
+        if (n < 0) {
+            if (errno != EINTR) out->error = 1;
+            continue;
+        }
+        data += n;
+        size -= n;
+    }
+    out->used = 0;
+}
+
+/**********************************************************************
+ * Find the subtree with the routes inside a prefix.
+ **********************************************************************/
+const Node *find_subtree(const Node *root, uint32_t prefix, int prefix_length)
+{
+    const Node *node = root;
+    while (node) {
+        int common = node->prefix_length < prefix_length ? node->prefix_length : prefix_length;
+        if ((node->prefix ^ prefix) & netmask(common))
+            return NULL;  // The path leaves the prefix
+        if (node->prefix_length >= prefix_length)
+            return node;
+        node = node->child[(prefix >> (31 - node->prefix_length)) & 1];
+    }
+    return NULL;
+}
+
+/* Format a node, and the edge from its parent, at the end of the buffer */
+static void put_node(ExportBuffer *out, const ExportOptions *options, const ExportFrame *frame,
+                     long row, int flags, int out_iface)
+{
+    const Node *node = frame->node;
+    char *p = out->data + out->used;
+    switch (options->format) {
+    case EXPORT_GRAPHVIZ:
+        *p++ = 'n';
+        p = put_uint(p, row);
+        p = put_text(p, " [label=\"");
+        p = put_prefix(p, node->prefix, node->prefix_length);
+        if (node->out_iface != NO_IFACE) {
+            p = put_text(p, "\\n");
+            p = put_uint(p, (unsigned)out_iface);
+            p = put_text(p, "\", shape=box");
+        } else {
+            *p++ = '"';
+        }
+        if (flags & TREE_TRUNCATED)
+            p = put_text(p, ", style=dashed");
+        p = put_text(p, "];\n");
+        if (frame->parent >= 0) {
+            *p++ = 'n';
+            p = put_uint(p, frame->parent);
+            p = put_text(p, " -> n");
+            p = put_uint(p, row);
+            if (frame->skipped) {
+                p = put_text(p, " [label=\"+");
+                p = put_uint(p, frame->skipped);
+                p = put_text(p, "\"]");
+            }
+            p = put_text(p, ";\n");
+        }
+        break;
+    case EXPORT_JSON:
+        p = put_text(p, row ? ",\n[" : "\n[");
+        if (frame->parent >= 0)
+            p = put_uint(p, frame->parent);
+        else
+            p = put_text(p, "-1");
+        p = put_text(p, ", \"");
+        p = put_prefix(p, node->prefix, node->prefix_length);
+        p = put_text(p, "\", ");
+        p = put_uint(p, (unsigned)out_iface);
+        p = put_text(p, ", ");
+        p = put_uint(p, frame->skipped);
+        p = put_text(p, flags & TREE_TRUNCATED ? ", 1]" : ", 0]");
+        break;
+    case EXPORT_BINARY: {
+        TreeRecord record = {
+            .prefix = node->prefix,
+            .out_iface = out_iface,
+            .prefix_length = node->prefix_length,
+            .flags = flags,
+            .skipped = frame->skipped < UINT16_MAX ? frame->skipped : UINT16_MAX,
+        };
+        memcpy(p, &record, sizeof(record));
+        p += sizeof(record);
+        break;
+    }
+    }
+    out->used = p - out->data;
+}
+
+/**********************************************************************
+ * Write a trie, or a subtree of it, to a file descriptor.
+ **********************************************************************/
+long export_trie(int fd, const Node *root, const ExportOptions *options)
+{
+    static const char *headers[] = {
+        [EXPORT_GRAPHVIZ] = "digraph trie {\nnode [fontsize=10];\n",
+        [EXPORT_JSON] = "{\"columns\": [\"parent\", \"prefix\", \"out_iface\", \"skipped\", \"truncated\"],\n"
+                        "\"nodes\": [",
+        [EXPORT_BINARY] = EXPORT_BINARY_MAGIC,
+    };
+    static const char *footers[] = {
+        [EXPORT_GRAPHVIZ] = "}\n",
+        [EXPORT_JSON] = "\n]}\n",
+        [EXPORT_BINARY] = "",
+    };
+    ExportBuffer out = { .fd = fd };
+    out.used = put_text(out.data, headers[options->format]) - out.data;
+
+    /* Every level leaves at most one subtree behind */
+    ExportFrame stack[EXPORT_STACK_SIZE];
+    int top = 0;
+    long rows = 0;
+    if (root)
+        stack[top++] = (ExportFrame) { root, -1, 0, 0 };
+    while (top && !out.error) {
+        ExportFrame frame = stack[--top];
+        const Node *node = frame.node;
+        const Node *children[2];
+        int skipped[2] = {0, 0};
+        for (int i = 0; i < 2; ++i) {
+            children[i] = node->child[i];
+            while (options->collapse_chains && children[i] && children[i]->out_iface == NO_IFACE &&
+                   !children[i]->left != !children[i]->right) {
+                children[i] = children[i]->left ? children[i]->left : children[i]->right;
+                skipped[i] += 1;
+            }
+        }
+        int flags = 0;
+        if (children[0] || children[1]) {
+            if (options->max_depth >= 0 && frame.depth >= options->max_depth) {
+                flags = TREE_TRUNCATED;
+                children[0] = children[1] = NULL;
+            } else {
+                flags = (children[0] ? TREE_LEFT : 0) | (children[1] ? TREE_RIGHT : 0);
+            }
+        }
+        int out_iface = node->out_iface;
+        if (options->nexthops && out_iface != NO_IFACE)
+            out_iface = nexthop_iface(options->nexthops, out_iface);
+
+        if (out.used + MAX_NODE_TEXT > EXPORT_BUFFER_SIZE)
+            flush(&out);
+        put_node(&out, options, &frame, rows, flags, out_iface);
+        for (int i = 1; i >= 0; --i) {
+            if (children[i])
+                stack[top++] = (ExportFrame) { children[i], rows, frame.depth + 1, skipped[i] };
+        }
+        rows += 1;
+    }
+    if (out.used + MAX_NODE_TEXT > EXPORT_BUFFER_SIZE)
+        flush(&out);
+    out.used = put_text(out.data + out.used, footers[options->format]) - out.data;
+    flush(&out);
+    return out.error ? -1 : rows;
+}
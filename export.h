@@ -0,0 +1,77 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "node.h"
+#include "nexthop.h"
+
+#define EXPORT_BUFFER_SIZE (1 << 16)
+#define EXPORT_BINARY_MAGIC "RLTRE001"
+
+/**********************************************************************
+ * EXPORT FORMAT
+ *  - EXPORT_GRAPHVIZ: a digraph for `dot`, a node per trie node with
+ *  its prefix and next hop. The routes are boxes.
+ *  - EXPORT_JSON: {"columns": [...], "nodes": [[parent, prefix,
+ *  out_iface, skipped, truncated], ...]}, a row per node in preorder.
+ *  parent is the row of the parent, -1 for the first one.
+ *  - EXPORT_BINARY: EXPORT_BINARY_MAGIC and then a TreeRecord per node
+ *  in preorder (left subtree first), in the byte order of the machine.
+ *  The flags tell which subtrees follow a record.
+ **********************************************************************/
+typedef enum {
+    EXPORT_GRAPHVIZ,
+    EXPORT_JSON,
+    EXPORT_BINARY,
+} ExportFormat;
+
+#define TREE_LEFT 1
+#define TREE_RIGHT 2
+#define TREE_TRUNCATED 4  // It has subtrees, below the depth cap
+
+typedef struct {
+    uint32_t prefix;
+    int32_t out_iface;
+    uint8_t prefix_length;
+    uint8_t flags;
+    uint16_t skipped;  // Nodes of the chain collapsed above this one
+} TreeRecord;
+
+/**********************************************************************
+ * EXPORT OPTIONS
+ * Fields:
+ *  - format: see ExportFormat.
+ *  - max_depth: levels written below the first node, -1 for all. The
+ *  nodes at the last level with subtrees are marked as truncated.
+ *  - collapse_chains: skip the nodes with a single subtree and no next
+ *  hop, and tell on the edge how many nodes were skipped. The routes
+ *  are never collapsed. A compressed trie has no such nodes, since it
+ *  only keeps a node with a single subtree if it holds a route.
+ *  - nexthops: to write the interfaces instead of the next hop indexes
+ *  stored in the trie. NULL to write the indexes.
+ **********************************************************************/
+typedef struct {
+    ExportFormat format;
+    int max_depth;
+    int collapse_chains;
+    const NextHopTable *nexthops;
+} ExportOptions;
+
+/**********************************************************************
+ * Find the subtree of a compressed trie with the routes inside a
+ * prefix: the first node on the path of the prefix that is as long or
+ * longer and inside it. Returns NULL if the trie has nothing there.
+ **********************************************************************/
+const Node *find_subtree(const Node *root, uint32_t prefix, int prefix_length);
+
+/**********************************************************************
+ * Write a trie, or a subtree of it, to a file descriptor. The nodes are
+ * walked with a stack of their own and formatted by hand into a buffer
+ * of EXPORT_BUFFER_SIZE bytes, written whenever it fills up, so the
+ * memory used does not depend on the size of the trie.
+ * Returns the number of nodes written, or -1 if a write failed.
+ **********************************************************************/
+long export_trie(int fd, const Node *root, const ExportOptions *options);
+
+#endif // EXPORT_H
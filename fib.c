@@ -0,0 +1,536 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "fib.h"
+#include "io.h"
+#include "pcap.h"
+
+#define is_digit(c) ((unsigned)((c) - '0') < 10)
+#define is_blank(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+/**********************************************************************
+ * Map a whole file in memory, read only. An empty file gives
+ * data == NULL and size == 0. Returns 0, or -1 if it cannot be opened.
+ **********************************************************************/
+static int map_file(const char *path, const char **data, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    *data = NULL;
+    if (*size) {
+        void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        posix_madvise(map, *size, POSIX_MADV_SEQUENTIAL);
+        *data = map;
+    }
+    close(fd);  // The mapping stays valid
+    return 0;
+}
+
+static void unmap_file(const char *data, size_t size)
+{
+    if (data) munmap((void *)data, size);
+}
+
+/* Upper bound of the number of lines: every line ends in '\n' but maybe the last one */
+static size_t count_lines(const char *data, size_t size)
+{
+    size_t lines = 1;
+    const char *p = data, *end = data + size;
+    while (p < end && (p = memchr(p, '\n', end - p))) {
+        lines += 1;
+        p += 1;
+    }
+    return lines;
+}
+
+/**********************************************************************
+ * Parse a decimal number in [0, max] without leading zeros.
+ * Returns the position after the number, or NULL if it is malformed.
+ **********************************************************************/
+static const char *parse_decimal(const char *p, const char *end, long max, long *value)
+{
+    if (p == end || !is_digit(*p)) return NULL;
+    long v = *p++ - '0';
+    if (v == 0) {
+        if (p < end && is_digit(*p)) return NULL;
+    } else {
+        while (p < end && is_digit(*p)) {
+            v = 10 * v + (*p++ - '0');
+            if (v > max) return NULL;
+        }
+    }
+    if (v > max) return NULL;
+    *value = v;
+    return p;
+}
+
+/* Parse a dotted-quad IPv4 address */
+static const char *parse_ip(const char *p, const char *end, uint32_t *ip)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+        long octet;
+        if (i) {
+            if (p == end || *p != '.') return NULL;
+            p += 1;
+        }
+        p = parse_decimal(p, end, 255, &octet);
+        if (!p) return NULL;
+        result = result << 8 | octet;
+    }
+    *ip = result;
+    return p;
+}
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && is_blank(*p)) p += 1;
+    return p;
+}
+
+/* Check that the line ends here. Returns the start of the next line */
+static const char *end_of_line(const char *p, const char *end)
+{
+    p = skip_blanks(p, end);
+    if (p == end) return p;
+    if (*p != '\n') return NULL;
+    return p + 1;
+}
+
+/* Parse "a.b.c.d/len<blanks>iface" */
+static const char *parse_fib_line(const char *p, const char *end, FibEntry *entry)
+{
+    long prefix_length, out_iface;
+    p = parse_ip(p, end, &entry->prefix);
+    if (!p || p == end || *p != '/') return NULL;
+    p = parse_decimal(p + 1, end, 32, &prefix_length);
+    if (!p || p == end || !is_blank(*p)) return NULL;
+    p = parse_decimal(skip_blanks(p, end), end, INT_MAX, &out_iface);
+    if (!p) return NULL;
+    entry->prefix_length = prefix_length;
+    entry->out_iface = out_iface;
+    return end_of_line(p, end);
+}
+
+/* Parse "A|M a.b.c.d/len iface" or "D a.b.c.d/len" */
+static const char *parse_update_line(const char *p, const char *end, RouteUpdate *update)
+{
+    long prefix_length, out_iface = 0;
+    if (end - p < 2 || !strchr("ADM", *p) || !is_blank(p[1])) return NULL;
+    update->op = *p;
+    p = parse_ip(skip_blanks(p + 1, end), end, &update->entry.prefix);
+    if (!p || p == end || *p != '/') return NULL;
+    p = parse_decimal(p + 1, end, 32, &prefix_length);
+    if (!p) return NULL;
+    if (update->op != ROUTE_DEL) {
+        if (p == end || !is_blank(*p)) return NULL;
+        p = parse_decimal(skip_blanks(p, end), end, INT_MAX, &out_iface);
+        if (!p) return NULL;
+    }
+    update->entry.prefix_length = prefix_length;
+    update->entry.out_iface = out_iface;
+    return end_of_line(p, end);
+}
+
+static int hex_value(char c)
+{
+    if (is_digit(c)) return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Parse "xx:xx:xx:xx:xx:xx" */
+static const char *parse_mac(const char *p, const char *end, uint8_t *mac)
+{
+    for (int i = 0; i < 6; ++i) {
+        if (i) {
+            if (p == end || *p != ':') return NULL;
+            p += 1;
+        }
+        if (end - p < 2 || hex_value(p[0]) < 0 || hex_value(p[1]) < 0) return NULL;
+        mac[i] = hex_value(p[0]) << 4 | hex_value(p[1]);
+        p += 2;
+    }
+    return p;
+}
+
+/* Parse "iface a.b.c.d [xx:xx:xx:xx:xx:xx]" */
+static const char *parse_nexthop_line(const char *p, const char *end, NextHop *next_hop)
+{
+    long out_iface;
+    *next_hop = (NextHop) {0};
+    p = parse_decimal(p, end, INT_MAX, &out_iface);
+    if (!p || p == end || !is_blank(*p)) return NULL;
+    p = parse_ip(skip_blanks(p, end), end, &next_hop->gateway);
+    if (!p) return NULL;
+    next_hop->out_iface = out_iface;
+    const char *mac = skip_blanks(p, end);
+    if (mac != p && mac < end && *mac != '\n') {
+        p = parse_mac(mac, end, next_hop->mac);
+        if (!p) return NULL;
+        next_hop->has_mac = 1;
+    }
+    return end_of_line(p, end);
+}
+
+static void log_parse_error(const char *path, const char *data, const char *line)
+{
+    size_t number = 1;
+    for (const char *p = data; p < line; ++p)
+        number += *p == '\n';
+    fprintf(stderr, "ERROR: %s:%zu: malformed line\n", path, number);
+}
+
+/**********************************************************************
+ * Load a whole routing table.
+ **********************************************************************/
+int load_fib(const char *path, Fib *fib)
+{
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0)
+        return ROUTING_TABLE_NOT_FOUND;
+
+    *fib = (Fib) { .entries = malloc(count_lines(data, size) * sizeof(FibEntry)) };
+    if (!fib->entries) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *line = p;
+        p = skip_blanks(p, end);
+        if (p < end && *p == '\n') {  // Empty line
+            p += 1;
+            continue;
+        }
+        if (p == end) break;
+        p = parse_fib_line(p, end, &fib->entries[fib->size]);
+        if (!p) {
+            log_parse_error(path, data, line);
+            unmap_file(data, size);
+            fib_free(fib);
+            return BAD_ROUTING_TABLE;
+        }
+        fib->size += 1;
+    }
+    unmap_file(data, size);
+    return OK;
+}
+
+/**********************************************************************
+ * Load a whole input packet file.
+ **********************************************************************/
+int load_trace(const char *path, uint32_t **ips, size_t *count)
+{
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0)
+        return INPUT_FILE_NOT_FOUND;
+
+    if (pcap_detect(data, size)) {
+        size_t skipped;
+        int result = pcap_extract(data, size, ips, count, &skipped);
+        unmap_file(data, size);
+        if (result < 0) {
+            fprintf(stderr, "ERROR: %s: malformed or truncated capture\n", path);
+            return BAD_INPUT_FILE;
+        }
+        if (skipped)
+            fprintf(stderr, "WARNING: %s: %zu frames without IPv4 skipped\n", path, skipped);
+        return OK;
+    }
+
+    *count = 0;
+    *ips = malloc(count_lines(data, size) * sizeof(uint32_t));
+    if (!*ips) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *line = p;
+        p = skip_blanks(p, end);
+        if (p < end && *p == '\n') {
+            p += 1;
+            continue;
+        }
+        if (p == end) break;
+        p = parse_ip(p, end, &(*ips)[*count]);
+        if (p) p = end_of_line(p, end);
+        if (!p) {
+            log_parse_error(path, data, line);
+            unmap_file(data, size);
+            free(*ips);
+            *ips = NULL;
+            *count = 0;
+            return BAD_INPUT_FILE;
+        }
+        *count += 1;
+    }
+    unmap_file(data, size);
+    return OK;
+}
+
+/**********************************************************************
+ * Parse the complete lines of a piece of a trace.
+ **********************************************************************/
+const char *parse_trace(const char *p, const char *end, uint32_t *ips, size_t max, size_t *count)
+{
+    *count = 0;
+    while (p < end && *count < max) {
+        const char *line_end = memchr(p, '\n', end - p);
+        if (!line_end) break;  // Incomplete, the rest comes later
+        const char *q = skip_blanks(p, line_end);
+        if (q < line_end) {
+            q = parse_ip(q, line_end, &ips[*count]);
+            if (q) q = end_of_line(q, line_end);
+            if (!q) return NULL;
+            *count += 1;
+        }
+        p = line_end + 1;
+    }
+    return p;
+}
+
+/**********************************************************************
+ * Load a whole update stream.
+ **********************************************************************/
+int load_updates(const char *path, RouteUpdate **updates, size_t *count)
+{
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0)
+        return UPDATE_FILE_NOT_FOUND;
+
+    *count = 0;
+    *updates = malloc(count_lines(data, size) * sizeof(RouteUpdate));
+    if (!*updates) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *line = p;
+        p = skip_blanks(p, end);
+        if (p < end && *p == '\n') {
+            p += 1;
+            continue;
+        }
+        if (p == end) break;
+        p = parse_update_line(p, end, &(*updates)[*count]);
+        if (!p) {
+            log_parse_error(path, data, line);
+            unmap_file(data, size);
+            free(*updates);
+            *updates = NULL;
+            *count = 0;
+            return BAD_UPDATE_FILE;
+        }
+        *count += 1;
+    }
+    unmap_file(data, size);
+    return OK;
+}
+
+/**********************************************************************
+ * Load the metadata of the next hops.
+ **********************************************************************/
+int load_nexthops(const char *path, NextHop **next_hops, size_t *count)
+{
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0)
+        return NEXTHOP_FILE_NOT_FOUND;
+
+    *count = 0;
+    *next_hops = malloc(count_lines(data, size) * sizeof(NextHop));
+    if (!*next_hops) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *line = p;
+        p = skip_blanks(p, end);
+        if (p < end && *p == '\n') {
+            p += 1;
+            continue;
+        }
+        if (p == end) break;
+        p = parse_nexthop_line(p, end, &(*next_hops)[*count]);
+        if (!p) {
+            log_parse_error(path, data, line);
+            unmap_file(data, size);
+            free(*next_hops);
+            *next_hops = NULL;
+            *count = 0;
+            return BAD_NEXTHOP_FILE;
+        }
+        *count += 1;
+    }
+    unmap_file(data, size);
+    return OK;
+}
+
+/* Parse an IPv6 address in text form, up to '/', a blank or the end of the line */
+static const char *parse_ip6(const char *p, const char *end, Ip6 *ip)
+{
+    char text[IP6_ADDRESS_SIZE];
+    size_t length = 0;
+    while (p + length < end && p[length] != '/' && p[length] != '\n' && !is_blank(p[length])) {
+        if (length == IP6_ADDRESS_SIZE - 1) return NULL;
+        length += 1;
+    }
+    memcpy(text, p, length);
+    text[length] = '\0';
+    unsigned char bytes[16];
+    if (inet_pton(AF_INET6, text, bytes) != 1) return NULL;
+    *ip = 0;
+    for (int i = 0; i < 16; ++i)
+        *ip = *ip << 8 | bytes[i];
+    return p + length;
+}
+
+/* Parse "addr/len<blanks>iface" */
+static const char *parse_fib6_line(const char *p, const char *end, Fib6Entry *entry)
+{
+    long prefix_length, out_iface;
+    p = parse_ip6(p, end, &entry->prefix);
+    if (!p || p == end || *p != '/') return NULL;
+    p = parse_decimal(p + 1, end, IP6_LENGTH, &prefix_length);
+    if (!p || p == end || !is_blank(*p)) return NULL;
+    p = parse_decimal(skip_blanks(p, end), end, INT_MAX, &out_iface);
+    if (!p) return NULL;
+    entry->prefix &= ip6_mask(prefix_length);
+    entry->prefix_length = prefix_length;
+    entry->out_iface = out_iface;
+    return end_of_line(p, end);
+}
+
+/**********************************************************************
+ * Load a whole IPv6 routing table.
+ **********************************************************************/
+int load_fib6(const char *path, Fib6 *fib)
+{
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0)
+        return ROUTING_TABLE_NOT_FOUND;
+
+    *fib = (Fib6) { .entries = malloc(count_lines(data, size) * sizeof(Fib6Entry)) };
+    if (!fib->entries) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *line = p;
+        p = skip_blanks(p, end);
+        if (p < end && *p == '\n') {
+            p += 1;
+            continue;
+        }
+        if (p == end) break;
+        p = parse_fib6_line(p, end, &fib->entries[fib->size]);
+        if (!p) {
+            log_parse_error(path, data, line);
+            unmap_file(data, size);
+            free(fib->entries);
+            *fib = (Fib6) {0};
+            return BAD_ROUTING_TABLE;
+        }
+        fib->size += 1;
+    }
+    unmap_file(data, size);
+    return OK;
+}
+
+/**********************************************************************
+ * Load a whole IPv6 input packet file.
+ **********************************************************************/
+int load_trace6(const char *path, Ip6 **ips, size_t *count)
+{
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0)
+        return INPUT_FILE_NOT_FOUND;
+
+    *count = 0;
+    *ips = malloc(count_lines(data, size) * sizeof(Ip6));
+    if (!*ips) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *line = p;
+        p = skip_blanks(p, end);
+        if (p < end && *p == '\n') {
+            p += 1;
+            continue;
+        }
+        if (p == end) break;
+        p = parse_ip6(p, end, &(*ips)[*count]);
+        if (p) p = end_of_line(p, end);
+        if (!p) {
+            log_parse_error(path, data, line);
+            unmap_file(data, size);
+            free(*ips);
+            *ips = NULL;
+            *count = 0;
+            return BAD_INPUT_FILE;
+        }
+        *count += 1;
+    }
+    unmap_file(data, size);
+    return OK;
+}
+
+/**********************************************************************
+ * Write an IPv6 address in its text form.
+ **********************************************************************/
+char *ip6_format(Ip6 ip, char *text)
+{
+    unsigned char bytes[16];
+    for (int i = 15; i >= 0; --i, ip >>= 8)
+        bytes[i] = (unsigned char)ip;
+    if (!inet_ntop(AF_INET6, bytes, text, IP6_ADDRESS_SIZE))
+        text[0] = '\0';
+    return text;
+}
+
+/**********************************************************************
+ * Free the entries of the FIB.
+ **********************************************************************/
+void fib_free(Fib *fib)
+{
+    free(fib->entries);
+    *fib = (Fib) {0};
+}
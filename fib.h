@@ -0,0 +1,136 @@
+#ifndef FIB_H
+#define FIB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "nexthop.h"
+#include "ip6.h"
+
+/**********************************************************************
+ * FIB ENTRY
+ * One line of the routing table.
+ **********************************************************************/
+typedef struct {
+    uint32_t prefix;
+    int prefix_length;
+    int out_iface;
+} FibEntry;
+
+/**********************************************************************
+ * FIB
+ * Fields:
+ *  - entries: the lines of the routing table, in file order.
+ *  - size: number of entries.
+ **********************************************************************/
+typedef struct {
+    FibEntry *entries;
+    size_t size;
+} Fib;
+
+/**********************************************************************
+ * ROUTE UPDATE
+ * One line of an update stream:
+ *      A a.b.c.d/len iface     add a route (or change its next hop)
+ *      D a.b.c.d/len           delete a route
+ *      M a.b.c.d/len iface     change the next hop of a route
+ * The out_iface of the entry is not used for deletions.
+ **********************************************************************/
+typedef enum {
+    ROUTE_ADD = 'A',
+    ROUTE_DEL = 'D',
+    ROUTE_MODIFY = 'M',
+} RouteOp;
+
+typedef struct {
+    RouteOp op;
+    FibEntry entry;
+} RouteUpdate;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Load a whole routing table, mapping the file in memory and parsing
+ * it by hand. Every line must be "a.b.c.d/len<blanks>iface", with
+ * decimal octets in [0, 255] without leading zeros.
+ * THIS FUNCTION PRODUCES LOGS with the offending line on parse errors.
+ * Returns OK, ROUTING_TABLE_NOT_FOUND or BAD_ROUTING_TABLE (io.h).
+ * Args:
+ *  - const char *path: file path of the routing table.
+ *  - Fib *fib: output parameter. Free it with `fib_free`.
+ **********************************************************************/
+int load_fib(const char *path, Fib *fib);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Load a whole input packet file, one "a.b.c.d" address per line,
+ * with the same rules as `load_fib`. A pcap or pcapng capture gives
+ * the IPv4 destinations of its frames instead (see `pcap_extract`).
+ * Returns OK, INPUT_FILE_NOT_FOUND or BAD_INPUT_FILE (io.h).
+ * Args:
+ *  - const char *path: file path of the input packet file.
+ *  - uint32_t **ips, size_t *count: output parameters. Free *ips.
+ **********************************************************************/
+int load_trace(const char *path, uint32_t **ips, size_t *count);
+
+/**********************************************************************
+ * Parse the complete lines ("a.b.c.d", blank lines are skipped) at the
+ * start of [p, end), a piece of a trace read from a stream, up to `max`
+ * IPs.
+ * Returns where the first line not parsed starts, or NULL if a line is
+ * malformed (*count are the IPs before it).
+ * Args:
+ *  - uint32_t *ips, size_t *count: output parameters, room for `max`.
+ **********************************************************************/
+const char *parse_trace(const char *p, const char *end, uint32_t *ips, size_t max, size_t *count);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Load a whole update stream, with the same rules as `load_fib`.
+ * Returns OK, UPDATE_FILE_NOT_FOUND or BAD_UPDATE_FILE (io.h).
+ * Args:
+ *  - const char *path: file path of the update stream.
+ *  - RouteUpdate **updates, size_t *count: output parameters. Free
+ *  *updates.
+ **********************************************************************/
+int load_updates(const char *path, RouteUpdate **updates, size_t *count);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Load the metadata of the next hops, one per line:
+ *      iface a.b.c.d [xx:xx:xx:xx:xx:xx]
+ * the interface, its gateway (0.0.0.0 if directly connected) and
+ * optionally the MAC of the gateway, in hexadecimal.
+ * Returns OK, NEXTHOP_FILE_NOT_FOUND or BAD_NEXTHOP_FILE (io.h).
+ * Args:
+ *  - const char *path: file path of the next hop file.
+ *  - NextHop **next_hops, size_t *count: output parameters. Free
+ *  *next_hops.
+ **********************************************************************/
+int load_nexthops(const char *path, NextHop **next_hops, size_t *count);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Load a whole IPv6 routing table, with the same rules as `load_fib`.
+ * Every line must be "addr/len<blanks>iface", the address in any text
+ * form of RFC 4291 and the length in [0, 128]. Prefixes are masked.
+ * Returns OK, ROUTING_TABLE_NOT_FOUND or BAD_ROUTING_TABLE (io.h).
+ * Args:
+ *  - Fib6 *fib: output parameter. Free fib->entries.
+ **********************************************************************/
+int load_fib6(const char *path, Fib6 *fib);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Load a whole IPv6 input packet file, one address per line, with the
+ * same rules as `load_trace`.
+ * Returns OK, INPUT_FILE_NOT_FOUND or BAD_INPUT_FILE (io.h).
+ * Args:
+ *  - Ip6 **ips, size_t *count: output parameters. Free *ips.
+ **********************************************************************/
+int load_trace6(const char *path, Ip6 **ips, size_t *count);
+
+/**********************************************************************
+ * Free the entries of the FIB.
+ **********************************************************************/
+void fib_free(Fib *fib);
+
+#endif // FIB_H
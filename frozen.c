@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "frozen.h"
+#include "utils.h"
+
+/* Position of a node of the Patricia trie in the frozen array */
+typedef struct {
+    const Node *node;
+    uint32_t index;
+} NodeIndex;
+
+typedef struct {
+    const Node **items;
+    int size;
+} NodeOrder;
+
+static int count_nodes(const Node *node)
+{
+    if (!node) return 0;
+    return 1 + count_nodes(node->left) + count_nodes(node->right);
+}
+
+static int height(const Node *node)
+{
+    if (!node) return 0;
+    int left = height(node->left), right = height(node->right);
+    return 1 + (left > right ? left : right);
+}
+
+static void layout_bfs(NodeOrder *order, const Node *root)
+{
+    int head = 0;
+    order->items[order->size++] = root;
+    while (head < order->size) {
+        const Node *node = order->items[head++];
+        if (node->left) order->items[order->size++] = node->left;
+        if (node->right) order->items[order->size++] = node->right;
+    }
+}
+
+static void layout_veb(NodeOrder *order, const Node *node, int h);
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Lay out the subtrees rooted at depth `depth` under `node`, from left
+ * to right, each one truncated to height `h`.
+ **********************************************************************/
+static void layout_bottoms(NodeOrder *order, const Node *node, int depth, int h)
+{
+    if (!node) return;
+    if (!depth) {
+        layout_veb(order, node, h);
+        return;
+    }
+    layout_bottoms(order, node->left, depth - 1, h);
+    layout_bottoms(order, node->right, depth - 1, h);
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Lay out the nodes of the subtree rooted at `node` whose depth is
+ * less than `h`: first the top half of the levels, then every subtree
+ * hanging from it.
+ **********************************************************************/
+static void layout_veb(NodeOrder *order, const Node *node, int h)
+{
+    if (!node) return;
+    if (h == 1) {
+        order->items[order->size++] = node;
+        return;
+    }
+    int top = h / 2;
+    layout_veb(order, node, top);
+    layout_bottoms(order, node, top, h - top);
+}
+
+static int compare_node_index(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)((const NodeIndex *)a)->node,
+              y = (uintptr_t)((const NodeIndex *)b)->node;
+    return (x > y) - (x < y);
+}
+
+static uint32_t find_index(const NodeIndex *indices, int size, const Node *node)
+{
+    if (!node) return FROZEN_NULL;
+    NodeIndex key = { .node = node };
+    const NodeIndex *found = bsearch(&key, indices, size, sizeof(NodeIndex), compare_node_index);
+    return found->index;
+}
+
+/**********************************************************************
+ * Serialize a (compressed) Patricia trie into a single array.
+ **********************************************************************/
+FrozenTrie *freeze_trie(Node *root, FrozenLayout layout)
+{
+    int size = count_nodes(root);
+    NodeOrder order = { .items = malloc(size * sizeof(Node *)) };
+    NodeIndex *indices = malloc(size * sizeof(NodeIndex));
+    FrozenTrie *trie = malloc(sizeof(FrozenTrie));
+    FrozenNode *nodes = malloc(size * sizeof(FrozenNode));
+    if (!order.items || !indices || !trie || !nodes) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    if (layout == FROZEN_BFS)
+        layout_bfs(&order, root);
+    else
+        layout_veb(&order, root, height(root));
+
+    for (int i = 0; i < size; ++i)
+        indices[i] = (NodeIndex) { .node = order.items[i], .index = i };
+    qsort(indices, size, sizeof(NodeIndex), compare_node_index);
+
+    for (int i = 0; i < size; ++i) {
+        const Node *node = order.items[i];
+        if (node->out_iface < 0 || node->out_iface > FROZEN_MAX_IFACE) {
+            fprintf(stderr, "ERROR: output interface %d does not fit in a frozen node\n", node->out_iface);
+            free(nodes);
+            free(trie);
+            trie = NULL;
+            break;
+        }
+        nodes[i] = (FrozenNode) {
+            .prefix = node->prefix,
+            .child = { find_index(indices, size, node->left), find_index(indices, size, node->right) },
+            .out_iface = node->out_iface,
+            .prefix_length = node->prefix_length,
+        };
+    }
+    free(indices);
+    free(order.items);
+    if (trie) {
+        trie->nodes = nodes;
+        trie->size = size;
+    }
+    return trie;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one. Same results and accesses as `lookup`.
+ **********************************************************************/
+int frozen_lookup(const FrozenTrie *trie, uint32_t ip, int *accesses)
+{
+    int best_iface = NO_IFACE;
+    uint32_t index = 0;
+    do {
+        const FrozenNode *node = &trie->nodes[index];
+        *accesses += 1;
+        uint32_t mask = node->prefix_length ? 0xFFFFFFFF << (32 - node->prefix_length) : 0;
+        if ((ip & mask) != (node->prefix & mask))
+            break;
+        if (node->out_iface != NO_IFACE)
+            best_iface = node->out_iface;
+        index = node->prefix_length < 32 ? node->child[(ip >> (31 - node->prefix_length)) & 1]
+                                         : FROZEN_NULL;
+    } while (index != FROZEN_NULL);
+    return best_iface;
+}
+
+/* State of one of the interleaved walks of `frozen_lookup_batch` */
+typedef struct {
+    uint32_t node;
+    int done;
+    size_t index;
+    int best_iface;
+    int accesses;
+} FrozenLane;
+
+/**********************************************************************
+ * Look up a batch of IPs, interleaving LOOKUP_BATCH_GROUP walks.
+ **********************************************************************/
+void frozen_lookup_batch(const FrozenTrie *trie, const uint32_t *ips, int *ifaces,
+                         int *accesses, size_t n)
+{
+    FrozenLane lanes[LOOKUP_BATCH_GROUP];
+    size_t next = 0;
+    int active = 0;
+
+    for (; active < LOOKUP_BATCH_GROUP && next < n; ++active, ++next)
+        lanes[active] = (FrozenLane) { .index = next, .best_iface = NO_IFACE };
+    int lanes_used = active;
+
+    while (active) {
+        for (int l = 0; l < lanes_used; ++l) {
+            if (lanes[l].done) continue;
+            const FrozenNode *node = &trie->nodes[lanes[l].node];
+            uint32_t ip = ips[lanes[l].index];
+            uint32_t index = FROZEN_NULL;
+            lanes[l].accesses += 1;
+
+            uint32_t mask = node->prefix_length ? 0xFFFFFFFF << (32 - node->prefix_length) : 0;
+            if ((ip & mask) == (node->prefix & mask)) {
+                if (node->out_iface != NO_IFACE)
+                    lanes[l].best_iface = node->out_iface;
+                if (node->prefix_length < 32)
+                    index = node->child[(ip >> (31 - node->prefix_length)) & 1];
+            }
+
+            if (index != FROZEN_NULL) {
+                __builtin_prefetch(&trie->nodes[index]);
+                lanes[l].node = index;
+                continue;
+            }
+            ifaces[lanes[l].index] = lanes[l].best_iface;
+            accesses[lanes[l].index] = lanes[l].accesses;
+            if (next < n) {
+                lanes[l] = (FrozenLane) { .index = next++, .best_iface = NO_IFACE };
+            } else {
+                lanes[l].done = 1;
+                active -= 1;
+            }
+        }
+    }
+}
+
+/**********************************************************************
+ * Check the child indexes of a trie read from a snapshot.
+ **********************************************************************/
+int frozen_validate(const FrozenTrie *trie)
+{
+    if (trie->size < 1)
+        return -1;
+    for (int i = 0; i < trie->size; ++i) {
+        const FrozenNode *node = &trie->nodes[i];
+        if (node->prefix_length > IP_ADDRESS_LENGTH)
+            return -1;
+        for (int c = 0; c < 2; ++c)
+            if (node->child[c] != FROZEN_NULL &&
+                (node->child[c] <= (uint32_t)i || node->child[c] >= (uint32_t)trie->size))
+                return -1;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Free the frozen trie.
+ **********************************************************************/
+void frozen_free(FrozenTrie *trie)
+{
+    if (!trie) return;
+    free(trie->nodes);
+    free(trie);
+}
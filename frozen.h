@@ -0,0 +1,86 @@
+#ifndef FROZEN_H
+#define FROZEN_H
+
+#include <stdint.h>
+#include "node.h"
+
+#define FROZEN_NULL 0
+#define FROZEN_MAX_IFACE UINT16_MAX
+
+/**********************************************************************
+ * FROZEN NODE
+ * Pointer-free copy of a Patricia trie node (16 bytes, 4 per cache
+ * line).
+ * Fields:
+ *  - prefix: the prefix itself.
+ *  - child[2]: indices of the left/right subtrees. The root is always
+ *  at index 0, so FROZEN_NULL (0) means there is no subtree.
+ *  - out_iface: the next hop.
+ *  - prefix_length: the length of the prefix.
+ **********************************************************************/
+typedef struct {
+    uint32_t prefix;
+    uint32_t child[2];
+    uint16_t out_iface;
+    uint8_t prefix_length;
+} FrozenNode;
+
+/**********************************************************************
+ * Order of the nodes in the array.
+ *  - FROZEN_BFS: level by level, so the top levels are packed together.
+ *  - FROZEN_VEB: van Emde Boas, recursively splitting the tree in a top
+ *  half and bottom subtrees, so every subtree is contiguous.
+ **********************************************************************/
+typedef enum {
+    FROZEN_BFS,
+    FROZEN_VEB,
+} FrozenLayout;
+
+/**********************************************************************
+ * FROZEN TRIE
+ * Fields:
+ *  - nodes: the whole trie in a single array, the root is nodes[0].
+ *  - size: number of nodes.
+ **********************************************************************/
+typedef struct {
+    FrozenNode *nodes;
+    int size;
+} FrozenTrie;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Serialize a (compressed) Patricia trie into a single array.
+ * Returns NULL if it cannot be represented (next hop too big).
+ * Args:
+ *  - Node *root: the root of the trie. It is not modified.
+ *  - FrozenLayout layout: the order of the nodes.
+ **********************************************************************/
+FrozenTrie *freeze_trie(Node *root, FrozenLayout layout);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one. Same results and accesses as `lookup`.
+ **********************************************************************/
+int frozen_lookup(const FrozenTrie *trie, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * Look up a batch of IPs, interleaving LOOKUP_BATCH_GROUP walks (see
+ * `lookup_batch`).
+ **********************************************************************/
+void frozen_lookup_batch(const FrozenTrie *trie, const uint32_t *ips, int *ifaces,
+                         int *accesses, size_t n);
+
+/**********************************************************************
+ * Check that every child index of the trie is inside the node array and
+ * after its parent, and every prefix length is valid, so a trie read
+ * from a snapshot cannot make a lookup read out of bounds or loop.
+ * Returns 0, or -1 if it is broken.
+ **********************************************************************/
+int frozen_validate(const FrozenTrie *trie);
+
+/**********************************************************************
+ * Free the frozen trie.
+ **********************************************************************/
+void frozen_free(FrozenTrie *trie);
+
+#endif // FROZEN_H
@@ -35,8 +35,6 @@ void tee(FILE *f, char const *fmt, ...){
  ***********************************************************************/
 int initializeIO(char *routingTableName, char *inputFileName){
 
-	char outputFileName[100];
-
   routingTable = fopen(routingTableName, "r");
   if (routingTable == NULL) return ROUTING_TABLE_NOT_FOUND;
 
@@ -46,8 +44,14 @@ int initializeIO(char *routingTableName, char *inputFileName){
    	return INPUT_FILE_NOT_FOUND;
  	}
 
+  char *outputFileName = malloc(strlen(inputFileName) + sizeof(OUTPUT_NAME));
+  if (outputFileName == NULL) {
+    fprintf(stderr, "Buy more RAM lol\n");
+    exit(1);
+  }
   sprintf(outputFileName, "%s%s", inputFileName, OUTPUT_NAME);
   outputFile = fopen(outputFileName, "w");
+  free(outputFileName);
   if (outputFile == NULL) {
     fclose(routingTable);
     fclose(inputFile);
@@ -59,6 +63,18 @@ int initializeIO(char *routingTableName, char *inputFileName){
 }
 
 
+/***********************************************************************
+ * File descriptor of the output file, to write the results without
+ * going through tee (see output.h)
+ ***********************************************************************/
+int getOutputFileDescriptor(){
+
+  fflush(outputFile);
+  return fileno(outputFile);
+
+}
+
+
 /***********************************************************************
  * Close the input/output files
  ***********************************************************************/
@@ -95,6 +111,24 @@ void printIOExplanationError(int result){
     case CANNOT_CREATE_OUTPUT:
       printf("Cannot create output file\n");
       break;
+    case UPDATE_FILE_NOT_FOUND:
+      printf("Update file not found\n");
+      break;
+    case BAD_UPDATE_FILE:
+      printf("Bad update file structure\n");
+      break;
+    case SNAPSHOT_NOT_FOUND:
+      printf("Snapshot not found\n");
+      break;
+    case BAD_SNAPSHOT:
+      printf("Bad or incompatible snapshot\n");
+      break;
+    case NEXTHOP_FILE_NOT_FOUND:
+      printf("Next hop file not found\n");
+      break;
+    case BAD_NEXTHOP_FILE:
+      printf("Bad next hop file structure\n");
+      break;
     default:
       printf("Unknown error\n");
       break;
@@ -168,22 +202,37 @@ void printOutputLine(uint32_t IPAddress, int outInterface,
 
   long sec, nsec;
 
+  sec = finalTime->tv_sec - initialTime->tv_sec;
   nsec = finalTime->tv_nsec - initialTime->tv_nsec;
     if (nsec < 0){
-    	initialTime->tv_sec += 1;
-  	  nsec = 1e9 - nsec;
+      //borrow a second
+      sec -= 1;
+      nsec += 1000000000;
     }
-    sec = finalTime->tv_sec - initialTime->tv_sec;
 
     *searchingTime = 1e9*sec + nsec;
 
+    printResultLine(IPAddress, outInterface, *searchingTime, numberOfAccesses);
+
+}
+
+
+/***********************************************************************
+ * Print a line to the output file, with the searching time (nsecs)
+ * already computed
+ *
+ * Used when the lookups are not timed one by one (e.g. batches)
+ *
+ ***********************************************************************/
+void printResultLine(uint32_t IPAddress, int outInterface, double searchingTime, int numberOfAccesses) {
+
 	//remember that output interface equals 0 means no matching
 	//remember that if no matching but default route is specified in the FIB, the default output interface
 	//must be stored to avoid dropping the packet (i.e., MISS)
     if (!outInterface)
-      tee(outputFile,"%i.%i.%i.%i;%s;%i;%.0lf\n",IPAddress >> 24, (IPAddress >> 16) & 0x000000ff, (IPAddress >> 8) & 0x000000ff, IPAddress & 0x000000ff , "MISS",numberOfAccesses, *searchingTime);
+      tee(outputFile,"%i.%i.%i.%i;%s;%i;%.0lf\n",IPAddress >> 24, (IPAddress >> 16) & 0x000000ff, (IPAddress >> 8) & 0x000000ff, IPAddress & 0x000000ff , "MISS",numberOfAccesses, searchingTime);
     else
-      tee(outputFile,"%i.%i.%i.%i;%i;%i;%.0lf\n",IPAddress >> 24, (IPAddress >> 16) & 0x000000ff, (IPAddress >> 8) & 0x000000ff, IPAddress & 0x000000ff , outInterface,numberOfAccesses, *searchingTime);
+      tee(outputFile,"%i.%i.%i.%i;%i;%i;%.0lf\n",IPAddress >> 24, (IPAddress >> 16) & 0x000000ff, (IPAddress >> 8) & 0x000000ff, IPAddress & 0x000000ff , outInterface,numberOfAccesses, searchingTime);
 
 }
 
@@ -235,3 +284,104 @@ void printMemoryTimeUsage(){
 }
 
 
+/***********************************************************************
+ * Print the time and the peak memory of the trie construction
+ *
+ * buildTime is in nanoseconds, buildMemory in Kbytes (see getPeakMemory)
+ *
+ ***********************************************************************/
+void printBuildSummary(double buildTime, long buildMemory){
+
+  tee(outputFile, "Build time (secs)= %.6lf\n", buildTime / 1e9);
+  tee(outputFile, "Build memory (Kbytes)= %ld\n\n", buildMemory);
+
+}
+
+
+/***********************************************************************
+ * Print the latency percentiles of the lookups (nsecs) and the timer
+ * that measured them
+ *
+ ***********************************************************************/
+void printLatencySummary(const char *timer, double p50, double p99, double p999, double maxLatency){
+
+  tee(outputFile, "Timer= %s\n", timer);
+  tee(outputFile, "Packet processing time percentiles (nsecs)= p50 %.0lf, p99 %.0lf, p99.9 %.0lf, max %.0lf\n\n",
+      p50, p99, p999, maxLatency);
+
+}
+
+
+/***********************************************************************
+ * Print the number of route updates applied and rejected (routes to
+ * delete or modify that did not exist)
+ *
+ ***********************************************************************/
+void printUpdateSummary(int appliedUpdates, int rejectedUpdates){
+
+  tee(outputFile, "Route updates applied= %i\n", appliedUpdates);
+  tee(outputFile, "Route updates rejected= %i\n\n", rejectedUpdates);
+
+}
+
+
+/***********************************************************************
+ * Peak resident set size so far, in Kbytes. Returns -1 on error
+ *
+ * For more info: man getrusage
+ *
+ ***********************************************************************/
+long getPeakMemory(){
+
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage)) return -1;
+  return usage.ru_maxrss;
+
+}
+
+
+/***********************************************************************
+ * Print the number of distinct next hops of the FIB
+ *
+ ***********************************************************************/
+void printNextHopSummary(int nextHops){
+
+  tee(outputFile, "Number of next hops= %i\n\n", nextHops);
+
+}
+
+
+/***********************************************************************
+ * Print the hits, misses and evictions of the front cache, and its
+ * hit rate
+ *
+ ***********************************************************************/
+void printCacheSummary(long hits, long misses, long evictions){
+
+  tee(outputFile, "Cache hits= %li\n", hits);
+  tee(outputFile, "Cache misses= %li\n", misses);
+  tee(outputFile, "Cache evictions= %li\n", evictions);
+  tee(outputFile, "Cache hit rate= %.2f%%\n\n", hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+
+}
+
+
+/***********************************************************************
+ * Print the line of an IPv6 lookup to the output file, and to the
+ * standard output unless quiet is set
+ *
+ ***********************************************************************/
+void printResultLine6(const char *IPAddress, int outInterface, double searchingTime, int numberOfAccesses, int quiet){
+
+  char interface[16];
+  if (!outInterface)
+    strcpy(interface, "MISS");
+  else
+    sprintf(interface, "%i", outInterface);
+  if (quiet)
+    fprintf(outputFile, "%s;%s;%i;%.0lf\n", IPAddress, interface, numberOfAccesses, searchingTime);
+  else
+    tee(outputFile, "%s;%s;%i;%.0lf\n", IPAddress, interface, numberOfAccesses, searchingTime);
+
+}
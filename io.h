@@ -14,6 +14,7 @@
  * Constant definitions
  ********************************************************************/
 #define OUTPUT_NAME ".out"
+#define BINARY_OUTPUT_NAME ".bin"
 #define OK 0
 #define ROUTING_TABLE_NOT_FOUND -3000
 #define INPUT_FILE_NOT_FOUND -3001
@@ -22,6 +23,12 @@
 #define BAD_INPUT_FILE -3004
 #define PARSE_ERROR -3005
 #define CANNOT_CREATE_OUTPUT -3006
+#define UPDATE_FILE_NOT_FOUND -3007
+#define BAD_UPDATE_FILE -3008
+#define SNAPSHOT_NOT_FOUND -3009
+#define BAD_SNAPSHOT -3010
+#define NEXTHOP_FILE_NOT_FOUND -3011
+#define BAD_NEXTHOP_FILE -3012
 
 /***********************************************************************
  * Write the input to the specified file (f) and the standard output
@@ -42,6 +49,13 @@ void tee(FILE *f, char const *fmt, ...);
 int initializeIO(char *routingTableName, char *inputFileName);
 
 
+/***********************************************************************
+ * File descriptor of the output file, to write the results without
+ * going through tee (see output.h)
+ ***********************************************************************/
+int getOutputFileDescriptor();
+
+
 /***********************************************************************
  * Close the input/output files
  ***********************************************************************/
@@ -89,6 +103,16 @@ int readInputPacketFileLine(uint32_t *IPAddress);
                         double *searchingTime, int numberOfTableAccesses);
 
 
+/***********************************************************************
+ * Print a line to the output file, with the searching time (nsecs)
+ * already computed
+ *
+ * Used when the lookups are not timed one by one (e.g. batches)
+ *
+ ***********************************************************************/
+void printResultLine(uint32_t IPAddress, int outInterface, double searchingTime, int numberOfAccesses);
+
+
 /***********************************************************************
  * Print execution summary to the output file
  *
@@ -111,3 +135,59 @@ void printSummary(int NumberOfNodesInTrie, int processedPackets, double averageN
 void printMemoryTimeUsage();
 
 
+/***********************************************************************
+ * Print the time and the peak memory of the trie construction
+ *
+ * buildTime is in nanoseconds, buildMemory in Kbytes (see getPeakMemory)
+ *
+ ***********************************************************************/
+void printBuildSummary(double buildTime, long buildMemory);
+
+
+/***********************************************************************
+ * Print the latency percentiles of the lookups (nsecs) and the timer
+ * that measured them
+ *
+ ***********************************************************************/
+void printLatencySummary(const char *timer, double p50, double p99, double p999, double maxLatency);
+
+
+/***********************************************************************
+ * Peak resident set size so far, in Kbytes. Returns -1 on error
+ *
+ * For more info: man getrusage
+ *
+ ***********************************************************************/
+long getPeakMemory();
+
+
+/***********************************************************************
+ * Print the number of route updates applied and rejected (routes to
+ * delete or modify that did not exist)
+ *
+ ***********************************************************************/
+void printUpdateSummary(int appliedUpdates, int rejectedUpdates);
+
+
+/***********************************************************************
+ * Print the number of distinct next hops of the FIB
+ *
+ ***********************************************************************/
+void printNextHopSummary(int nextHops);
+
+
+/***********************************************************************
+ * Print the hits, misses and evictions of the front cache, and its
+ * hit rate
+ *
+ ***********************************************************************/
+void printCacheSummary(long hits, long misses, long evictions);
+
+
+/***********************************************************************
+ * Print the line of an IPv6 lookup to the output file, and to the
+ * standard output unless quiet is set. Same fields as printResultLine,
+ * with the address already in text form
+ *
+ ***********************************************************************/
+void printResultLine6(const char *IPAddress, int outInterface, double searchingTime, int numberOfAccesses, int quiet);
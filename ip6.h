@@ -0,0 +1,61 @@
+#ifndef IP6_H
+#define IP6_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**********************************************************************
+ * IPv6 ADDRESS
+ * 128-bit keys, with the first bit of the address as the MSB, like the
+ * uint32_t of IPv4. The IPv6 code is a path of its own (node6.h, the
+ * IPv6 engines, load_fib6...), so the IPv4 one keeps its 32-bit keys.
+ **********************************************************************/
+__extension__ typedef unsigned __int128 Ip6;
+
+#define IP6_LENGTH 128
+#define IP6_ADDRESS_SIZE 46  // INET6_ADDRSTRLEN
+
+/* Netmask of a prefix length in [0, 128] */
+static inline Ip6 ip6_mask(int prefix_length)
+{
+    return prefix_length ? ~(Ip6)0 << (IP6_LENGTH - prefix_length) : 0;
+}
+
+/* Bit `pos` of an address (0 is the MSB), pos < 128 */
+static inline int ip6_bit(Ip6 ip, int pos)
+{
+    return (int)(ip >> (IP6_LENGTH - 1 - pos)) & 1;
+}
+
+/* Number of leading bits two addresses have in common */
+static inline int ip6_common_length(Ip6 a, Ip6 b)
+{
+    Ip6 diff = a ^ b;
+    uint64_t high = (uint64_t)(diff >> 64), low = (uint64_t)diff;
+    if (high) return __builtin_clzll(high);
+    if (low) return 64 + __builtin_clzll(low);
+    return IP6_LENGTH;
+}
+
+/**********************************************************************
+ * FIB6 ENTRY
+ * One line of an IPv6 routing table, "addr/len<blanks>iface".
+ **********************************************************************/
+typedef struct {
+    Ip6 prefix;
+    int prefix_length;
+    int out_iface;
+} Fib6Entry;
+
+typedef struct {
+    Fib6Entry *entries;
+    size_t size;
+} Fib6;
+
+/**********************************************************************
+ * Write an address in its text form (RFC 5952) into `text`, which has
+ * room for IP6_ADDRESS_SIZE characters. Returns `text`.
+ **********************************************************************/
+char *ip6_format(Ip6 ip, char *text);
+
+#endif // IP6_H
@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include "lctrie.h"
+#include "utils.h"
+
+/**********************************************************************
+ * Leaf of the leaf-pushed trie. The leaves are disjoint, sorted and
+ * cover the whole address space.
+ **********************************************************************/
+typedef struct {
+    uint32_t prefix;
+    int prefix_length;
+    int out_iface;
+} LCLeaf;
+
+typedef struct {
+    LCLeaf *items;
+    int size;
+    int capacity;
+} LCLeaves;
+
+/* Get `bits` bits of `ip` starting from bit `pos` (0 is the MSB) */
+#define extract(ip, pos, bits) (((uint32_t)(ip) << (pos)) >> (32 - (bits)))
+
+static void *lc_realloc(void *ptr, size_t size)
+{
+    void *new = realloc(ptr, size);
+    if (!new) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return new;
+}
+
+static void append_leaf(LCLeaves *leaves, uint32_t prefix, int prefix_length, int out_iface)
+{
+    if (leaves->size == leaves->capacity) {
+        leaves->capacity = leaves->capacity ? 2 * leaves->capacity : 1024;
+        leaves->items = lc_realloc(leaves->items, leaves->capacity * sizeof(LCLeaf));
+    }
+    leaves->items[leaves->size++] = (LCLeaf) {
+        .prefix = prefix,
+        .prefix_length = prefix_length,
+        .out_iface = out_iface,
+    };
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Push the next hops of the Patricia trie down to the leaves.
+ * Args:
+ *  - LCLeaves *leaves: output vector, filled in address order.
+ *  - Node *node: the subtree inside the current region, or NULL.
+ *  - uint32_t prefix, int prefix_length: the current region.
+ *  - int best: next hop inherited from the shorter prefixes.
+ **********************************************************************/
+static void push_leaves(LCLeaves *leaves, Node *node, uint32_t prefix, int prefix_length, int best)
+{
+    if (!node) {
+        append_leaf(leaves, prefix, prefix_length, best);
+        return;
+    }
+
+    /* The node is deeper (path compression): the sibling half is empty */
+    if (node->prefix_length > prefix_length) {
+        uint32_t bit = 1U << (31 - prefix_length);
+        if (node->prefix & bit) {
+            append_leaf(leaves, prefix, prefix_length + 1, best);
+            push_leaves(leaves, node, prefix | bit, prefix_length + 1, best);
+        } else {
+            push_leaves(leaves, node, prefix, prefix_length + 1, best);
+            append_leaf(leaves, prefix | bit, prefix_length + 1, best);
+        }
+        return;
+    }
+
+    if (node->out_iface != NO_IFACE)
+        best = node->out_iface;
+    if (!node->left && !node->right) {
+        append_leaf(leaves, prefix, prefix_length, best);
+        return;
+    }
+    push_leaves(leaves, node->left, prefix, prefix_length + 1, best);
+    push_leaves(leaves, node->right, prefix | (1U << (31 - prefix_length)), prefix_length + 1, best);
+}
+
+/**********************************************************************
+ * Compute the branching factor of a node covering `n` leaves at
+ * depth `pos`: the largest one for which at least fill_factor * 2^branch
+ * of the children are present in the binary trie. The leaves shorter
+ * than pos + branch have to be replicated, and they are the ones making
+ * the children disappear.
+ **********************************************************************/
+static int compute_branch(const LCLeaf *leaves, int n, int pos, double fill_factor)
+{
+    int count[33] = {0};
+    for (int i = 0; i < n; ++i)
+        count[leaves[i].prefix_length - pos] += 1;
+
+    int branch = 1;
+    double missing = 0;  // fraction of the children replicated at depth branch
+    while (pos + branch < 32 && branch < LC_MAX_BRANCH) {
+        missing += count[branch] / (double)(1U << branch);
+        if (1 - missing < fill_factor)
+            break;
+        branch += 1;
+    }
+    return branch;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Build the subtrie for the leaves [first, first + n) in the slot
+ * `slot` of the node array.
+ **********************************************************************/
+static void build(LCTrie *trie, const LCLeaf *leaves, int first, int n, int pos, int slot,
+                  double fill_factor, int forced_branch)
+{
+    if (n == 1) {
+        trie->nodes[slot] = LC_NODE(0, leaves[first].out_iface);
+        return;
+    }
+
+    int branch = forced_branch ? forced_branch
+                               : compute_branch(leaves + first, n, pos, fill_factor);
+    int children = 1 << branch;
+    if (trie->size + children > trie->capacity) {
+        while (trie->size + children > trie->capacity)
+            trie->capacity *= 2;
+        trie->nodes = lc_realloc(trie->nodes, trie->capacity * sizeof(LCNode));
+    }
+    int block = trie->size;
+    trie->size += children;
+    trie->nodes[slot] = LC_NODE(branch, block);
+
+    int i = first, end = first + n;
+    while (i < end) {
+        uint32_t pattern = extract(leaves[i].prefix, pos, branch);
+        if (leaves[i].prefix_length <= pos + branch) {
+            /* The leaf covers one or more children: replicate it */
+            uint32_t copies = 1U << (pos + branch - leaves[i].prefix_length);
+            for (uint32_t j = 0; j < copies; ++j)
+                trie->nodes[block + pattern + j] = LC_NODE(0, leaves[i].out_iface);
+            i += 1;
+        } else {
+            int j = i + 1;
+            while (j < end && extract(leaves[j].prefix, pos, branch) == pattern)
+                j += 1;
+            build(trie, leaves, i, j - i, pos + branch, block + pattern, fill_factor, 0);
+            i = j;
+        }
+    }
+}
+
+/**********************************************************************
+ * Build a level-compressed trie from a Patricia trie.
+ **********************************************************************/
+LCTrie *lc_create(Node *root, double fill_factor, int root_branch)
+{
+    LCLeaves leaves = {0};
+    push_leaves(&leaves, root, 0, 0, NO_IFACE);
+
+    for (int i = 0; i < leaves.size; ++i) {
+        if ((uint32_t)leaves.items[i].out_iface > LC_ADR_MASK) {
+            fprintf(stderr, "ERROR: output interface %d does not fit in an LC-trie node\n",
+                    leaves.items[i].out_iface);
+            free(leaves.items);
+            return NULL;
+        }
+    }
+    if (root_branch > LC_MAX_BRANCH)
+        root_branch = LC_MAX_BRANCH;
+
+    LCTrie *trie = lc_realloc(NULL, sizeof(LCTrie));
+    trie->capacity = leaves.size + 1;
+    trie->nodes = lc_realloc(NULL, trie->capacity * sizeof(LCNode));
+    trie->size = 1;
+    build(trie, leaves.items, 0, leaves.size, 0, 0, fill_factor, root_branch);
+
+    trie->nodes = lc_realloc(trie->nodes, trie->size * sizeof(LCNode));
+    trie->capacity = trie->size;
+    free(leaves.items);
+    return trie;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one.
+ **********************************************************************/
+int lc_lookup(const LCTrie *trie, uint32_t ip, int *accesses)
+{
+    LCNode node = trie->nodes[0];
+    int pos = 0;
+    *accesses += 1;
+    while (LC_BRANCH(node)) {
+        int branch = LC_BRANCH(node);
+        node = trie->nodes[LC_ADR(node) + extract(ip, pos, branch)];
+        pos += branch;
+        *accesses += 1;
+    }
+    return LC_ADR(node);
+}
+
+/* State of one of the interleaved walks of `lc_lookup_batch` */
+typedef struct {
+    const LCNode *next;
+    int pos;
+    size_t index;
+    int accesses;
+} LCLane;
+
+/**********************************************************************
+ * Look up a batch of IPs, interleaving LOOKUP_BATCH_GROUP walks. Every
+ * lane keeps a pointer to its next node, which is prefetched one round
+ * before it is read.
+ **********************************************************************/
+void lc_lookup_batch(const LCTrie *trie, const uint32_t *ips, int *ifaces,
+                     int *accesses, size_t n)
+{
+    LCLane lanes[LOOKUP_BATCH_GROUP];
+    size_t next = 0;
+    int active = 0;
+
+    for (; active < LOOKUP_BATCH_GROUP && next < n; ++active, ++next)
+        lanes[active] = (LCLane) { .next = trie->nodes, .index = next };
+    int lanes_used = active;
+
+    while (active) {
+        for (int l = 0; l < lanes_used; ++l) {
+            if (!lanes[l].next) continue;
+            LCNode node = *lanes[l].next;
+            lanes[l].accesses += 1;
+            if (LC_BRANCH(node)) {
+                int branch = LC_BRANCH(node);
+                lanes[l].next = &trie->nodes[LC_ADR(node) + extract(ips[lanes[l].index], lanes[l].pos, branch)];
+                lanes[l].pos += branch;
+                __builtin_prefetch(lanes[l].next);
+                continue;
+            }
+            ifaces[lanes[l].index] = LC_ADR(node);
+            accesses[lanes[l].index] = lanes[l].accesses;
+            if (next < n) {
+                lanes[l] = (LCLane) { .next = trie->nodes, .index = next++ };
+            } else {
+                lanes[l].next = NULL;
+                active -= 1;
+            }
+        }
+    }
+}
+
+/**********************************************************************
+ * Check the child blocks of a trie read from a snapshot. The blocks are
+ * allocated after their parent, so the bits consumed above every node
+ * are known once the nodes before it are checked.
+ **********************************************************************/
+int lc_validate(const LCTrie *trie)
+{
+    if (trie->size < 1)
+        return -1;
+    uint8_t *pos = calloc(trie->size, sizeof(uint8_t));
+    if (!pos) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    int result = 0;
+    for (int i = 0; i < trie->size && !result; ++i) {
+        LCNode node = trie->nodes[i];
+        int branch = LC_BRANCH(node);
+        if (!branch)
+            continue;
+        uint64_t last = (uint64_t)LC_ADR(node) + (1ULL << branch);
+        if (pos[i] + branch > IP_ADDRESS_LENGTH || LC_ADR(node) <= (uint32_t)i || last > (uint64_t)trie->size) {
+            result = -1;
+            break;
+        }
+        for (uint32_t child = LC_ADR(node); child < last; ++child)
+            if (pos[child] < pos[i] + branch)
+                pos[child] = pos[i] + branch;
+    }
+    free(pos);
+    return result;
+}
+
+/**********************************************************************
+ * Free the LC-trie.
+ **********************************************************************/
+void lc_free(LCTrie *trie)
+{
+    if (!trie) return;
+    free(trie->nodes);
+    free(trie);
+}
@@ -0,0 +1,85 @@
+#ifndef LCTRIE_H
+#define LCTRIE_H
+
+#include <stdint.h>
+#include "node.h"
+
+#define LC_DEFAULT_FILL_FACTOR 0.5
+#define LC_DEFAULT_ROOT_BRANCH 16
+#define LC_MAX_BRANCH 24
+
+/**********************************************************************
+ * LC-TRIE NODE
+ * Every node is packed in a single 32-bit word, as in the original
+ * Nilsson & Karlsson paper:
+ *  - branch (5 bits): number of bits consumed by this node. The node
+ *  has 2^branch children stored contiguously. 0 means leaf.
+ *  - adr (27 bits): index of the first child if it is an internal node,
+ *  or the output interface if it is a leaf.
+ **********************************************************************/
+typedef uint32_t LCNode;
+#define LC_ADR_BITS 27
+#define LC_ADR_MASK ((1U << LC_ADR_BITS) - 1)
+#define LC_BRANCH(n) ((n) >> LC_ADR_BITS)
+#define LC_ADR(n) ((n) & LC_ADR_MASK)
+#define LC_NODE(branch, adr) (((uint32_t)(branch) << LC_ADR_BITS) | (adr))
+
+/**********************************************************************
+ * LC-TRIE
+ * Fields:
+ *  - nodes: the whole trie, the root is nodes[0].
+ *  - size: number of nodes in use.
+ *  - capacity: number of nodes allocated.
+ **********************************************************************/
+typedef struct {
+    LCNode *nodes;
+    int size;
+    int capacity;
+} LCTrie;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Build a level-compressed trie from a (compressed or not) Patricia
+ * trie. The prefixes are leaf-pushed first, so that the leaves cover
+ * the whole address space and no prefix check is needed at the end.
+ * Args:
+ *  - Node *root: the root of the Patricia trie. It is not modified.
+ *  - double fill_factor: fraction (0, 1] of the 2^branch children of a
+ *  node that must exist in the binary trie to use that branch.
+ *  - int root_branch: branching factor of the root. If it is 0, the
+ *  fill factor is used for the root too.
+ **********************************************************************/
+LCTrie *lc_create(Node *root, double fill_factor, int root_branch);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one.
+ * Args:
+ *  - const LCTrie *trie: the LC-trie.
+ *  - uint32_t ip: the IP for which to look up a next hop.
+ *  - int *accesses: variable declared outside the function to keep
+ *  track of the number of memory acesses.
+ **********************************************************************/
+int lc_lookup(const LCTrie *trie, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * Look up a batch of IPs, interleaving LOOKUP_BATCH_GROUP walks (see
+ * `lookup_batch`).
+ **********************************************************************/
+void lc_lookup_batch(const LCTrie *trie, const uint32_t *ips, int *ifaces,
+                     int *accesses, size_t n);
+
+/**********************************************************************
+ * Check that every child block of the trie is inside the node array,
+ * after its parent, and that no path consumes more than 32 bits, so a
+ * trie read from a snapshot cannot make a lookup read out of bounds or
+ * loop. Returns 0, or -1 if it is broken.
+ **********************************************************************/
+int lc_validate(const LCTrie *trie);
+
+/**********************************************************************
+ * Free the LC-trie.
+ **********************************************************************/
+void lc_free(LCTrie *trie);
+
+#endif // LCTRIE_H
@@ -3,22 +3,69 @@
 #endif
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "io.h"
 #include "node.h"
+#include "engine.h"
+#include "lctrie.h"
+#include "fib.h"
+#include "worker.h"
+#include "rcu.h"
+#include "timing.h"
+#include "output.h"
+#include "snapshot.h"
+#include "cache.h"
+#include "stream.h"
+#include "build.h"
+#include "stats.h"
 
 //En mi caso es necesario que lo primero sea definir _POSIX_C_SOURCE 200809L para usar funciones POSIX de nivel 2008 o superior.
 //asi el compilador no da error en la función gettime() ni en la macro CLOCK_MONOTONIC_RAW
 
-extern int node_count;
-
 typedef struct {
     char *fib_file;
     char *input_packet_file;
+    char *update_file;
+    char *compile_file;
+    char *snapshot_file;
+    char *nexthop_file;
+    const Engine *engine;
+    int engine_chosen;  // Given with -e, not the default
+    EngineOptions options;
+    int batch_size;
+    int threads;
+    int build_threads;
+    TimerSource timer;
+    OutputFormat output_format;
+    int quiet;
+    int aggregate;
+    size_t cache_entries;
+    CacheKey cache_key;
+    char *stream_source;
+    StreamFormat stream_format;
+    double stats_interval;
+    int ipv6;
+    char *stats_file;
+    StatsFormat stats_format;
 } Args;
 
 void usage(char *cmd, char *errmsg)
 {
-    fprintf(stderr, "Usage: %s <FIB> <InputPacketFile>\n", cmd);
+    fprintf(stderr, "Usage: %s [-e engine] [-f fill_factor] [-r root_branch] [-b batch_size] [-j threads] [-P build_threads] [-u updates] [-t tsc|clock] [-o text|binary] [-q] [-a] [-n nexthops] [-C cache_entries] [-K ip|24] [-T stats_file] [-F json|prometheus] <FIB> <InputPacketFile>\n", cmd);
+    fprintf(stderr, "       %s -c <snapshot> [-e engine] [-f fill_factor] [-r root_branch] [-P build_threads] [-a] [-n nexthops] <FIB>\n", cmd);
+    fprintf(stderr, "       %s -s <snapshot> [options] <InputPacketFile>\n", cmd);
+    fprintf(stderr, "       %s -S -|unix:<socket>|<fifo> [-i text|binary] [-I seconds] [options] <FIB>|-s <snapshot>\n", cmd);
+    fprintf(stderr, "       %s -6 [-e engine] [-t tsc|clock] [-q] <FIB6> <InputPacketFile6>\n", cmd);
+    fputs("Engines:", stderr);
+    for (int i = 0; i < engine_count; ++i)
+        fprintf(stderr, " %s", engines[i].name);
+    fputs(" (default: patricia)\nIPv6 engines:", stderr);
+    for (int i = 0; i < engine6_count; ++i)
+        fprintf(stderr, " %s", engines6[i].name);
+    fputs("\n", stderr);
     fputs(errmsg, stderr);
 }
 
@@ -33,11 +80,232 @@ char *shift(int *ac, char ***av)
 int parse_cmdline_opts(int argc, char **argv, Args *args)
 {
     char *command = shift(&argc, &argv);
-    if (!argc) {
-        usage(command, "ERROR: no files provided\n");
+    args->engine = &engines[0];
+    args->threads = 1;
+    args->timer = TIMER_TSC;
+    args->stats_interval = 1;
+    args->options.fill_factor = LC_DEFAULT_FILL_FACTOR;
+    args->options.root_branch = LC_DEFAULT_ROOT_BRANCH;
+    while (argc && argv[0][0] == '-') {
+        char *flag = shift(&argc, &argv);
+        if (strlen(flag) != 2 || !strchr("efrbjPutoqcsanCKSiI6TF", flag[1])) {
+            usage(command, "ERROR: unknown option\n");
+            return -1;
+        }
+        if (flag[1] == 'q') {  // The options without value
+            args->quiet = 1;
+            continue;
+        }
+        if (flag[1] == 'a') {
+            args->aggregate = 1;
+            continue;
+        }
+        if (flag[1] == '6') {
+            args->ipv6 = 1;
+            continue;
+        }
+        if (!argc) {
+            usage(command, "ERROR: option without value\n");
+            return -1;
+        }
+        char *value = shift(&argc, &argv);
+        switch (flag[1]) {
+        case 'e':
+            args->engine = find_engine(value);
+            if (!args->engine) {
+                usage(command, "ERROR: unknown engine\n");
+                return -1;
+            }
+            args->engine_chosen = 1;
+            break;
+        case 'f':
+            args->options.fill_factor = atof(value);
+            if (args->options.fill_factor <= 0 || args->options.fill_factor > 1) {
+                usage(command, "ERROR: the fill factor must be in (0, 1]\n");
+                return -1;
+            }
+            break;
+        case 'r':
+            args->options.root_branch = atoi(value);
+            if (args->options.root_branch < 0 || args->options.root_branch > LC_MAX_BRANCH) {
+                usage(command, "ERROR: invalid root branching factor\n");
+                return -1;
+            }
+            break;
+        case 'b':
+            args->batch_size = atoi(value);
+            if (args->batch_size < 0) {
+                usage(command, "ERROR: invalid batch size\n");
+                return -1;
+            }
+            break;
+        case 'j':
+            args->threads = atoi(value);
+            if (args->threads < 1) {
+                usage(command, "ERROR: invalid number of threads\n");
+                return -1;
+            }
+            break;
+        case 'P':
+            args->build_threads = atoi(value);
+            if (args->build_threads < 1) {
+                usage(command, "ERROR: invalid number of build threads\n");
+                return -1;
+            }
+            break;
+        case 'u':
+            args->update_file = value;
+            break;
+        case 'c':
+            args->compile_file = value;
+            break;
+        case 's':
+            args->snapshot_file = value;
+            break;
+        case 'n':
+            args->nexthop_file = value;
+            break;
+        case 'C':
+            if (atol(value) <= 0) {
+                usage(command, "ERROR: invalid cache size\n");
+                return -1;
+            }
+            args->cache_entries = atol(value);
+            break;
+        case 'K':
+            if (!strcmp(value, "ip")) args->cache_key = CACHE_KEY_IP;
+            else if (!strcmp(value, "24")) args->cache_key = CACHE_KEY_24;
+            else {
+                usage(command, "ERROR: unknown cache key\n");
+                return -1;
+            }
+            break;
+        case 'S':
+            args->stream_source = value;
+            break;
+        case 'i':
+            if (!strcmp(value, "text")) args->stream_format = STREAM_TEXT;
+            else if (!strcmp(value, "binary")) args->stream_format = STREAM_BINARY;
+            else {
+                usage(command, "ERROR: unknown stream format\n");
+                return -1;
+            }
+            break;
+        case 'I':
+            args->stats_interval = atof(value);
+            if (args->stats_interval < 0) {
+                usage(command, "ERROR: invalid stats interval\n");
+                return -1;
+            }
+            break;
+        case 'T':
+            args->stats_file = value;
+            break;
+        case 'F':
+            if (!strcmp(value, "json")) args->stats_format = STATS_JSON;
+            else if (!strcmp(value, "prometheus")) args->stats_format = STATS_PROMETHEUS;
+            else {
+                usage(command, "ERROR: unknown stats format\n");
+                return -1;
+            }
+            break;
+        case 't':
+            if (!strcmp(value, "tsc")) args->timer = TIMER_TSC;
+            else if (!strcmp(value, "clock")) args->timer = TIMER_CLOCK;
+            else {
+                usage(command, "ERROR: unknown timer\n");
+                return -1;
+            }
+            break;
+        case 'o':
+            if (!strcmp(value, "text")) args->output_format = OUTPUT_TEXT;
+            else if (!strcmp(value, "binary")) args->output_format = OUTPUT_BINARY;
+            else {
+                usage(command, "ERROR: unknown output format\n");
+                return -1;
+            }
+            break;
+        }
+    }
+    if (args->update_file) {
+        /* Only the RCU trie can be updated while it is looked up */
+        if (!args->engine_chosen)
+            args->engine = find_engine("rcu");
+        if (args->engine != find_engine("rcu")) {
+            usage(command, "ERROR: route updates need the rcu engine\n");
+            return -1;
+        }
+        if (args->aggregate) {
+            /* The aggregated trie lost the routes ORTC merged, the updates would not find them */
+            usage(command, "ERROR: -a cannot be used with -u\n");
+            return -1;
+        }
+    }
+    if (args->compile_file) {
+        /* Only the engines without pointers can be compiled */
+        if (!args->engine_chosen)
+            args->engine = find_engine("lc");
+        if (!args->engine->save) {
+            usage(command, "ERROR: this engine cannot be compiled\n");
+            return -1;
+        }
+        if (args->snapshot_file || args->update_file) {
+            usage(command, "ERROR: -c cannot be used with -s or -u\n");
+            return -1;
+        }
+    }
+    if (args->ipv6) {
+        if (args->update_file || args->compile_file || args->snapshot_file || args->stream_source ||
+            args->aggregate || args->nexthop_file || args->cache_entries || args->batch_size || args->threads > 1 ||
+            args->build_threads || args->stats_file ||
+            args->output_format != OUTPUT_TEXT) {
+            usage(command, "ERROR: -6 only takes -e, -t and -q\n");
+            return -1;
+        }
+        if (!find_engine6(args->engine->name)) {
+            usage(command, "ERROR: this engine has no IPv6 version\n");
+            return -1;
+        }
+    }
+    if (args->stream_source && (args->update_file || args->compile_file)) {
+        usage(command, "ERROR: -S cannot be used with -u or -c\n");
+        return -1;
+    }
+    if (args->stream_source && args->threads > 1) {
+        /* The destinations are answered in order, in the calling thread */
+        usage(command, "ERROR: -S cannot be used with -j\n");
+        return -1;
+    }
+    if (args->stats_file && (args->update_file || args->snapshot_file || args->stream_source || args->compile_file)) {
+        /* The statistics need the trie, as it was built */
+        usage(command, "ERROR: -T cannot be used with -u, -s, -S or -c\n");
+        return -1;
+    }
+    if (args->cache_key == CACHE_KEY_24 && (args->update_file || args->snapshot_file)) {
+        /* The /24s that cannot be cached are found in the trie, once */
+        usage(command, "ERROR: -K 24 cannot be used with -u or -s\n");
         return -1;
     }
-    args->fib_file = shift(&argc, &argv);
+    if (args->snapshot_file) {
+        if (args->update_file) {
+            usage(command, "ERROR: a snapshot cannot be updated\n");
+            return -1;
+        }
+        if (args->aggregate || args->nexthop_file || args->build_threads) {
+            usage(command, "ERROR: -a, -n and -P are given when the snapshot is compiled\n");
+            return -1;
+        }
+        /* The FIB is the snapshot, only the input packet file is given */
+        args->fib_file = args->snapshot_file;
+    } else {
+        if (!argc) {
+            usage(command, "ERROR: no files provided\n");
+            return -1;
+        }
+        args->fib_file = shift(&argc, &argv);
+    }
+    if (args->compile_file || args->stream_source)
+        return 0;
     if (!argc) {
         usage(command, "ERROR: no input packet file provided\n");
         return -1;
@@ -46,11 +314,415 @@ int parse_cmdline_opts(int argc, char **argv, Args *args)
     return 0;
 }
 
+typedef struct {
+    RcuTrie *trie;
+    const RouteUpdate *updates;
+    size_t count;
+    int applied;
+    int rejected;
+} UpdateStream;
+
+/* Writer thread: apply the route updates while the lookups go on */
+void *apply_updates(void *arg)
+{
+    UpdateStream *stream = arg;
+    for (size_t i = 0; i < stream->count; ++i) {
+        const FibEntry *route = &stream->updates[i].entry;
+        int result = 0;
+        switch (stream->updates[i].op) {
+        case ROUTE_ADD:
+            result = route_add(stream->trie, route->prefix, route->prefix_length, route->out_iface);
+            break;
+        case ROUTE_DEL:
+            result = route_del(stream->trie, route->prefix, route->prefix_length);
+            break;
+        case ROUTE_MODIFY:
+            result = route_modify(stream->trie, route->prefix, route->prefix_length, route->out_iface);
+            break;
+        }
+        if (result < 0) stream->rejected += 1;
+        else stream->applied += 1;
+    }
+    return NULL;
+}
+
+/**********************************************************************
+ * Look up the IPs in blocks of RESULT_BLOCK, handing every block to the
+ * result writer as soon as it is done, so the results are written while
+ * the next block is looked up. The blocks are looked up by the same pool
+ * of threads. The next hop indexes of the block are translated to
+ * interfaces first. The accumulators of every block are added up in
+ * `lookups`. Returns 0, or -1 if a thread could not be created.
+ **********************************************************************/
+#define RESULT_BLOCK 65536
+int run_blocks(LookupChunk *lookups, int threads, const NextHopTable *nexthops,
+               ResultWriter *results)
+{
+    if ((size_t)threads > lookups->count) threads = lookups->count ? lookups->count : 1;
+    LookupPool *pool = lookup_pool_create(threads);
+    if (!pool)
+        return -1;
+    LookupChunk block = *lookups;
+    lookups->total_accesses = 0;
+    lookups->total_time = 0;
+    lookups->processed_packets = 0;
+    histogram_reset(&lookups->latencies);
+    for (size_t first = 0; first < lookups->count; first += RESULT_BLOCK) {
+        block.ips = lookups->ips + first;
+        block.count = lookups->count - first < RESULT_BLOCK ? lookups->count - first : RESULT_BLOCK;
+        block.ifaces = lookups->ifaces + first;
+        block.accesses = lookups->accesses + first;
+        block.times = lookups->times + first;
+        lookup_pool_run(pool, &block);
+        lookups->total_accesses += block.total_accesses;
+        lookups->total_time += block.total_time;
+        lookups->processed_packets += block.processed_packets;
+        histogram_merge(&lookups->latencies, &block.latencies);
+        nexthop_translate(nexthops, block.ifaces, block.count);
+        writer_submit(results, first + block.count);
+    }
+    lookup_pool_destroy(pool);
+    return 0;
+}
+
+double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/**********************************************************************
+ * Load the next hops of the FIB and their metadata into the table, and
+ * replace the interfaces of the FIB by their indexes. Only the engines
+ * with 16-bit next hops, the aggregation (-a) and the metadata (-n) use
+ * the table. Otherwise, or if an engine with 16-bit next hops gets too
+ * many of them (it rejects the FIB itself), the table is left empty
+ * and the FIB keeps its interfaces.
+ * Returns 0, or -1 on error (already reported).
+ **********************************************************************/
+int load_nexthop_table(const Args *args, Fib *fib, NextHopTable *nexthops)
+{
+    nexthop_init(nexthops);
+    if (!args->aggregate && !args->nexthop_file) {
+        if (!args->engine->narrow_nexthops ||
+            nexthop_intern_all(nexthops, &fib->entries[0].out_iface, fib->size, sizeof(FibEntry)) < 0) {
+            nexthop_free(nexthops);
+            return 0;
+        }
+    }
+    if (nexthop_compress(nexthops, &fib->entries[0].out_iface, fib->size, sizeof(FibEntry)) < 0)
+        return -1;
+    if (!args->nexthop_file)
+        return 0;
+    NextHop *metadata;
+    size_t count;
+    int result = load_nexthops(args->nexthop_file, &metadata, &count);
+    if (result < 0) {
+        printIOExplanationError(result);
+        return -1;
+    }
+    for (size_t i = 0; i < count && result == 0; ++i)
+        result = nexthop_set(nexthops, &metadata[i]);
+    free(metadata);
+    if (result < 0)
+        fprintf(stderr, "ERROR: more than %d distinct next hops\n", NEXTHOP_MAX);
+    return result;
+}
+
+/**********************************************************************
+ * Load the FIB, build and compress the Patricia trie (aggregated with
+ * -a), and build the lookup structure of the engine from it. The trie
+ * is released (and `*root` set to NULL) once the structure is built,
+ * unless the engine keeps it, -K 24 or -T still walk it, or a DEBUG
+ * build dumps it.
+ * Returns the structure, or NULL on error (already reported).
+ **********************************************************************/
+void *build_table(const Args *args, Node **root, NextHopTable *nexthops)
+{
+    Fib fib;
+    int result = load_fib(args->fib_file, &fib);
+    if (result < 0) {
+        printIOExplanationError(result);
+        return NULL;
+    }
+    if (load_nexthop_table(args, &fib, nexthops) < 0) {
+        fib_free(&fib);
+        return NULL;
+    }
+    /* The aggregation needs the trie uncompressed */
+    if (args->build_threads)
+        *root = create_trie_parallel(fib.entries, fib.size, args->build_threads, !args->aggregate);
+    else if (args->aggregate)
+        *root = create_trie_from_fib(fib.entries, fib.size);
+    else
+        *root = create_compressed_trie_from_fib(fib.entries, fib.size);
+    fib_free(&fib);
+    if (!*root)
+        return NULL;
+
+#ifdef DEBUG
+    /* Only -a builds the trie uncompressed; main dumps the compressed one */
+    if (args->aggregate && output_graphviz("out_uncompressed.gv", *root) < 0)
+        return NULL;
+#endif
+
+    if (args->aggregate)
+        *root = compress_trie(aggregate_trie(*root));
+    void *table = args->engine->build(*root, &args->options);
+
+#ifndef DEBUG
+    int needs_trie = args->engine->keeps_trie || args->stats_file ||
+                     (args->cache_entries && args->cache_key == CACHE_KEY_24);
+    if (table && !needs_trie) {
+        node_pool_destroy();
+        *root = NULL;
+    }
+#endif
+    return table;
+}
+
+/**********************************************************************
+ * Compile mode: build the lookup structure and write it to a snapshot
+ * that later runs map with -s.
+ **********************************************************************/
+int compile(const Args *args)
+{
+    Node *root = NULL;
+    NextHopTable nexthops = {0};
+    void *table = build_table(args, &root, &nexthops);
+    if (!table) {
+        nexthop_free(&nexthops);
+        node_pool_destroy();
+        return 1;
+    }
+    int result = snapshot_save(args->compile_file, args->engine, table, &nexthops);
+    if (result < 0)
+        printIOExplanationError(result);
+    else
+        printf("FIB compiled to %s with the %s engine\n", args->compile_file, args->engine->name);
+    args->engine->destroy(table);
+    nexthop_free(&nexthops);
+    node_pool_destroy();
+    return result < 0;
+}
+
+/**********************************************************************
+ * Map a snapshot, and use its lookup structure as it is.
+ * Returns the structure, or NULL on error (already reported).
+ **********************************************************************/
+void *attach_table(Args *args, Snapshot *snapshot, NextHopTable *nexthops)
+{
+    int result = snapshot_open(args->snapshot_file, snapshot);
+    if (result < 0) {
+        printIOExplanationError(result);
+        return NULL;
+    }
+    if (nexthop_attach(nexthops, snapshot->nexthops.data, snapshot->nexthops.size / sizeof(NextHop)) < 0) {
+        printIOExplanationError(BAD_SNAPSHOT);
+        snapshot_close(snapshot);
+        return NULL;
+    }
+    if (args->engine_chosen && args->engine != snapshot->engine) {
+        fprintf(stderr, "ERROR: the snapshot was compiled with the %s engine\n", snapshot->engine->name);
+        snapshot_close(snapshot);
+        return NULL;
+    }
+    args->engine = snapshot->engine;
+    void *table = args->engine->attach(snapshot->sections, snapshot->section_count);
+    if (!table) {
+        printIOExplanationError(BAD_SNAPSHOT);
+        snapshot_close(snapshot);
+    }
+    return table;
+}
+
+/* Free a lookup structure, built or attached to a snapshot */
+void destroy_table(const Engine *engine, void *table, Snapshot *snapshot)
+{
+    if (snapshot->map) {
+        free(table);
+        snapshot_close(snapshot);
+    } else {
+        engine->destroy(table);
+    }
+}
+
+/**********************************************************************
+ * Create the front caches of the -C option, one per thread.
+ * Returns them, or NULL if there is no cache.
+ **********************************************************************/
+FrontCache *create_caches(const Args *args, void *table, Node *root)
+{
+    if (!args->cache_entries)
+        return NULL;
+    FrontCache *caches = malloc(args->threads * sizeof(FrontCache));
+    if (!caches) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    /* Only the RCU trie changes, and says when */
+    const _Atomic uint32_t *generation = args->engine == find_engine("rcu") ? &((RcuTrie *)table)->generation
+                                                                           : NULL;
+    for (int t = 0; t < args->threads; ++t)
+        cache_init(&caches[t], args->cache_entries, args->cache_key, root, generation);
+    return caches;
+}
+
+void destroy_caches(const Args *args, FrontCache *caches)
+{
+    for (int t = 0; caches && t < args->threads; ++t)
+        cache_free(&caches[t]);
+    free(caches);
+}
+
+/**********************************************************************
+ * Stream mode: build the lookup structure (or map the snapshot), and
+ * answer the destinations of the -S source as they come, printing the
+ * interval stats on stderr. Lookups run in the calling thread.
+ **********************************************************************/
+int serve_stream(Args *args)
+{
+    Node *root = NULL;
+    Snapshot snapshot = {0};
+    NextHopTable nexthops = {0};
+    void *table = args->snapshot_file ? attach_table(args, &snapshot, &nexthops)
+                                      : build_table(args, &root, &nexthops);
+    if (!table) {
+        nexthop_free(&nexthops);
+        node_pool_destroy();
+        return 1;
+    }
+    timer_init(args->timer);
+    FrontCache *caches = create_caches(args, table, root);
+    LookupStream stream = {
+        .lookups = {
+            .engine = args->engine,
+            .table = table,
+            .batch_size = args->batch_size,
+            .cache = caches,
+        },
+        .nexthops = &nexthops,
+        .input_format = args->stream_format,
+        .output_format = args->output_format,
+        .interval = args->stats_interval,
+    };
+    int result = stream_run(&stream, args->stream_source);
+    if (caches) {
+        fprintf(stderr, "Cache hits= %lu, misses= %lu, evictions= %lu\n",
+                (unsigned long)caches->hits, (unsigned long)caches->misses,
+                (unsigned long)caches->evictions);
+    }
+    destroy_caches(args, caches);
+    destroy_table(args->engine, table, &snapshot);
+    nexthop_free(&nexthops);
+    node_pool_destroy();
+    return result < 0;
+}
+
+/**********************************************************************
+ * IPv6 mode: the same run as the IPv4 one over 128-bit addresses, with
+ * the IPv6 version of the engine. The lookups are timed one by one in
+ * the calling thread.
+ **********************************************************************/
+int lookup_ipv6(const Args *args)
+{
+    const Engine6 *engine = find_engine6(args->engine->name);
+    int result = initializeIO(args->fib_file, args->input_packet_file);
+    if (result < 0) {
+        printIOExplanationError(result);
+        return 1;
+    }
+    struct timespec build_start, build_end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &build_start);
+    Fib6 fib;
+    NextHopTable nexthops = {0};
+    result = load_fib6(args->fib_file, &fib);
+    if (result < 0) {
+        printIOExplanationError(result);
+        freeIO();
+        return 1;
+    }
+    /* Next hop indexes in the tries, like in IPv4 */
+    nexthop_init(&nexthops);
+    if (nexthop_compress(&nexthops, &fib.entries[0].out_iface, fib.size, sizeof(Fib6Entry)) < 0) {
+        free(fib.entries);
+        nexthop_free(&nexthops);
+        freeIO();
+        return 1;
+    }
+    Node6 *root = create_trie6_from_fib(fib.entries, fib.size);
+    free(fib.entries);
+    void *table = engine->build(root);
+    if (!table) {
+        nexthop_free(&nexthops);
+        node6_pool_destroy();
+        freeIO();
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &build_end);
+    double build_time = elapsed_ns(&build_start, &build_end);
+    long build_memory = getPeakMemory();
+
+    Ip6 *ips;
+    size_t ip_count;
+    result = load_trace6(args->input_packet_file, &ips, &ip_count);
+    int return_value = 0;
+    if (result < 0) {
+        printIOExplanationError(result);
+        return_value = 1;
+        ip_count = 0;
+        ips = NULL;
+    }
+    timer_init(args->timer);
+    Histogram *latencies = malloc(sizeof(Histogram));
+    if (!latencies) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    histogram_reset(latencies);
+    double total_accesses = 0, total_time = 0;
+    for (size_t i = 0; i < ip_count; ++i) {
+        int accesses = 0;
+        uint64_t start = timer_now();
+        int out_iface = engine->lookup(table, ips[i], &accesses);
+        uint64_t end = timer_now();
+        double time = timer_elapsed_ns(start, end);
+        char address[IP6_ADDRESS_SIZE];
+        printResultLine6(ip6_format(ips[i], address), nexthop_iface(&nexthops, out_iface), time,
+                         accesses, args->quiet);
+        total_accesses += accesses;
+        total_time += time;
+        histogram_record(latencies, time);
+    }
+    if (!return_value) {
+        printSummary(engine->node_count(table), ip_count, ip_count ? total_accesses / ip_count : 0,
+                     ip_count ? total_time / ip_count : 0);
+        printLatencySummary(timer_source == TIMER_TSC ? "tsc" : "clock",
+                            histogram_percentile(latencies, 0.50),
+                            histogram_percentile(latencies, 0.99),
+                            histogram_percentile(latencies, 0.999), latencies->max);
+        printBuildSummary(build_time, build_memory);
+        printNextHopSummary(nexthops.size - 1);
+    }
+    free(latencies);
+    free(ips);
+    engine->destroy(table);
+    nexthop_free(&nexthops);
+    node6_pool_destroy();
+    freeIO();
+    return return_value;
+}
+
 int main(int argc, char *argv[])
 {
     Args args = {0};
     if (parse_cmdline_opts(argc, argv, &args) < 0)
         return 1;
+    if (args.compile_file)
+        return compile(&args);
+    if (args.stream_source)
+        return serve_stream(&args);
+    if (args.ipv6)
+        return lookup_ipv6(&args);
     char *routing_file_path = args.fib_file;
     char *input_file = args.input_packet_file;
     int result = initializeIO(routing_file_path, input_file);
@@ -58,45 +730,125 @@ int main(int argc, char *argv[])
         printIOExplanationError(result);
         return 1;
     }
-    Node *root = create_trie();
-    if (!root) {
-        free_nodes(root);
+    struct timespec build_start, build_end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &build_start);
+    Node *root = NULL;
+    Snapshot snapshot = {0};
+    NextHopTable nexthops = {0};
+    void *table = args.snapshot_file ? attach_table(&args, &snapshot, &nexthops)
+                                     : build_table(&args, &root, &nexthops);
+    if (!table) {
+        nexthop_free(&nexthops);
+        node_pool_destroy();
         freeIO();
         return 1;
     }
-
-#ifdef DEBUG
-    if (output_graphviz("out_uncompressed.gv", root) < 0) {
-        free_nodes(root);
+    const Engine *engine = args.engine;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &build_end);
+    double build_time = elapsed_ns(&build_start, &build_end);
+    long build_memory = getPeakMemory();
+    uint32_t *ips;
+    size_t ip_count;
+    result = load_trace(input_file, &ips, &ip_count);
+    if (result < 0) {
+        printIOExplanationError(result);
+        destroy_table(engine, table, &snapshot);
+        nexthop_free(&nexthops);
+        node_pool_destroy();
         freeIO();
         return 1;
     }
-#endif
-
-    root = compress_trie(root);
-    uint32_t ip;
-    int iface, accesses;
-    int processed_packets = 0;
-    double total_accesses = 0;
-    double total_time = 0;
-    double searching_time = 0.0;
-    struct timespec start, end;
-
 
-    while (readInputPacketFileLine(&ip) == OK) {
-        accesses = 0;
-
-        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
-        iface = lookup(root, ip, &accesses);
-        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-
-        printOutputLine(ip, iface, &start, &end, &searching_time, accesses);
-
-        total_accesses += accesses;
-        total_time += searching_time;
-        processed_packets++;
+    /* Falls back to the clock if the CPU has no invariant TSC */
+    timer_init(args.timer);
+    size_t room = ip_count ? ip_count : 1;
+    int *ifaces = malloc(room * sizeof(int));
+    int *accesses = malloc(room * sizeof(int));
+    double *times = malloc(room * sizeof(double));
+    if (!ifaces || !accesses || !times) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    LookupChunk lookups = {
+        .engine = engine,
+        .table = table,
+        .ips = ips,
+        .count = ip_count,
+        .batch_size = args.batch_size,
+        .ifaces = ifaces,
+        .accesses = accesses,
+        .times = times,
+    };
+    FrontCache *caches = create_caches(&args, table, root);
+    lookups.cache = caches;
+    int return_value = 0;
+    UpdateStream stream = { .trie = table };
+    pthread_t writer;
+    int writing = 0;
+    if (args.update_file) {
+        RouteUpdate *updates;
+        result = load_updates(args.update_file, &updates, &stream.count);
+        if (result < 0) {
+            printIOExplanationError(result);
+            return_value = 1;
+        } else if (nexthops.size && nexthop_compress(&nexthops, &updates[0].entry.out_iface, stream.count,
+                                                     sizeof(RouteUpdate)) < 0) {
+            free(updates);
+            return_value = 1;
+        } else {
+            stream.updates = updates;
+            writing = !pthread_create(&writer, NULL, apply_updates, &stream);
+            if (!writing) {
+                fprintf(stderr, "ERROR: could not create update thread\n");
+                return_value = 1;
+            }
+        }
+    }
+    /* Text results go to the .out file, binary ones to their own .bin file */
+    int result_fd = getOutputFileDescriptor();
+    char *binary_file = NULL;
+    if (!return_value && args.output_format == OUTPUT_BINARY) {
+        binary_file = malloc(strlen(input_file) + sizeof(BINARY_OUTPUT_NAME));
+        if (!binary_file) {
+            fprintf(stderr, "Buy more RAM lol\n");
+            exit(1);
+        }
+        sprintf(binary_file, "%s%s", input_file, BINARY_OUTPUT_NAME);
+        result_fd = open(binary_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (result_fd < 0) {
+            printIOExplanationError(CANNOT_CREATE_OUTPUT);
+            return_value = 1;
+        }
+    }
+    ResultWriter *results = NULL;
+    if (!return_value) {
+        fflush(stdout);
+        results = writer_create(result_fd, args.quiet ? -1 : STDOUT_FILENO, args.output_format,
+                                ips, ifaces, accesses, times);
+        if (!results) {
+            fprintf(stderr, "ERROR: could not create writer thread\n");
+            return_value = 1;
+        }
+    }
+    if (!return_value && run_blocks(&lookups, args.threads, &nexthops, results) < 0)
+        return_value = 1;
+    if (results && writer_close(results) < 0) {
+        fprintf(stderr, "ERROR: could not write the results\n");
+        return_value = 1;
+    }
+    if (binary_file) {
+        if (result_fd >= 0) close(result_fd);
+        free(binary_file);
+    }
+    if (writing) {
+        pthread_join(writer, NULL);
+        rcu_reclaim(table, 1);
     }
 
+    int processed_packets = lookups.processed_packets;
+    double total_accesses = lookups.total_accesses;
+    double total_time = lookups.total_time;
+
     //Estadísticas finales
     double average_accesses = 0;
     double average_time = 0;
@@ -105,17 +857,56 @@ int main(int argc, char *argv[])
         average_accesses = total_accesses / processed_packets;
         average_time = total_time / processed_packets;
     }
-    printSummary(node_count, processed_packets, average_accesses, average_time);
+    printSummary(engine->node_count(table), processed_packets, average_accesses, average_time);
+    printLatencySummary(timer_source == TIMER_TSC ? "tsc" : "clock",
+                        histogram_percentile(&lookups.latencies, 0.50),
+                        histogram_percentile(&lookups.latencies, 0.99),
+                        histogram_percentile(&lookups.latencies, 0.999),
+                        lookups.latencies.max);
+    printBuildSummary(build_time, build_memory);
+    if (nexthops.size)
+        printNextHopSummary(nexthops.size - 1);
+    if (caches) {
+        long hits = 0, misses = 0, evictions = 0;
+        for (int t = 0; t < args.threads; ++t) {
+            hits += caches[t].hits;
+            misses += caches[t].misses;
+            evictions += caches[t].evictions;
+        }
+        printCacheSummary(hits, misses, evictions);
+    }
+    if (args.update_file)
+        printUpdateSummary(stream.applied, stream.rejected);
+    if (!return_value && args.stats_file) {
+        TrieStats stats = {0};
+        stats_trie(&stats, root);
+        stats_engines(&stats, root, &args.options);
+        stats_accesses(&stats, accesses, ip_count);
+        stats_hot_nodes(&stats, root, ips, ip_count, &nexthops);
+        result = stats_export(&stats, args.stats_file, args.stats_format);
+        stats_free(&stats);
+        if (result < 0) {
+            printIOExplanationError(result);
+            return_value = 1;
+        }
+    }
 
 
-    int return_value = 0;
 #ifdef DEBUG
-    if (output_graphviz("out_compressed.gv", root) < 0)
+    if (root && output_graphviz("out_compressed.gv", root) < 0)
         return_value = 1;
 #endif
 
 
-    free_nodes(root);
+    free((RouteUpdate *)stream.updates);
+    free(ips);
+    free(ifaces);
+    free(accesses);
+    free(times);
+    destroy_caches(&args, caches);
+    destroy_table(engine, table, &snapshot);
+    nexthop_free(&nexthops);
+    node_pool_destroy();
     freeIO();
     return return_value;
 }
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "nexthop.h"
+#include "node.h"
+
+#define FIRST_CAPACITY 64
+#define EMPTY_SLOT 0  // NO_IFACE is never hashed
+
+static void *nexthop_realloc(void *ptr, size_t size)
+{
+    void *new = realloc(ptr, size);
+    if (!new) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return new;
+}
+
+static uint32_t hash_iface(int out_iface)
+{
+    return (uint32_t)out_iface * 2654435761U;
+}
+
+/* Rebuild the hash with twice as many slots as next hops, at least */
+static void rehash(NextHopTable *table, int slot_count)
+{
+    free(table->slots);
+    table->slots = calloc(slot_count, sizeof(uint16_t));
+    if (!table->slots) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    table->slot_count = slot_count;
+    for (int index = 1; index < table->size; ++index) {
+        uint32_t slot = hash_iface(table->entries[index].out_iface) & (slot_count - 1);
+        while (table->slots[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & (slot_count - 1);
+        table->slots[slot] = index;
+    }
+}
+
+/**********************************************************************
+ * Create a table with NO_IFACE only.
+ **********************************************************************/
+void nexthop_init(NextHopTable *table)
+{
+    *table = (NextHopTable) {
+        .entries = nexthop_realloc(NULL, FIRST_CAPACITY * sizeof(NextHop)),
+        .size = 1,
+        .capacity = FIRST_CAPACITY,
+    };
+    table->entries[0] = (NextHop) { .out_iface = NO_IFACE };
+    rehash(table, 2 * FIRST_CAPACITY);
+}
+
+/**********************************************************************
+ * Index of an interface, added to the table if it is new.
+ **********************************************************************/
+int nexthop_intern(NextHopTable *table, int out_iface)
+{
+    if (out_iface == NO_IFACE)
+        return 0;
+    uint32_t slot = hash_iface(out_iface) & (table->slot_count - 1);
+    while (table->slots[slot] != EMPTY_SLOT) {
+        if (table->entries[table->slots[slot]].out_iface == out_iface)
+            return table->slots[slot];
+        slot = (slot + 1) & (table->slot_count - 1);
+    }
+    if (table->size > NEXTHOP_MAX)
+        return -1;
+
+    int index = table->size++;
+    if (index == table->capacity) {
+        table->capacity *= 2;
+        table->entries = nexthop_realloc(table->entries, table->capacity * sizeof(NextHop));
+    }
+    table->entries[index] = (NextHop) { .out_iface = out_iface };
+    table->slots[slot] = index;
+    if (2 * table->size > table->slot_count)
+        rehash(table, 2 * table->slot_count);
+    return index;
+}
+
+/**********************************************************************
+ * Add the interfaces of `count` entries to the table.
+ **********************************************************************/
+int nexthop_intern_all(NextHopTable *table, const int *out_ifaces, size_t count, size_t stride)
+{
+    for (size_t i = 0; i < count; ++i)
+        if (nexthop_intern(table, *(const int *)((const char *)out_ifaces + i * stride)) < 0)
+            return -1;
+    return 0;
+}
+
+/**********************************************************************
+ * Replace the interfaces of `count` entries by their indexes. They are
+ * all interned first, so nothing changes if there are too many.
+ **********************************************************************/
+int nexthop_compress(NextHopTable *table, int *out_ifaces, size_t count, size_t stride)
+{
+    if (nexthop_intern_all(table, out_ifaces, count, stride) < 0) {
+        fprintf(stderr, "ERROR: more than %d distinct next hops\n", NEXTHOP_MAX);
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        int *out_iface = (int *)((char *)out_ifaces + i * stride);
+        *out_iface = nexthop_intern(table, *out_iface);
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Set the gateway and the MAC of an interface.
+ **********************************************************************/
+int nexthop_set(NextHopTable *table, const NextHop *next_hop)
+{
+    int index = nexthop_intern(table, next_hop->out_iface);
+    if (index < 0)
+        return -1;
+    if (index != 0)
+        table->entries[index] = *next_hop;
+    return 0;
+}
+
+/**********************************************************************
+ * Replace `n` indexes by their interfaces.
+ **********************************************************************/
+void nexthop_translate(const NextHopTable *table, int *ifaces, size_t n)
+{
+    if (!table->size)
+        return;  // No table, they are the interfaces
+    for (size_t i = 0; i < n; ++i)
+        ifaces[i] = (unsigned)ifaces[i] < (unsigned)table->size ? table->entries[ifaces[i]].out_iface
+                                                                : NO_IFACE;
+}
+
+/**********************************************************************
+ * Use next hops stored elsewhere as a table.
+ **********************************************************************/
+int nexthop_attach(NextHopTable *table, const NextHop *entries, size_t count)
+{
+    if (!count) {
+        *table = (NextHopTable) {0};
+        return 0;
+    }
+    if (count > (size_t)NEXTHOP_MAX + 1 || entries[0].out_iface != NO_IFACE)
+        return -1;
+    *table = (NextHopTable) {
+        .entries = (NextHop *)entries,  // Only read
+        .size = count,
+    };
+    return 0;
+}
+
+/**********************************************************************
+ * Free the table.
+ **********************************************************************/
+void nexthop_free(NextHopTable *table)
+{
+    if (table->slots) {
+        free(table->entries);
+        free(table->slots);
+    }
+    *table = (NextHopTable) {0};
+}
@@ -0,0 +1,107 @@
+#ifndef NEXTHOP_H
+#define NEXTHOP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NEXTHOP_MAX UINT16_MAX  // Indexes fit in 16 bits, 0 is NO_IFACE
+
+/**********************************************************************
+ * NEXT HOP
+ * Fields:
+ *  - out_iface: the output interface, as written in the FIB.
+ *  - gateway: IP of the next router, 0 if the network is directly
+ *  connected.
+ *  - mac: MAC address of the gateway, if has_mac is set.
+ **********************************************************************/
+typedef struct {
+    int32_t out_iface;
+    uint32_t gateway;
+    uint8_t mac[6];
+    uint8_t has_mac;
+    uint8_t reserved;
+} NextHop;
+
+/**********************************************************************
+ * NEXT HOP TABLE
+ * The distinct next hops of the FIB. The tries store the index of the
+ * next hop instead of the interface, and the results are translated
+ * back before they are written. Index 0 is NO_IFACE. An empty table
+ * (size 0, e.g. after `nexthop_free`) stands for no table at all: the
+ * tries store the interfaces, and the translation leaves them as they
+ * are.
+ * Fields:
+ *  - entries: the next hops, by index.
+ *  - size, capacity: next hops in use (NO_IFACE included)/allocated.
+ *  - slots, slot_count: open-addressing hash of the interfaces, to
+ *  find their indexes. NULL in a table attached to a snapshot, which
+ *  can only translate.
+ **********************************************************************/
+typedef struct {
+    NextHop *entries;
+    int size;
+    int capacity;
+    uint16_t *slots;
+    int slot_count;
+} NextHopTable;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create a table with NO_IFACE only.
+ **********************************************************************/
+void nexthop_init(NextHopTable *table);
+
+/**********************************************************************
+ * Index of an interface, added to the table if it is new.
+ * Returns -1 if the table is full (NEXTHOP_MAX next hops).
+ **********************************************************************/
+int nexthop_intern(NextHopTable *table, int out_iface);
+
+/**********************************************************************
+ * Add the interfaces of `count` entries, `stride` bytes apart, to the
+ * table, without changing them.
+ * Returns 0, or -1 if there are too many distinct next hops.
+ **********************************************************************/
+int nexthop_intern_all(NextHopTable *table, const int *out_ifaces, size_t count, size_t stride);
+
+/**********************************************************************
+ * Replace the interfaces of `count` entries, `stride` bytes apart, by
+ * their indexes. If there are too many, the entries are not changed.
+ * Returns 0, or -1 if there are too many distinct next hops.
+ * THIS FUNCTION PRODUCES LOGS.
+ **********************************************************************/
+int nexthop_compress(NextHopTable *table, int *out_ifaces, size_t count, size_t stride);
+
+/**********************************************************************
+ * Set the gateway and the MAC of an interface (e.g. from `load_nexthops`).
+ * Returns 0, or -1 if the table is full.
+ **********************************************************************/
+int nexthop_set(NextHopTable *table, const NextHop *next_hop);
+
+/**********************************************************************
+ * Interface of an index.
+ **********************************************************************/
+static inline int nexthop_iface(const NextHopTable *table, int index)
+{
+    return table->size ? table->entries[index].out_iface : index;
+}
+
+/**********************************************************************
+ * Replace `n` indexes by their interfaces.
+ **********************************************************************/
+void nexthop_translate(const NextHopTable *table, int *ifaces, size_t n);
+
+/**********************************************************************
+ * Use `count` next hops stored elsewhere (e.g. in a snapshot) as a
+ * table. It can translate, but not intern. No next hops give an empty
+ * table.
+ * Returns 0, or -1 if they are not valid.
+ **********************************************************************/
+int nexthop_attach(NextHopTable *table, const NextHop *entries, size_t count);
+
+/**********************************************************************
+ * Free the table (nothing to free if it is attached).
+ **********************************************************************/
+void nexthop_free(NextHopTable *table);
+
+#endif // NEXTHOP_H
@@ -1,8 +1,25 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <fcntl.h>
+#include <unistd.h>
 #include "node.h"
 #include "io.h"
 #include "utils.h"
+#include "export.h"
 
-int node_count = 0;
+NodePool node_pool = {0};
+
+/* Pool of the calling thread, NULL for the global one */
+static _Thread_local NodePool *thread_pool = NULL;
+
+#define FIRST_SLAB_NODES 1024
+#define MAX_SLAB_NODES (1 << 20)
+
+struct NodeSlab {
+    NodeSlab *next;
+    Node nodes[];
+};
 
 /**********************************************************************
  * Allocate a node.
@@ -10,55 +27,183 @@ int node_count = 0;
  **********************************************************************/
 Node *node_alloc(void)
 {
-    Node *new = malloc(sizeof(Node));
-    if (!new) {
-        fprintf(stderr, "Buy more RAM lol\n");
-        exit(1);
+    NodePool *pool = thread_pool ? thread_pool : &node_pool;
+    Node *new;
+    if (pool->free_list) {
+        new = pool->free_list;
+        pool->free_list = new->left;
+    } else {
+        if (pool->next == pool->end) {
+            /* Each slab doubles the size of the pool, up to a limit */
+            long nodes = pool->allocated ? pool->allocated : FIRST_SLAB_NODES;
+            if (nodes > MAX_SLAB_NODES) nodes = MAX_SLAB_NODES;
+            NodeSlab *slab = malloc(sizeof(NodeSlab) + nodes * sizeof(Node));
+            if (!slab) {
+                fprintf(stderr, "Buy more RAM lol\n");
+                exit(1);
+            }
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->next = slab->nodes;
+            pool->end = slab->nodes + nodes;
+            pool->allocated += nodes;
+        }
+        new = pool->next++;
     }
+    pool->in_use += 1;
     *new = (Node) { .out_iface = NO_IFACE };
     return new;
 }
 
 /**********************************************************************
- * RECURSIVE FUNCTION
- * Insert a new node as the left/right subtree of another one
+ * Give a node back to the pool.
+ **********************************************************************/
+void node_release(Node *node)
+{
+    NodePool *pool = thread_pool ? thread_pool : &node_pool;
+    node->left = pool->free_list;
+    pool->free_list = node;
+    pool->in_use -= 1;
+}
+
+/**********************************************************************
+ * Make the calling thread allocate from its own pool.
+ **********************************************************************/
+void node_pool_use(NodePool *pool)
+{
+    thread_pool = pool;
+}
+
+/**********************************************************************
+ * Move the nodes of a private pool to the global one.
+ **********************************************************************/
+void node_pool_merge(NodePool *pool)
+{
+    while (pool->slabs) {
+        NodeSlab *next = pool->slabs->next;
+        pool->slabs->next = node_pool.slabs;
+        node_pool.slabs = pool->slabs;
+        pool->slabs = next;
+    }
+    while (pool->free_list) {
+        Node *next = pool->free_list->left;
+        pool->free_list->left = node_pool.free_list;
+        node_pool.free_list = pool->free_list;
+        pool->free_list = next;
+    }
+    node_pool.allocated += pool->allocated;
+    node_pool.in_use += pool->in_use;
+    *pool = (NodePool) {0};
+}
+
+/**********************************************************************
+ * Release every slab of the pool at once.
+ **********************************************************************/
+void node_pool_destroy(void)
+{
+    while (node_pool.slabs) {
+        NodeSlab *next = node_pool.slabs->next;
+        free(node_pool.slabs);
+        node_pool.slabs = next;
+    }
+    node_pool = (NodePool) {0};
+}
+
+/**********************************************************************
+ * Insert a new node as the left/right subtree of another one, going
+ * down one bit per iteration.
  * Args:
- *  - Node *root: the root of the current SUBTREE (it does not have to
- *  be the root of the whole tree, since this function is called
- *  recursively.
+ *  - Node *root: the root of the SUBTREE where the node goes (it does
+ *  not have to be the root of the whole tree).
  *  - Node *new: the new node to be inserted in the tree.
  **********************************************************************/
 #define current_bit(node, ref) (((node).prefix >> (31 - (ref).prefix_length)) & 1)
 #define current_bit_from_ip(ip, node) (((ip) >> (31 - (node).prefix_length)) & 1)
 void insert_node(Node *root, Node *new)
 {
-    uint32_t root_net_prefix = (root->prefix >> (31 - root->prefix_length)) & ((1U << root->prefix_length) - 1),
-             new_net_prefix = (new->prefix >> (31 - new->prefix_length)) & ((1U << new->prefix_length) - 1);
-    if (root->prefix_length == new->prefix_length &&
-        root_net_prefix == new_net_prefix) {
-        root->out_iface = new->out_iface;
-        return;
+    int mask;
+    getNetmask(new->prefix_length, &mask);
+    for (;;) {
+        if (root->prefix_length == new->prefix_length &&
+            !((root->prefix ^ new->prefix) & (uint32_t)mask)) {
+            root->out_iface = new->out_iface;
+            return;
+        }
+
+        /* Seguir por la rama del bit, creándola si no existe */
+        int bit = current_bit(*new, *root);
+        if (!root->child[bit]) {
+            Node *child = node_alloc();
+            child->prefix_length = root->prefix_length + 1;
+            child->prefix = root->prefix | ((uint32_t)bit << (31 - root->prefix_length));
+            root->child[bit] = child;
+        }
+        root = root->child[bit];
     }
+}
+
+#define netmask(length) ((length) ? 0xFFFFFFFFU << (32 - (length)) : 0)
 
-    if (current_bit(*new, *root)) {
-        /* Reintentar inserción en rama derecha */
-        if (!root->right) {
-            root->right = node_alloc();
-            root->right->prefix_length = root->prefix_length + 1;
-            root->right->prefix = root->prefix | (1U << (31 - root->prefix_length));
+static Node *new_compressed_node(uint32_t prefix, int prefix_length, int out_iface)
+{
+    Node *node = node_alloc();
+    node->prefix = prefix & netmask(prefix_length);
+    node->prefix_length = prefix_length;
+    node->bit_shift = node_bit_shift(prefix_length);
+    node->out_iface = out_iface;
+    return node;
+}
+
+/**********************************************************************
+ * Insert a route in a compressed trie, keeping it compressed.
+ **********************************************************************/
+void insert_compressed(Node *root, uint32_t prefix, int prefix_length, int out_iface)
+{
+    prefix &= netmask(prefix_length);
+    Node *node = root;  // Always a prefix of the route
+    for (;;) {
+        if (node->prefix_length == prefix_length) {
+            node->out_iface = out_iface;
+            return;
         }
-        insert_node(root->right, new);
-    } else {
-        /* Reintentar inserción en rama izquierda */
-        if (!root->left) {
-            root->left = node_alloc();
-            root->left->prefix_length = root->prefix_length + 1;
-            root->left->prefix = root->prefix;
+        int bit = (prefix >> (31 - node->prefix_length)) & 1;
+        Node *child = node->child[bit];
+        if (!child) {
+            node->child[bit] = new_compressed_node(prefix, prefix_length, out_iface);
+            return;
+        }
+        int common = child->prefix ^ prefix ? __builtin_clz(child->prefix ^ prefix) : 32;
+        if (common > child->prefix_length) common = child->prefix_length;
+        if (common > prefix_length) common = prefix_length;
+        if (common == child->prefix_length) {
+            node = child;
+            continue;
         }
-        insert_node(root->left, new);
+        /* The route leaves the child's prefix at bit `common` */
+        Node *split = new_compressed_node(prefix, common, common == prefix_length ? out_iface : NO_IFACE);
+        split->child[(child->prefix >> (31 - common)) & 1] = child;
+        if (common < prefix_length)
+            split->child[(prefix >> (31 - common)) & 1] = new_compressed_node(prefix, prefix_length, out_iface);
+        node->child[bit] = split;
+        return;
     }
 }
 
+/**********************************************************************
+ * The root is the only node of a trie built with `insert_compressed`
+ * that can be left without next hop and with a single subtree: drop it
+ * as `compress_trie` would.
+ **********************************************************************/
+Node *compress_root(Node *root)
+{
+    root->bit_shift = node_bit_shift(root->prefix_length);
+    if (root->out_iface != NO_IFACE || (root->left && root->right) || (!root->left && !root->right))
+        return root;
+    Node *child = root->left ? root->left : root->right;
+    node_release(root);
+    return child;
+}
+
 /**********************************************************************
  * WARNING: THIS FUNCTION ALLOCATES MEMORY
  * Create the Patricia trie, uncompressed.
@@ -91,14 +236,68 @@ Node *create_trie()
 }
 
 /**********************************************************************
- * Free the tree from the root to the leaves.
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create the Patricia trie, uncompressed, from a FIB already loaded in
+ * memory.
+ **********************************************************************/
+Node *create_trie_from_fib(const FibEntry *entries, size_t count)
+{
+    Node *root = node_alloc();
+    for (size_t i = 0; i < count; ++i) {
+        Node new_node = (Node) {
+            .prefix = entries[i].prefix,
+            .prefix_length = entries[i].prefix_length,
+            .out_iface = entries[i].out_iface,
+        };
+        insert_node(root, &new_node);
+    }
+    return root;
+}
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create the compressed Patricia trie from a FIB already loaded in
+ * memory, inserting and compressing in the same pass.
+ **********************************************************************/
+Node *create_compressed_trie_from_fib(const FibEntry *entries, size_t count)
+{
+    Node *root = new_compressed_node(0, 0, NO_IFACE);
+    for (size_t i = 0; i < count; ++i)
+        insert_compressed(root, entries[i].prefix, entries[i].prefix_length, entries[i].out_iface);
+    return compress_root(root);
+}
+
+/**********************************************************************
+ * Give the nodes of the tree back to the pool, with a stack of the
+ * subtrees still to be freed.
  **********************************************************************/
 void free_nodes(Node *root)
 {
-    if (root->left) free_nodes(root->left);
-    if (root->right) free_nodes(root->right);
-    free(root);
-    root = NULL;
+    /* Every level leaves at most one subtree behind */
+    Node *stack[IP_ADDRESS_LENGTH + 2];
+    int top = 0;
+    if (root)
+        stack[top++] = root;
+    while (top) {
+        Node *node = stack[--top];
+        Node *left = node->left, *right = node->right;
+        node_release(node);  // Reuses `left`
+        if (right) stack[top++] = right;
+        if (left) stack[top++] = left;
+    }
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Check whether two tries have the same nodes.
+ **********************************************************************/
+int trie_equal(const Node *a, const Node *b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->prefix_length == b->prefix_length && a->prefix == b->prefix &&
+           a->out_iface == b->out_iface && a->bit_shift == b->bit_shift &&
+           trie_equal(a->left, b->left) && trie_equal(a->right, b->right);
 }
 
 /**********************************************************************
@@ -115,38 +314,247 @@ void print_trie(FILE *stream, Node *root, int level)
 }
 
 /**********************************************************************
- * RECURSIVE_FUNCTION
- * Compress a Patricia trie. Get rid of the in-between nodes if they
- * do not correspond to a next hop and they only have one subtree.
+ * Compress the nodes of a Patricia trie shorter than `depth`. Get rid
+ * of the in-between nodes if they do not correspond to a next hop and
+ * they only have one subtree.
+ * Post-order walk with a stack of the links to the nodes: a node is
+ * seen once on the way down, to push its subtrees, and once on the way
+ * up, when they are compressed and it can be replaced by its child.
  **********************************************************************/
-Node* compress_trie(Node *node) {
-    if (!node) return NULL;
+typedef struct {
+    Node **link;
+    int expanded;
+} CompressFrame;
 
-    node->left = compress_trie(node->left);
-    node->right = compress_trie(node->right);
+static Node *compress_above(Node *root, int depth) {
+    /* A node and its two subtrees per level */
+    CompressFrame stack[2 * (IP_ADDRESS_LENGTH + 2)];
+    int top = 0;
+    stack[top++] = (CompressFrame) { &root, 0 };
+    while (top) {
+        CompressFrame *frame = &stack[top - 1];
+        Node *node = *frame->link;
+        if (!node || node->prefix_length >= depth) {
+            top -= 1;
+            continue;
+        }
+        if (!frame->expanded) {
+            frame->expanded = 1;
+            node->bit_shift = node_bit_shift(node->prefix_length);
+            stack[top++] = (CompressFrame) { &node->right, 0 };
+            stack[top++] = (CompressFrame) { &node->left, 0 };
+            continue;
+        }
+        top -= 1;
 
-    if (!node->left && !node->right)
-        return node;
+        // Nodo sin interfaz y con un único hijo: eliminamos
+        if (node->out_iface == NO_IFACE && !node->left != !node->right) {
+            *frame->link = node->left ? node->left : node->right;
+            node_release(node);
+        }
+        // Si no, nodo con out_iface, 2 hijos o una hoja
+    }
+    return root;
+}
 
-    // Nodo sin interfaz y con un único hijo: eliminamos
-    if (node->out_iface == NO_IFACE) {
-        if (node->left && !node->right) {
-            Node *child = node->left;
-            free(node);
-            node_count += 1;
-            return child;
+/**********************************************************************
+ * Compress a Patricia trie.
+ **********************************************************************/
+Node *compress_trie(Node *node)
+{
+    return compress_above(node, IP_ADDRESS_LENGTH + 1);
+}
+
+/**********************************************************************
+ * Compress the part of a Patricia trie above `depth`.
+ **********************************************************************/
+Node *compress_trie_above(Node *node, int depth)
+{
+    return compress_above(node, depth);
+}
+
+/* Set of next hops, sorted */
+typedef struct {
+    int *items;
+    int size;
+} HopSet;
+
+/* Sets of the nodes of a subtree, in preorder */
+typedef struct {
+    HopSet *sets;
+    size_t size;
+    size_t capacity;
+} HopSets;
+
+static int *hop_alloc(int count)
+{
+    int *items = malloc((count ? count : 1) * sizeof(int));
+    if (!items) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return items;
+}
+
+static size_t hop_sets_push(HopSets *sets)
+{
+    if (sets->size == sets->capacity) {
+        sets->capacity = sets->capacity ? 2 * sets->capacity : 1024;
+        sets->sets = realloc(sets->sets, sets->capacity * sizeof(HopSet));
+        if (!sets->sets) {
+            fprintf(stderr, "Buy more RAM lol\n");
+            exit(1);
         }
-        if (node->right && !node->left) {
-            Node *child = node->right;
-            free(node);
-            node_count += 1;
-            return child;
+    }
+    sets->sets[sets->size] = (HopSet) {0};
+    return sets->size++;
+}
+
+/* The intersection of two sets if it is not empty, their union otherwise */
+static HopSet hop_merge(const HopSet *a, const HopSet *b)
+{
+    HopSet result = { .items = hop_alloc(a->size + b->size) };
+    for (int i = 0, j = 0; i < a->size && j < b->size;) {
+        if (a->items[i] == b->items[j]) {
+            result.items[result.size++] = a->items[i];
+            i += 1;
+            j += 1;
+        } else if (a->items[i] < b->items[j]) {
+            i += 1;
+        } else {
+            j += 1;
         }
     }
+    if (result.size)
+        return result;
+    int i = 0, j = 0;
+    while (i < a->size || j < b->size) {
+        if (j == b->size || (i < a->size && a->items[i] < b->items[j]))
+            result.items[result.size++] = a->items[i++];
+        else
+            result.items[result.size++] = b->items[j++];
+    }
+    return result;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * ORTC pass 1: give every node with a single subtree the missing one,
+ * and every leaf the next hop it forwards to.
+ **********************************************************************/
+static void ortc_normalize(Node *node, int inherited)
+{
+    if (node->out_iface != NO_IFACE)
+        inherited = node->out_iface;
+    if (!node->left && !node->right) {
+        node->out_iface = inherited;
+        return;
+    }
+    for (int bit = 0; bit < 2; ++bit) {
+        if (node->child[bit]) continue;
+        Node *sibling = node_alloc();
+        sibling->prefix_length = node->prefix_length + 1;
+        sibling->prefix = node->prefix | ((uint32_t)bit << (31 - node->prefix_length));
+        node->child[bit] = sibling;
+    }
+    ortc_normalize(node->left, inherited);
+    ortc_normalize(node->right, inherited);
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * ORTC pass 2: the set of next hops of a node is the one of its leaf,
+ * or the merge of the sets of its subtrees. Returns the index of the
+ * set of the node.
+ **********************************************************************/
+static size_t ortc_sets(HopSets *sets, const Node *node)
+{
+    size_t index = hop_sets_push(sets);
+    if (!node->left) {
+        HopSet leaf = { .items = hop_alloc(1), .size = 1 };
+        leaf.items[0] = node->out_iface;
+        sets->sets[index] = leaf;
+        return index;
+    }
+    size_t left = ortc_sets(sets, node->left);
+    size_t right = ortc_sets(sets, node->right);
+    sets->sets[index] = hop_merge(&sets->sets[left], &sets->sets[right]);
+    return index;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * ORTC pass 3: a node needs a prefix only if the next hop it inherits
+ * is not in its set. The sets are consumed in preorder.
+ **********************************************************************/
+static void ortc_assign(const HopSets *sets, size_t *next, Node *node, int inherited)
+{
+    const HopSet *set = &sets->sets[(*next)++];
+    int found = 0;
+    for (int i = 0; i < set->size && !found; ++i)
+        found = set->items[i] == inherited;
+    if (found) {
+        node->out_iface = NO_IFACE;
+    } else {
+        node->out_iface = set->items[0];
+        inherited = set->items[0];
+    }
+    if (node->left) {
+        ortc_assign(sets, next, node->left, inherited);
+        ortc_assign(sets, next, node->right, inherited);
+    }
+}
 
-    return node; // nodo con out_iface o 2 hijos
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Release the subtrees without any next hop. Returns the node, or NULL
+ * if it was released.
+ **********************************************************************/
+static Node *prune_trie(Node *node)
+{
+    if (!node) return NULL;
+    node->left = prune_trie(node->left);
+    node->right = prune_trie(node->right);
+    if (node->out_iface == NO_IFACE && !node->left && !node->right) {
+        node_release(node);
+        return NULL;
+    }
+    return node;
 }
 
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Run ORTC on every subtree whose root has a route, which covers the
+ * whole subtree. The space not covered by any route is left alone.
+ **********************************************************************/
+static void aggregate_covered(Node *node)
+{
+    if (!node) return;
+    if (node->out_iface == NO_IFACE) {
+        aggregate_covered(node->left);
+        aggregate_covered(node->right);
+        return;
+    }
+    HopSets sets = {0};
+    size_t next = 0;
+    ortc_normalize(node, NO_IFACE);
+    ortc_sets(&sets, node);
+    ortc_assign(&sets, &next, node, NO_IFACE);
+    for (size_t i = 0; i < sets.size; ++i)
+        free(sets.sets[i].items);
+    free(sets.sets);
+}
+
+/**********************************************************************
+ * Aggregate the routes of an uncompressed Patricia trie with ORTC.
+ **********************************************************************/
+Node *aggregate_trie(Node *root)
+{
+    aggregate_covered(root);
+    root->left = prune_trie(root->left);
+    root->right = prune_trie(root->right);
+    return root;
+}
 
 /**********************************************************************
  * Look up the next hop corresponding to an IP. Returns 0 if it
@@ -165,15 +573,13 @@ int lookup(Node *root, uint32_t ip, int *accesses) {
         int mask;
         getNetmask(node->prefix_length, (int *)&mask); //utils
 
-        if (node->prefix_length == 0) {
-            mask = 0x00000000;  // Protege contra desplazamiento ilegal(necesario por funcion getNetmask)
-        }
-
         // Verificamos si el prefijo del nodo coincide con la IP
         if ((ip & mask) == (node->prefix & mask)) {
             if (node->out_iface != NO_IFACE) {//tiene interfaz
                 best_iface = node->out_iface;
             }
+            if (node->prefix_length == IP_ADDRESS_LENGTH)
+                break;  // Un /32 no tiene hijos (y el desplazamiento sería ilegal)
             //seguimos avanzando
             if (current_bit_from_ip(ip, *node) == 0) {
                 node = node->left;
@@ -189,70 +595,102 @@ int lookup(Node *root, uint32_t ip, int *accesses) {
 }
 
 /**********************************************************************
- * RECURSIVE FUNCTION
- * Output the trie to a file in graphviz format, to be processed with
- * the `dot` command-line utility
- * Args:
- *  - FILE *stream: an opened FILE *. No need to handle it here.
- *  - Node *root: the relative root of the current tree.
- *  - int level: it is a closure. The function behaves differently
- *  depending on its value. If it is 0, it prints the opening and
- *  closing curly braces of the format.
+ * Same results as `lookup`, with a single prefix comparison at the end.
  **********************************************************************/
-void make_graph(FILE *stream, Node *root, int level)
+int lookup_fast(Node *root, uint32_t ip, int *accesses)
 {
-    if (!level) {
-        fprintf(stream, "digraph G {\n");
+    /* Prefix lengths and next hops of the nodes with a next hop, in path order */
+    int lengths[IP_ADDRESS_LENGTH + 1], ifaces[IP_ADDRESS_LENGTH + 1];
+    int count = 0;
+    const Node *node = root, *last = root;
+    while (node) {
+        *accesses += 1;
+        lengths[count] = node->prefix_length;
+        ifaces[count] = node->out_iface;
+        count += node->out_iface != NO_IFACE;
+        last = node;
+        node = node->child[(ip >> node->bit_shift) & 1];
     }
+    if (!last)
+        return NO_IFACE;
+
+    uint32_t diff = ip ^ last->prefix;
+    int matched = diff ? __builtin_clz(diff) : IP_ADDRESS_LENGTH;
+    while (count && lengths[count - 1] > matched)
+        count -= 1;
+    return count ? ifaces[count - 1] : NO_IFACE;
+}
+
+/* State of one of the interleaved walks of `lookup_batch` */
+typedef struct {
+    Node *node;
+    size_t index;
+    int best_iface;
+    int accesses;
+} BatchLane;
+
+/**********************************************************************
+ * Look up a batch of IPs, interleaving LOOKUP_BATCH_GROUP walks.
+ **********************************************************************/
+void lookup_batch(Node *root, const uint32_t *ips, int *ifaces, int *accesses, size_t n)
+{
+    BatchLane lanes[LOOKUP_BATCH_GROUP];
+    size_t next = 0;
+    int active = 0;
+
+    for (; active < LOOKUP_BATCH_GROUP && next < n; ++active, ++next)
+        lanes[active] = (BatchLane) { .node = root, .index = next, .best_iface = NO_IFACE };
+    int lanes_used = active;
 
-    enum { BOTH, ONE, NONE } state = BOTH;
-
-    if (!root->left && !root->right)
-        state = NONE;
-    else if ((root->left && !root->right) || (!root->left && root->right))
-        state = ONE;
-    else
-        state = BOTH;
-
-    if (state == BOTH)
-        fprintf(stream, "\""Node_Fmt" * %d\" -> { ", Node_Args(*root), root->out_iface);
-    else if (state == ONE)
-        fprintf(stream, "\"" Node_Fmt " * %d\" -> ", Node_Args(*root), root->out_iface);
-    else
-        fprintf(stream, "\""Node_Fmt" * %d\"\n", Node_Args(*root), root->out_iface);
-
-    if (root->left)
-        fprintf(stream, "\""Node_Fmt" * %d\"", Node_Args(*root->left), root->left->out_iface);
-    if (state == BOTH)
-        fprintf(stream, ", ");
-    if (root->right)
-        fprintf(stream, "\""Node_Fmt" * %d\"", Node_Args(*root->right), root->right->out_iface);
-
-    if (state == BOTH) fprintf(stream, "}\n");
-    else fprintf(stream, "\n");
-
-    if (root->left) make_graph(stream, root->left, level + 1);
-    if (root->right) make_graph(stream, root->right, level + 1);
-
-    if (!level) {
-        fprintf(stream, "}\n");
+    while (active) {
+        for (int l = 0; l < lanes_used; ++l) {
+            Node *node = lanes[l].node;
+            if (!node) continue;
+            uint32_t ip = ips[lanes[l].index];
+            lanes[l].accesses += 1;
+
+            uint32_t mask = node->prefix_length ? 0xFFFFFFFF << (32 - node->prefix_length) : 0;
+            if ((ip & mask) == (node->prefix & mask)) {
+                if (node->out_iface != NO_IFACE)
+                    lanes[l].best_iface = node->out_iface;
+                node = node->prefix_length == 32 ? NULL
+                     : current_bit_from_ip(ip, *node) ? node->right : node->left;
+            } else {
+                node = NULL;
+            }
+
+            if (node) {
+                __builtin_prefetch(node);
+                lanes[l].node = node;
+                continue;
+            }
+            /* This walk is over: give the lane to the next IP */
+            ifaces[lanes[l].index] = lanes[l].best_iface;
+            accesses[lanes[l].index] = lanes[l].accesses;
+            if (next < n) {
+                lanes[l] = (BatchLane) { .node = root, .index = next++, .best_iface = NO_IFACE };
+            } else {
+                lanes[l].node = NULL;
+                active -= 1;
+            }
+        }
     }
 }
 
 /**********************************************************************
- * Wrapper of the above `make_graph` function, in charge of opening
- * the file and handling errors.
+ * Output the trie to a file in graphviz format, with `export_trie`.
  * THIS FUNCTION PRODUCES LOGS. There is no need to print errors in
  * user code.
  **********************************************************************/
 int output_graphviz(const char *gv_file_path, Node *root)
 {
-    FILE *stream = fopen(gv_file_path, "w");
-    if (!stream) {
+    int fd = open(gv_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
         fprintf(stderr, "ERROR: could not open GraphViz file\n");
         return -1;
     }
-    make_graph(stream, root, 0);
-    fclose(stream);  // We do not care about the errors at this point.
+    ExportOptions options = { .format = EXPORT_GRAPHVIZ, .max_depth = -1 };
+    export_trie(fd, root, &options);
+    close(fd);  // We do not care about the errors at this point.
     return 0;
 }
@@ -3,11 +3,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include "fib.h"
 
 #define NO_IFACE 0
 
-extern int node_count;
-
 /**********************************************************************
  * NODE STRUCTURE
  * Explanation of the anonymous union: convenience to print the IP
@@ -16,7 +15,10 @@ extern int node_count;
  *  - prefix_length: the length of the IP prefix
  *  - prefix: the prefix itself (cidr_format represents the same bytes)
  *  - out_iface: the "next_hop" of the forwarding algorithm.
- *  - Node *left,*right: left and right subtrees.
+ *  - bit_shift: 31 - prefix_length (0 for /32), the shift that gives
+ *  the bit of an IP choosing the subtree. Set by `compress_trie`.
+ *  - Node *left,*right: left and right subtrees, also reachable as
+ *  child[0], child[1] to choose them without branches.
  **********************************************************************/
 typedef struct Node Node;
 struct Node {
@@ -26,9 +28,43 @@ struct Node {
         uint8_t cidr_format[4];
     };
     int out_iface;
-    Node *left;
-    Node *right;
+    uint8_t bit_shift;
+    union {
+        struct {
+            Node *left;
+            Node *right;
+        };
+        Node *child[2];
+    };
 };
+#define node_bit_shift(prefix_length) ((prefix_length) < 32 ? 31 - (prefix_length) : 0)
+/**********************************************************************
+ * NODE POOL
+ * Every node is taken from a global pool of slabs, so there is no
+ * malloc per node. The nodes released by `compress_trie` or
+ * `free_nodes` go to a free list, linked through their `left` field,
+ * and are reused by the next `node_alloc`. A thread that builds a
+ * subtrie of its own can take its nodes from a private pool instead
+ * (see `node_pool_use`).
+ * Fields:
+ *  - slabs: list of slabs, the newest first.
+ *  - free_list: released nodes.
+ *  - next, end: unused part of the newest slab.
+ *  - allocated: nodes reserved in slabs.
+ *  - in_use: nodes handed out and not released.
+ **********************************************************************/
+typedef struct NodeSlab NodeSlab;
+typedef struct {
+    NodeSlab *slabs;
+    Node *free_list;
+    Node *next;
+    Node *end;
+    long allocated;
+    long in_use;
+} NodePool;
+
+extern NodePool node_pool;
+
 /* Macros for printf */
 #define Node_Fmt "%d.%d.%d.%d/%d"
 #define Node_Args(x) (x).cidr_format[3], (x).cidr_format[2], (x).cidr_format[1], (x).cidr_format[0], (x).prefix_length
@@ -41,16 +77,59 @@ struct Node {
 Node *node_alloc(void);
 
 /**********************************************************************
- * RECURSIVE FUNCTION
- * Insert a new node as the left/right subtree of another one
+ * Give a node back to the pool.
+ **********************************************************************/
+void node_release(Node *node);
+
+/**********************************************************************
+ * Make the calling thread allocate and release its nodes in `pool`, or
+ * in the global pool again if it is NULL.
+ **********************************************************************/
+void node_pool_use(NodePool *pool);
+
+/**********************************************************************
+ * Move the nodes of a private pool (slabs, free list and counters) to
+ * the global one, and empty it. Not thread safe: the owner of the pool
+ * must be done with it.
+ **********************************************************************/
+void node_pool_merge(NodePool *pool);
+
+/**********************************************************************
+ * Release every slab of the pool at once. Every node allocated so far
+ * becomes invalid.
+ **********************************************************************/
+void node_pool_destroy(void);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Insert a new node as the left/right subtree of another one, in an
+ * uncompressed trie: every bit of the path gets its node.
  * Args:
- *  - Node *root: the root of the current SUBTREE (it does not have to
- *  be the root of the whole tree, since this function is called
- *  recursively.
+ *  - Node *root: the root of the SUBTREE where the node goes (it does
+ *  not have to be the root of the whole tree).
  *  - Node *new: the new node to be inserted in the tree.
  **********************************************************************/
 void insert_node(Node *root, Node *new);
 
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Insert a route in a compressed trie, without going through the
+ * uncompressed one: only the node of the route and, if it leaves the
+ * prefix of an existing node, the node where they split are created.
+ * A route that is already there gets the new next hop.
+ * Args:
+ *  - Node *root: the root of the SUBTREE, a prefix of the route. Not
+ *  removed even if it has no next hop (see `compress_root`).
+ **********************************************************************/
+void insert_compressed(Node *root, uint32_t prefix, int prefix_length, int out_iface);
+
+/**********************************************************************
+ * Finish a trie built with `insert_compressed`: returns its root, or
+ * the only subtree of the root if the root has no next hop, like
+ * `compress_trie` does.
+ **********************************************************************/
+Node *compress_root(Node *root);
+
 /**********************************************************************
  * WARNING: THIS FUNCTION ALLOCATES MEMORY
  * Create the Patricia trie, uncompressed.
@@ -60,17 +139,65 @@ void insert_node(Node *root, Node *new);
 Node *create_trie();
 
 /**********************************************************************
- * Free the tree from the root to the leaves.
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create the Patricia trie, uncompressed, from a FIB already loaded in
+ * memory (see `load_fib`).
+ * Args:
+ *  - const FibEntry *entries: the FIB entries, in file order.
+ *  - size_t count: number of entries.
+ **********************************************************************/
+Node *create_trie_from_fib(const FibEntry *entries, size_t count);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create the compressed Patricia trie from a FIB already loaded in
+ * memory, with `insert_compressed`. The trie is the same as the one of
+ * `compress_trie(create_trie_from_fib(...))`, but the uncompressed one
+ * is never built, so the memory used while loading is the one of the
+ * compressed trie.
+ **********************************************************************/
+Node *create_compressed_trie_from_fib(const FibEntry *entries, size_t count);
+
+/**********************************************************************
+ * Give the nodes of the tree back to the pool, from the root to the
+ * leaves, without recursion. Use `node_pool_destroy` to release all of them at once.
  **********************************************************************/
 void free_nodes(Node *root);
 
 /**********************************************************************
  * RECURSIVE FUNCTION
+ * Check whether two tries have the same nodes (prefix, next hop and
+ * bit_shift) in the same places. Returns 1 if they do, 0 otherwise.
+ **********************************************************************/
+int trie_equal(const Node *a, const Node *b);
+
+/**********************************************************************
  * Compress a Patricia trie. Get rid of the in-between nodes if they
  * do not correspond to a next hop and they only have one subtree.
+ * The nodes that stay get their bit_shift precomputed. The trie is
+ * walked with a stack of its own, bounded by the 33 levels of a trie.
  **********************************************************************/
 Node* compress_trie(Node *node);
 
+/**********************************************************************
+ * Same as `compress_trie`, but only for the nodes shorter than `depth`:
+ * the subtrees from `depth` down are taken as already compressed and
+ * are not visited.
+ **********************************************************************/
+Node *compress_trie_above(Node *node, int depth);
+
+/**********************************************************************
+ * CALLS RECURSIVE FUNCTIONS
+ * Aggregate the routes of an uncompressed Patricia trie with ORTC
+ * (Draves, King, Venkatachary & Zill): every part of the trie covered
+ * by a route gets the smallest set of prefixes that forwards exactly
+ * like the original ones. Sibling prefixes with the same next hop are
+ * merged, and more specific prefixes with the next hop of the route
+ * covering them disappear. Compress the trie afterwards.
+ * Returns the root, which is never released.
+ **********************************************************************/
+Node *aggregate_trie(Node *root);
+
 /**********************************************************************
  * Look up the next hop corresponding to an IP. Returns 0 if it
  * did not find one.
@@ -83,11 +210,36 @@ Node* compress_trie(Node *node);
 int lookup(Node *root, uint32_t ip, int *accesses);
 
 /**********************************************************************
- * Wrapper of the above `make_graph` function, in charge of opening
- * the file and handling errors.
- * CALLS A RECURSIVE FUNCTION: make_graph
- * Output the trie to a file in graphviz format, to be processed with
- * the `dot` command-line utility
+ * Same results as `lookup`, but cheaper per node: the walk only reads
+ * the bit of the IP each node chooses (child[bit], no netmasks) and
+ * remembers the nodes with a next hop. The IP is compared with a prefix
+ * only once, with the last node reached: every remembered node no
+ * longer than the bits they have in common matches, and the longest
+ * one is the answer. Needs a compressed trie (see `compress_trie`).
+ * The accesses are the nodes actually read, so they can be more than
+ * with `lookup`, which stops at the first node that does not match.
+ **********************************************************************/
+int lookup_fast(Node *root, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * Look up a batch of IPs. The walks of LOOKUP_BATCH_GROUP IPs are
+ * interleaved (AMAC): each one advances a node per round and prefetches
+ * the next one, so the cache misses of different walks overlap. The
+ * results are the same as calling `lookup` for every IP.
+ * Args:
+ *  - Node *root: the absolute root of the trie.
+ *  - const uint32_t *ips: the IPs to look up.
+ *  - int *ifaces: output parameter, the next hop of every IP.
+ *  - int *accesses: output parameter, the accesses of every IP.
+ *  - size_t n: number of IPs.
+ **********************************************************************/
+#define LOOKUP_BATCH_GROUP 16
+void lookup_batch(Node *root, const uint32_t *ips, int *ifaces, int *accesses, size_t n);
+
+/**********************************************************************
+ * Output the whole trie to a file in graphviz format, to be processed
+ * with the `dot` command-line utility. See `export_trie` (export.h)
+ * for subtrees, depth caps and the other formats.
  * THIS FUNCTION PRODUCES LOGS. There is no need to print errors in
  * user code.
  * Args:
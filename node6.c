@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "node6.h"
+
+Node6Pool node6_pool = {0};
+
+#define FIRST_SLAB_NODES 1024
+#define MAX_SLAB_NODES (1 << 20)
+
+struct Node6Slab {
+    Node6Slab *next;
+    Node6 nodes[];
+};
+
+/**********************************************************************
+ * Allocate an IPv6 node.
+ **********************************************************************/
+Node6 *node6_alloc(void)
+{
+    if (node6_pool.next == node6_pool.end) {
+        /* Each slab doubles the size of the pool, up to a limit */
+        long nodes = node6_pool.allocated ? node6_pool.allocated : FIRST_SLAB_NODES;
+        if (nodes > MAX_SLAB_NODES) nodes = MAX_SLAB_NODES;
+        Node6Slab *slab = malloc(sizeof(Node6Slab) + nodes * sizeof(Node6));
+        if (!slab) {
+            fprintf(stderr, "Buy more RAM lol\n");
+            exit(1);
+        }
+        slab->next = node6_pool.slabs;
+        node6_pool.slabs = slab;
+        node6_pool.next = slab->nodes;
+        node6_pool.end = slab->nodes + nodes;
+        node6_pool.allocated += nodes;
+    }
+    Node6 *new = node6_pool.next++;
+    node6_pool.in_use += 1;
+    *new = (Node6) { .out_iface = NO_IFACE };
+    return new;
+}
+
+/**********************************************************************
+ * Release every slab of the pool at once.
+ **********************************************************************/
+void node6_pool_destroy(void)
+{
+    while (node6_pool.slabs) {
+        Node6Slab *next = node6_pool.slabs->next;
+        free(node6_pool.slabs);
+        node6_pool.slabs = next;
+    }
+    node6_pool = (Node6Pool) {0};
+}
+
+static Node6 *new_node6(Ip6 prefix, int prefix_length, int out_iface)
+{
+    Node6 *node = node6_alloc();
+    node->prefix = prefix & ip6_mask(prefix_length);
+    node->prefix_length = prefix_length;
+    node->out_iface = out_iface;
+    return node;
+}
+
+/**********************************************************************
+ * Insert a route in the trie.
+ **********************************************************************/
+void insert_node6(Node6 *root, Ip6 prefix, int prefix_length, int out_iface)
+{
+    prefix &= ip6_mask(prefix_length);
+    Node6 *node = root;  // Always a prefix of the route
+    for (;;) {
+        if (node->prefix_length == prefix_length) {
+            node->out_iface = out_iface;
+            return;
+        }
+        int bit = ip6_bit(prefix, node->prefix_length);
+        Node6 *child = node->child[bit];
+        if (!child) {
+            node->child[bit] = new_node6(prefix, prefix_length, out_iface);
+            return;
+        }
+        int common = ip6_common_length(child->prefix, prefix);
+        if (common > child->prefix_length) common = child->prefix_length;
+        if (common > prefix_length) common = prefix_length;
+        if (common == child->prefix_length) {
+            node = child;
+            continue;
+        }
+        /* The route leaves the child's prefix at bit `common` */
+        Node6 *split = new_node6(prefix, common, common == prefix_length ? out_iface : NO_IFACE);
+        split->child[ip6_bit(child->prefix, common)] = child;
+        if (common < prefix_length)
+            split->child[ip6_bit(prefix, common)] = new_node6(prefix, prefix_length, out_iface);
+        node->child[bit] = split;
+        return;
+    }
+}
+
+/**********************************************************************
+ * Create the compressed IPv6 Patricia trie from a FIB.
+ **********************************************************************/
+Node6 *create_trie6_from_fib(const Fib6Entry *entries, size_t count)
+{
+    Node6 *root = node6_alloc();
+    for (size_t i = 0; i < count; ++i)
+        insert_node6(root, entries[i].prefix, entries[i].prefix_length, entries[i].out_iface);
+    return root;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IPv6 address.
+ **********************************************************************/
+int lookup6(const Node6 *root, Ip6 ip, int *accesses)
+{
+    int best = NO_IFACE;
+    const Node6 *node = root;
+    while (node) {
+        *accesses += 1;
+        if ((ip ^ node->prefix) & ip6_mask(node->prefix_length))
+            break;
+        if (node->out_iface != NO_IFACE)
+            best = node->out_iface;
+        if (node->prefix_length == IP6_LENGTH)
+            break;
+        node = node->child[ip6_bit(ip, node->prefix_length)];
+    }
+    return best;
+}
@@ -0,0 +1,82 @@
+#ifndef NODE6_H
+#define NODE6_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ip6.h"
+#include "node.h"
+
+/**********************************************************************
+ * IPv6 NODE STRUCTURE
+ * A node of the IPv6 Patricia trie. Over 128 bits a trie with a node
+ * per bit would take tens of nodes per route, so the IPv6 trie is
+ * built compressed: every node is a route or a branching point, and a
+ * child can be many bits longer than its parent.
+ * Fields:
+ *  - prefix, prefix_length: the prefix of the node, masked.
+ *  - out_iface: the next hop, NO_IFACE for a branching point.
+ *  - child[2]: subtrees, by the bit `prefix_length` of the IP.
+ **********************************************************************/
+typedef struct Node6 Node6;
+struct Node6 {
+    Ip6 prefix;
+    int prefix_length;
+    int out_iface;
+    Node6 *child[2];
+};
+
+/**********************************************************************
+ * IPv6 NODE POOL
+ * Same idea as NodePool: the nodes are taken from slabs and released
+ * all at once.
+ * Fields:
+ *  - slabs: list of slabs, the newest first.
+ *  - next, end: unused part of the newest slab.
+ *  - allocated: nodes reserved in slabs.
+ *  - in_use: nodes handed out.
+ **********************************************************************/
+typedef struct Node6Slab Node6Slab;
+typedef struct {
+    Node6Slab *slabs;
+    Node6 *next;
+    Node6 *end;
+    long allocated;
+    long in_use;
+} Node6Pool;
+
+extern Node6Pool node6_pool;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Allocate an IPv6 node, with no route and no children.
+ **********************************************************************/
+Node6 *node6_alloc(void);
+
+/**********************************************************************
+ * Release every slab of the pool at once.
+ **********************************************************************/
+void node6_pool_destroy(void);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Insert a route in the trie, splitting the node where the route leaves
+ * it. A route that is already there gets the new next hop.
+ * Args:
+ *  - Node6 *root: the root of the trie (the /0 node).
+ **********************************************************************/
+void insert_node6(Node6 *root, Ip6 prefix, int prefix_length, int out_iface);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Create the compressed IPv6 Patricia trie from a FIB already loaded
+ * in memory (see `load_fib6`).
+ **********************************************************************/
+Node6 *create_trie6_from_fib(const Fib6Entry *entries, size_t count);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IPv6 address. Returns 0 if
+ * it did not find one. Same contract as `lookup`.
+ **********************************************************************/
+int lookup6(const Node6 *root, Ip6 ip, int *accesses);
+
+#endif // NODE6_H
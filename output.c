@@ -0,0 +1,240 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "output.h"
+
+#define MAX_LINE 64  // "255.255.255.255;2147483647;2147483647;18446744073709551615\n"
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Write v in decimal at p, returns the position after it */
+static char *put_uint(char *p, uint64_t v)
+{
+    char digits[20];
+    char *d = digits + sizeof(digits);
+    while (v >= 100) {
+        const char *pair = &digit_pairs[2 * (v % 100)];
+        v /= 100;
+        *--d = pair[1];
+        *--d = pair[0];
+    }
+    if (v >= 10) {
+        *--d = digit_pairs[2 * v + 1];
+        *--d = digit_pairs[2 * v];
+    } else {
+        *--d = '0' + v;
+    }
+    size_t length = digits + sizeof(digits) - d;
+    memcpy(p, d, length);
+    return p + length;
+}
+
+/* Same line as `printResultLine` */
+static char *format_line(char *p, uint32_t ip, int iface, int accesses, double time)
+{
+    p = put_uint(p, ip >> 24);
+    *p++ = '.';
+    p = put_uint(p, (ip >> 16) & 0xFF);
+    *p++ = '.';
+    p = put_uint(p, (ip >> 8) & 0xFF);
+    *p++ = '.';
+    p = put_uint(p, ip & 0xFF);
+    *p++ = ';';
+    if (iface) {
+        p = put_uint(p, (unsigned)iface);
+    } else {
+        memcpy(p, "MISS", 4);
+        p += 4;
+    }
+    *p++ = ';';
+    p = put_uint(p, (unsigned)accesses);
+    *p++ = ';';
+    p = put_uint(p, time > 0 ? (uint64_t)(time + 0.5) : 0);
+    *p++ = '\n';
+    return p;
+}
+
+/* Write the whole buffer, retrying on short writes */
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (size) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static void flush(ResultWriter *writer)
+{
+    if (!writer->used || writer->error) {
+        writer->used = 0;
+        return;
+    }
+    if (write_all(writer->fd, writer->buffer, writer->used) < 0 ||
+        (writer->echo_fd >= 0 && write_all(writer->echo_fd, writer->buffer, writer->used) < 0))
+        writer->error = 1;
+    writer->used = 0;
+}
+
+/* Format the results [first, last) into the buffer */
+static void format_results(ResultWriter *writer, size_t first, size_t last)
+{
+    for (size_t i = first; i < last; ++i) {
+        if (writer->used + MAX_LINE > OUTPUT_BUFFER_SIZE)
+            flush(writer);
+        if (writer->format == OUTPUT_BINARY) {
+            ResultRecord record = {
+                .ip = writer->ips[i],
+                .out_iface = writer->ifaces[i],
+                .accesses = writer->accesses[i],
+                .time = writer->times[i],
+            };
+            memcpy(writer->buffer + writer->used, &record, sizeof(record));
+            writer->used += sizeof(record);
+        } else {
+            char *start = writer->buffer + writer->used;
+            char *end = format_line(start, writer->ips[i], writer->ifaces[i],
+                                    writer->accesses[i], writer->times[i]);
+            writer->used += end - start;
+        }
+    }
+}
+
+/**********************************************************************
+ * Write n results right away, from the calling thread.
+ **********************************************************************/
+int write_results(int fd, OutputFormat format, const uint32_t *ips, const int *ifaces,
+                  const int *accesses, const double *times, size_t n)
+{
+    char buffer[1 << 16];
+    size_t used = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (used + MAX_LINE > sizeof(buffer)) {
+            if (write_all(fd, buffer, used) < 0)
+                return -1;
+            used = 0;
+        }
+        if (format == OUTPUT_BINARY) {
+            ResultRecord record = {
+                .ip = ips[i],
+                .out_iface = ifaces[i],
+                .accesses = accesses[i],
+                .time = times[i],
+            };
+            memcpy(buffer + used, &record, sizeof(record));
+            used += sizeof(record);
+        } else {
+            used = format_line(buffer + used, ips[i], ifaces[i], accesses[i], times[i]) - buffer;
+        }
+    }
+    return write_all(fd, buffer, used);
+}
+
+static void *writer_thread(void *arg)
+{
+    ResultWriter *writer = arg;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->written == writer->ready && !writer->closing) {
+            /* Nothing to do until more results come: write what we have */
+            pthread_mutex_unlock(&writer->lock);
+            flush(writer);
+            pthread_mutex_lock(&writer->lock);
+            if (writer->written == writer->ready && !writer->closing)
+                pthread_cond_wait(&writer->more, &writer->lock);
+        }
+        size_t first = writer->written, last = writer->ready;
+        if (first == last && writer->closing)
+            break;
+        pthread_mutex_unlock(&writer->lock);
+        format_results(writer, first, last);
+        pthread_mutex_lock(&writer->lock);
+        writer->written = last;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    flush(writer);
+    return NULL;
+}
+
+/**********************************************************************
+ * Start the writer thread.
+ **********************************************************************/
+ResultWriter *writer_create(int fd, int echo_fd, OutputFormat format, const uint32_t *ips,
+                            const int *ifaces, const int *accesses, const double *times)
+{
+    ResultWriter *writer = calloc(1, sizeof(ResultWriter));
+    char *buffer = malloc(OUTPUT_BUFFER_SIZE);
+    if (!writer || !buffer) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    *writer = (ResultWriter) {
+        .fd = fd,
+        .echo_fd = format == OUTPUT_TEXT ? echo_fd : -1,
+        .format = format,
+        .ips = ips,
+        .ifaces = ifaces,
+        .accesses = accesses,
+        .times = times,
+        .buffer = buffer,
+    };
+    if (format == OUTPUT_BINARY) {
+        memcpy(writer->buffer, OUTPUT_BINARY_MAGIC, 8);
+        writer->used = 8;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->more, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_thread, writer)) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->more);
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**********************************************************************
+ * Make the results [0, count) available to the writer.
+ **********************************************************************/
+void writer_submit(ResultWriter *writer, size_t count)
+{
+    pthread_mutex_lock(&writer->lock);
+    if (count > writer->ready) {
+        writer->ready = count;
+        pthread_cond_signal(&writer->more);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**********************************************************************
+ * Write the results submitted so far and stop the thread.
+ **********************************************************************/
+int writer_close(ResultWriter *writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_signal(&writer->more);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    int result = writer->error ? -1 : 0;
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->more);
+    free(writer->buffer);
+    free(writer);
+    return result;
+}
@@ -0,0 +1,96 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_BINARY_MAGIC "RLRES001"
+
+/**********************************************************************
+ * OUTPUT FORMAT
+ *  - OUTPUT_TEXT: the lines of `printResultLine`,
+ *      a.b.c.d;iface|MISS;accesses;nsecs
+ *  - OUTPUT_BINARY: the 8 bytes of OUTPUT_BINARY_MAGIC, then one
+ *  ResultRecord per IP, in the byte order of the machine.
+ **********************************************************************/
+typedef enum {
+    OUTPUT_TEXT,
+    OUTPUT_BINARY,
+} OutputFormat;
+
+typedef struct {
+    uint32_t ip;
+    uint32_t out_iface;  // 0 means MISS
+    uint32_t accesses;
+    float time;          // nsecs
+} ResultRecord;
+
+/**********************************************************************
+ * RESULT WRITER
+ * Writes the results of the lookups from a background thread, so the
+ * formatting and the I/O overlap with the next lookups. The results are
+ * formatted by hand into a large buffer, which is written with `write`
+ * when it is full or when the thread runs out of results.
+ * Fields:
+ *  - fd, echo_fd: where the buffer is written. echo_fd is -1 for none.
+ *  - format: see OutputFormat.
+ *  - ips, ifaces, accesses, times: the results, in input order.
+ *  - ready: results [0, ready) can be written. Grows with
+ *  `writer_submit`.
+ *  - written: results already formatted.
+ *  - closing: no more results will be submitted.
+ *  - error: a write failed, the rest of the results are dropped.
+ *  - buffer, used: the formatted results not written yet.
+ *  - lock, more, thread: synchronization with the lookups.
+ **********************************************************************/
+typedef struct {
+    int fd;
+    int echo_fd;
+    OutputFormat format;
+    const uint32_t *ips;
+    const int *ifaces;
+    const int *accesses;
+    const double *times;
+    size_t ready;
+    size_t written;
+    int closing;
+    int error;
+    char *buffer;
+    size_t used;
+    pthread_mutex_t lock;
+    pthread_cond_t more;
+    pthread_t thread;
+} ResultWriter;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Start the writer thread. The result arrays must stay valid until
+ * `writer_close`, and the results are only read once submitted.
+ * Returns NULL if the thread could not be created.
+ **********************************************************************/
+ResultWriter *writer_create(int fd, int echo_fd, OutputFormat format, const uint32_t *ips,
+                            const int *ifaces, const int *accesses, const double *times);
+
+/**********************************************************************
+ * Make the results [0, count) available to the writer.
+ **********************************************************************/
+void writer_submit(ResultWriter *writer, size_t count);
+
+/**********************************************************************
+ * Write the results submitted so far, stop the thread and free the
+ * writer. The file descriptors are not closed.
+ * Returns 0, or -1 if a write failed.
+ **********************************************************************/
+int writer_close(ResultWriter *writer);
+
+/**********************************************************************
+ * Write n results to fd right away, from the calling thread, without
+ * the magic of OUTPUT_BINARY (e.g. to answer a stream).
+ * Returns 0, or -1 if the write failed.
+ **********************************************************************/
+int write_results(int fd, OutputFormat format, const uint32_t *ips, const int *ifaces,
+                  const int *accesses, const double *times, size_t n);
+
+#endif // OUTPUT_H
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pcap.h"
+
+#define PCAP_MAGIC 0xA1B2C3D4U           // Microsecond timestamps
+#define PCAP_MAGIC_NSEC 0xA1B23C4DU      // Nanosecond timestamps
+#define PCAPNG_SECTION 0x0A0D0D0AU       // Section Header Block, same in both byte orders
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4DU
+#define PCAPNG_INTERFACE 1
+#define PCAPNG_OBSOLETE_PACKET 2
+#define PCAPNG_SIMPLE_PACKET 3
+#define PCAPNG_ENHANCED_PACKET 6
+
+#define PCAP_HEADER 24
+#define PCAP_RECORD 16
+#define ETHERTYPE_IPV4 0x0800
+#define IPV4_HEADER 20
+
+/* Where the frames go, and how to read the numbers of the file */
+typedef struct {
+    uint32_t *ips;
+    size_t count;
+    size_t capacity;
+    size_t skipped;
+    int swapped;  // The file was written in the other byte order
+} Extractor;
+
+static uint32_t read32(const Extractor *extractor, const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return extractor->swapped ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t read16(const Extractor *extractor, const unsigned char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return extractor->swapped ? __builtin_bswap16(v) : v;
+}
+
+/* The numbers inside the frames are always big endian */
+#define be16(p) ((uint16_t)((p)[0] << 8 | (p)[1]))
+#define be32(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | (uint32_t)(p)[2] << 8 | (p)[3])
+
+/**********************************************************************
+ * Find the IPv4 destination of a frame.
+ * Returns 1 if there is one, 0 if the frame is not IPv4.
+ **********************************************************************/
+static int frame_destination(uint32_t linktype, const unsigned char *frame, size_t length,
+                             uint32_t *ip)
+{
+    size_t offset;
+    switch (linktype) {
+    case PCAP_LINKTYPE_ETHERNET: {
+        if (length < 14) return 0;
+        uint16_t type = be16(frame + 12);
+        offset = 14;
+        while (type == 0x8100 || type == 0x88A8 || type == 0x9100) {  // VLAN tags
+            if (length < offset + 4) return 0;
+            type = be16(frame + offset + 2);
+            offset += 4;
+        }
+        if (type != ETHERTYPE_IPV4) return 0;
+        break;
+    }
+    case PCAP_LINKTYPE_LINUX_SLL:
+        if (length < 16 || be16(frame + 14) != ETHERTYPE_IPV4) return 0;
+        offset = 16;
+        break;
+    case PCAP_LINKTYPE_RAW:
+    case PCAP_LINKTYPE_IPV4:
+        offset = 0;
+        break;
+    default:
+        return 0;
+    }
+    if (length < offset + IPV4_HEADER || frame[offset] >> 4 != 4)
+        return 0;
+    *ip = be32(frame + offset + 16);
+    return 1;
+}
+
+static void add_frame(Extractor *extractor, uint32_t linktype, const unsigned char *frame,
+                      size_t length)
+{
+    uint32_t ip;
+    if (!frame_destination(linktype, frame, length, &ip)) {
+        extractor->skipped += 1;
+        return;
+    }
+    if (extractor->count == extractor->capacity) {
+        extractor->capacity = extractor->capacity ? 2 * extractor->capacity : 4096;
+        uint32_t *ips = realloc(extractor->ips, extractor->capacity * sizeof(uint32_t));
+        if (!ips) {
+            fprintf(stderr, "Buy more RAM lol\n");
+            exit(1);
+        }
+        extractor->ips = ips;
+    }
+    extractor->ips[extractor->count++] = ip;
+}
+
+/* Classic pcap: a file header and then one record header per frame */
+static int extract_pcap(Extractor *extractor, const unsigned char *data, size_t size)
+{
+    if (size < PCAP_HEADER)
+        return -1;
+    uint32_t linktype = read32(extractor, data + 20) & 0x0FFFFFFF;  // The upper bits are FCS info
+    size_t offset = PCAP_HEADER;
+    while (offset < size) {
+        if (size - offset < PCAP_RECORD)
+            return -1;
+        uint32_t captured = read32(extractor, data + offset + 8);
+        offset += PCAP_RECORD;
+        if (captured > size - offset)
+            return -1;
+        add_frame(extractor, linktype, data + offset, captured);
+        offset += captured;
+    }
+    return 0;
+}
+
+/* pcapng: blocks, each section with its byte order and its interfaces */
+static int extract_pcapng(Extractor *extractor, const unsigned char *data, size_t size)
+{
+    uint32_t *linktypes = NULL;
+    size_t interfaces = 0, capacity = 0;
+    size_t offset = 0;
+    int result = 0;
+    while (offset < size && !result) {
+        if (size - offset < 12) {
+            result = -1;
+            break;
+        }
+        const unsigned char *block = data + offset;
+        uint32_t type;
+        memcpy(&type, block, 4);
+        if (type == PCAPNG_SECTION) {
+            uint32_t magic;
+            memcpy(&magic, block + 8, 4);
+            if (magic != PCAPNG_BYTE_ORDER && magic != __builtin_bswap32(PCAPNG_BYTE_ORDER)) {
+                result = -1;
+                break;
+            }
+            extractor->swapped = magic != PCAPNG_BYTE_ORDER;
+            interfaces = 0;  // Interface ids start again in every section
+        }
+        type = read32(extractor, block);
+        uint32_t length = read32(extractor, block + 4);
+        if (length < 12 || length % 4 || length > size - offset) {
+            result = -1;
+            break;
+        }
+        const unsigned char *body = block + 8;
+        size_t body_length = length - 12;
+        switch (type) {
+        case PCAPNG_INTERFACE:
+            if (body_length < 8) {
+                result = -1;
+                break;
+            }
+            if (interfaces == capacity) {
+                capacity = capacity ? 2 * capacity : 8;
+                uint32_t *more = realloc(linktypes, capacity * sizeof(uint32_t));
+                if (!more) {
+                    fprintf(stderr, "Buy more RAM lol\n");
+                    exit(1);
+                }
+                linktypes = more;
+            }
+            linktypes[interfaces++] = read16(extractor, body);
+            break;
+        case PCAPNG_ENHANCED_PACKET:
+        case PCAPNG_OBSOLETE_PACKET: {
+            if (body_length < 20) {
+                result = -1;
+                break;
+            }
+            uint32_t interface = type == PCAPNG_ENHANCED_PACKET ? read32(extractor, body)
+                                                                : read16(extractor, body);
+            uint32_t captured = read32(extractor, body + 12);
+            if (interface >= interfaces || captured > body_length - 20) {
+                result = -1;
+                break;
+            }
+            add_frame(extractor, linktypes[interface], body + 20, captured);
+            break;
+        }
+        case PCAPNG_SIMPLE_PACKET: {
+            if (body_length < 4 || !interfaces) {
+                result = -1;
+                break;
+            }
+            /* Only the original length is given, the frame may be cut by the snaplen */
+            size_t captured = read32(extractor, body);
+            if (captured > body_length - 4) captured = body_length - 4;
+            add_frame(extractor, linktypes[0], body + 4, captured);
+            break;
+        }
+        default:
+            break;  // Statistics, name resolution, custom blocks...
+        }
+        offset += length;
+    }
+    free(linktypes);
+    return result;
+}
+
+/**********************************************************************
+ * Check whether a mapped file is a capture.
+ **********************************************************************/
+int pcap_detect(const char *data, size_t size)
+{
+    if (size < 4)
+        return 0;
+    uint32_t magic;
+    memcpy(&magic, data, 4);
+    return magic == PCAP_MAGIC || magic == __builtin_bswap32(PCAP_MAGIC) ||
+           magic == PCAP_MAGIC_NSEC || magic == __builtin_bswap32(PCAP_MAGIC_NSEC) ||
+           magic == PCAPNG_SECTION;
+}
+
+/**********************************************************************
+ * Extract the IPv4 destination of every frame of a mapped capture.
+ **********************************************************************/
+int pcap_extract(const char *data, size_t size, uint32_t **ips, size_t *count, size_t *skipped)
+{
+    Extractor extractor = {0};
+    uint32_t magic;
+    memcpy(&magic, data, 4);
+    int result;
+    if (magic == PCAPNG_SECTION) {
+        result = extract_pcapng(&extractor, (const unsigned char *)data, size);
+    } else {
+        extractor.swapped = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC;
+        result = extract_pcap(&extractor, (const unsigned char *)data, size);
+    }
+    if (result < 0) {
+        free(extractor.ips);
+        *ips = NULL;
+        *count = *skipped = 0;
+        return -1;
+    }
+    /* Never NULL, like the IPs of a text trace */
+    *ips = realloc(extractor.ips, (extractor.count ? extractor.count : 1) * sizeof(uint32_t));
+    if (!*ips) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    *count = extractor.count;
+    *skipped = extractor.skipped;
+    return 0;
+}
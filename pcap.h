@@ -0,0 +1,34 @@
+#ifndef PCAP_H
+#define PCAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Link types of the frames that are understood */
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_LINKTYPE_RAW 101
+#define PCAP_LINKTYPE_LINUX_SLL 113
+#define PCAP_LINKTYPE_IPV4 228
+
+/**********************************************************************
+ * Check whether a mapped file is a capture (pcap, with microsecond or
+ * nanosecond timestamps in either byte order, or pcapng) rather than
+ * a text trace.
+ **********************************************************************/
+int pcap_detect(const char *data, size_t size);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Extract the IPv4 destination of every frame of a mapped capture, in
+ * capture order, parsing it in place (no libpcap). The frames can be
+ * Ethernet (with any number of 802.1Q/802.1ad tags), Linux cooked or
+ * raw IP. Frames that are not IPv4, or too short to hold the IPv4
+ * header, are skipped.
+ * Returns 0, or -1 if the capture is malformed or truncated.
+ * Args:
+ *  - uint32_t **ips, size_t *count: output parameters. Free *ips.
+ *  - size_t *skipped: output parameter, frames skipped.
+ **********************************************************************/
+int pcap_extract(const char *data, size_t size, uint32_t **ips, size_t *count, size_t *skipped);
+
+#endif // PCAP_H
@@ -0,0 +1,368 @@
+#include <stdlib.h>
+#include "poptrie.h"
+#include "utils.h"
+
+#define SLOTS (1 << POPTRIE_STRIDE)
+
+/* The 6 bits of `ip` from bit `pos` (0 is the MSB), padded with zeros past bit 31 */
+#define chunk(ip, pos) ((uint32_t)(((uint64_t)(ip) << 32 >> (64 - (pos) - POPTRIE_STRIDE)) & (SLOTS - 1)))
+
+/* Slots 0..s of a bitmap */
+#define up_to(s) ((2ULL << (s)) - 1)
+
+typedef struct {
+    Poptrie *trie;
+    uint32_t node_capacity;
+    uint32_t leaf_capacity;
+} Builder;
+
+static void *poptrie_realloc(void *ptr, size_t size)
+{
+    void *new = realloc(ptr, size);
+    if (!new) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    return new;
+}
+
+/* Reserve `count` contiguous nodes. Returns the first one */
+static uint32_t reserve_nodes(Builder *builder, uint32_t count)
+{
+    Poptrie *trie = builder->trie;
+    while (trie->node_count + count > builder->node_capacity) {
+        builder->node_capacity = builder->node_capacity ? 2 * builder->node_capacity : 1024;
+        trie->nodes = poptrie_realloc(trie->nodes, builder->node_capacity * sizeof(PoptrieNode));
+    }
+    uint32_t first = trie->node_count;
+    trie->node_count += count;
+    return first;
+}
+
+static void append_leaf(Builder *builder, uint16_t out_iface)
+{
+    Poptrie *trie = builder->trie;
+    if (trie->leaf_count == builder->leaf_capacity) {
+        builder->leaf_capacity = builder->leaf_capacity ? 2 * builder->leaf_capacity : 1024;
+        trie->leaves = poptrie_realloc(trie->leaves, builder->leaf_capacity * sizeof(uint16_t));
+    }
+    trie->leaves[trie->leaf_count++] = out_iface;
+}
+
+/**********************************************************************
+ * Walk the Patricia trie down to the region prefix/length.
+ * Returns a node strictly inside the region, from which the longer
+ * prefixes of the region can be reached, or NULL if there is none and
+ * the whole region goes to *best.
+ * Args:
+ *  - const Node *node: where to start, a node no longer than the region
+ *  or inside it.
+ *  - int *best: in/out, next hop of the longest prefix containing the
+ *  region.
+ **********************************************************************/
+static const Node *descend(const Node *node, uint32_t prefix, int length, int *best)
+{
+    while (node) {
+        uint32_t mask = node->prefix_length < length ? node->prefix_length : length;
+        mask = mask ? 0xFFFFFFFFU << (32 - mask) : 0;
+        if ((node->prefix ^ prefix) & mask)
+            return NULL;
+        if (node->prefix_length > length)
+            return node;
+        if (node->out_iface != NO_IFACE)
+            *best = node->out_iface;
+        if (node->prefix_length == length)
+            return node->left || node->right ? node : NULL;
+        node = node->child[(prefix >> (31 - node->prefix_length)) & 1];
+    }
+    return NULL;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Fill the node `index`, covering the region prefix/pos, and then its
+ * children.
+ * Args:
+ *  - const Node *from: where to start the walks of `descend`.
+ *  - int best: next hop of the longest prefix containing the region.
+ **********************************************************************/
+static void build(Builder *builder, uint32_t index, uint32_t prefix, int pos,
+                  const Node *from, int best)
+{
+    const Node *inside[SLOTS];
+    int leaf[SLOTS];
+    int length = pos + POPTRIE_STRIDE < 32 ? pos + POPTRIE_STRIDE : 32;
+    uint64_t vector = 0, leafvec = 0;
+    uint32_t children = 0;
+    for (int s = 0; s < SLOTS; ++s) {
+        uint32_t region = prefix | (uint32_t)(((uint64_t)s << (32 - POPTRIE_STRIDE)) >> pos);
+        leaf[s] = best;
+        inside[s] = descend(from, region, length, &leaf[s]);
+        if (inside[s]) {
+            vector |= 1ULL << s;
+            children += 1;
+        }
+    }
+
+    uint32_t base0 = builder->trie->leaf_count;
+    int previous = -1;
+    for (int s = 0; s < SLOTS; ++s) {
+        if (inside[s] || leaf[s] == previous)
+            continue;
+        leafvec |= 1ULL << s;
+        append_leaf(builder, leaf[s]);
+        previous = leaf[s];
+    }
+    uint32_t base1 = children ? reserve_nodes(builder, children) : 0;
+    builder->trie->nodes[index] = (PoptrieNode) {
+        .vector = vector,
+        .leafvec = leafvec,
+        .base0 = base0,
+        .base1 = base1,
+    };
+
+    uint32_t child = base1;
+    for (int s = 0; s < SLOTS; ++s) {
+        if (!inside[s]) continue;
+        uint32_t region = prefix | (uint32_t)(((uint64_t)s << (32 - POPTRIE_STRIDE)) >> pos);
+        build(builder, child++, region, pos + POPTRIE_STRIDE, inside[s], leaf[s]);
+    }
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Check that every next hop fits in a leaf.
+ **********************************************************************/
+static int check_ifaces(const Node *node)
+{
+    if (!node) return 0;
+    if (node->out_iface < 0 || node->out_iface > POPTRIE_MAX_IFACE) {
+        fprintf(stderr, "ERROR: output interface %d does not fit in a Poptrie leaf\n", node->out_iface);
+        return -1;
+    }
+    if (check_ifaces(node->left) < 0) return -1;
+    return check_ifaces(node->right);
+}
+
+/**********************************************************************
+ * Build a Poptrie from a (compressed) Patricia trie.
+ **********************************************************************/
+Poptrie *poptrie_create(Node *root)
+{
+    if (check_ifaces(root) < 0)
+        return NULL;
+    Poptrie *trie = calloc(1, sizeof(Poptrie));
+    if (!trie) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    Builder builder = { .trie = trie };
+    reserve_nodes(&builder, 1);
+    build(&builder, 0, 0, 0, root, NO_IFACE);
+    /* Give back the room left by the doublings */
+    trie->nodes = poptrie_realloc(trie->nodes, trie->node_count * sizeof(PoptrieNode));
+    trie->leaves = poptrie_realloc(trie->leaves, trie->leaf_count * sizeof(uint16_t));
+    return trie;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one.
+ **********************************************************************/
+int poptrie_lookup(const Poptrie *trie, uint32_t ip, int *accesses)
+{
+    const PoptrieNode *node = &trie->nodes[0];
+    int pos = 0;
+    uint32_t s = chunk(ip, pos);
+    *accesses += 1;
+    while (node->vector >> s & 1) {
+        node = &trie->nodes[node->base1 + __builtin_popcountll(node->vector & up_to(s)) - 1];
+        pos += POPTRIE_STRIDE;
+        s = chunk(ip, pos);
+        *accesses += 1;
+    }
+    *accesses += 1;
+    return trie->leaves[node->base0 + __builtin_popcountll(node->leafvec & up_to(s)) - 1];
+}
+
+/* IPv6: same nodes and leaves, over 128-bit keys */
+
+/* The 6 bits of `ip` from bit `pos`, padded with zeros past bit 127 */
+static inline uint32_t chunk6(Ip6 ip, int pos)
+{
+    if (pos + POPTRIE_STRIDE <= IP6_LENGTH)
+        return (uint32_t)(ip >> (IP6_LENGTH - pos - POPTRIE_STRIDE)) & (SLOTS - 1);
+    return (uint32_t)(ip << (pos + POPTRIE_STRIDE - IP6_LENGTH)) & (SLOTS - 1);
+}
+
+/* Same as `descend`, on the IPv6 trie */
+static const Node6 *descend6(const Node6 *node, Ip6 prefix, int length, int *best)
+{
+    while (node) {
+        int common = node->prefix_length < length ? node->prefix_length : length;
+        if ((node->prefix ^ prefix) & ip6_mask(common))
+            return NULL;
+        if (node->prefix_length > length)
+            return node;
+        if (node->out_iface != NO_IFACE)
+            *best = node->out_iface;
+        if (node->prefix_length == length)
+            return node->child[0] || node->child[1] ? node : NULL;
+        node = node->child[ip6_bit(prefix, node->prefix_length)];
+    }
+    return NULL;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Same as `build`, on the IPv6 trie.
+ **********************************************************************/
+static void build6(Builder *builder, uint32_t index, Ip6 prefix, int pos, const Node6 *from,
+                   int best)
+{
+    const Node6 *inside[SLOTS];
+    int leaf[SLOTS];
+    int length = pos + POPTRIE_STRIDE < IP6_LENGTH ? pos + POPTRIE_STRIDE : IP6_LENGTH;
+    uint64_t vector = 0, leafvec = 0;
+    uint32_t children = 0;
+    for (int s = 0; s < SLOTS; ++s) {
+        Ip6 region = prefix | ((Ip6)s << (IP6_LENGTH - POPTRIE_STRIDE)) >> pos;
+        leaf[s] = best;
+        inside[s] = descend6(from, region, length, &leaf[s]);
+        if (inside[s]) {
+            vector |= 1ULL << s;
+            children += 1;
+        }
+    }
+
+    uint32_t base0 = builder->trie->leaf_count;
+    int previous = -1;
+    for (int s = 0; s < SLOTS; ++s) {
+        if (inside[s] || leaf[s] == previous)
+            continue;
+        leafvec |= 1ULL << s;
+        append_leaf(builder, leaf[s]);
+        previous = leaf[s];
+    }
+    uint32_t base1 = children ? reserve_nodes(builder, children) : 0;
+    builder->trie->nodes[index] = (PoptrieNode) {
+        .vector = vector,
+        .leafvec = leafvec,
+        .base0 = base0,
+        .base1 = base1,
+    };
+
+    uint32_t child = base1;
+    for (int s = 0; s < SLOTS; ++s) {
+        if (!inside[s]) continue;
+        Ip6 region = prefix | ((Ip6)s << (IP6_LENGTH - POPTRIE_STRIDE)) >> pos;
+        build6(builder, child++, region, pos + POPTRIE_STRIDE, inside[s], leaf[s]);
+    }
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Check that every next hop of the IPv6 trie fits in a leaf.
+ **********************************************************************/
+static int check_ifaces6(const Node6 *node)
+{
+    if (!node) return 0;
+    if (node->out_iface < 0 || node->out_iface > POPTRIE_MAX_IFACE) {
+        fprintf(stderr, "ERROR: output interface %d does not fit in a Poptrie leaf\n", node->out_iface);
+        return -1;
+    }
+    if (check_ifaces6(node->child[0]) < 0) return -1;
+    return check_ifaces6(node->child[1]);
+}
+
+/**********************************************************************
+ * Build a Poptrie from the IPv6 Patricia trie.
+ **********************************************************************/
+Poptrie *poptrie6_create(const Node6 *root)
+{
+    if (check_ifaces6(root) < 0)
+        return NULL;
+    Poptrie *trie = calloc(1, sizeof(Poptrie));
+    if (!trie) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    Builder builder = { .trie = trie };
+    reserve_nodes(&builder, 1);
+    build6(&builder, 0, 0, 0, root, NO_IFACE);
+    trie->nodes = poptrie_realloc(trie->nodes, trie->node_count * sizeof(PoptrieNode));
+    trie->leaves = poptrie_realloc(trie->leaves, trie->leaf_count * sizeof(uint16_t));
+    return trie;
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IPv6 address.
+ **********************************************************************/
+int poptrie6_lookup(const Poptrie *trie, Ip6 ip, int *accesses)
+{
+    const PoptrieNode *node = &trie->nodes[0];
+    int pos = 0;
+    uint32_t s = chunk6(ip, pos);
+    *accesses += 1;
+    while (node->vector >> s & 1) {
+        node = &trie->nodes[node->base1 + __builtin_popcountll(node->vector & up_to(s)) - 1];
+        pos += POPTRIE_STRIDE;
+        s = chunk6(ip, pos);
+        *accesses += 1;
+    }
+    *accesses += 1;
+    return trie->leaves[node->base0 + __builtin_popcountll(node->leafvec & up_to(s)) - 1];
+}
+
+/**********************************************************************
+ * Check the children and leaves of a Poptrie read from a snapshot. The
+ * children are reserved after their parent, so the depth of every node
+ * is known once the nodes before it are checked.
+ **********************************************************************/
+int poptrie_validate(const Poptrie *trie)
+{
+    const int levels = (IP_ADDRESS_LENGTH + POPTRIE_STRIDE - 1) / POPTRIE_STRIDE;
+    if (!trie->node_count)
+        return -1;
+    uint8_t *depth = calloc(trie->node_count, sizeof(uint8_t));
+    if (!depth) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    int result = 0;
+    for (uint32_t i = 0; i < trie->node_count; ++i) {
+        const PoptrieNode *node = &trie->nodes[i];
+        uint64_t children = __builtin_popcountll(node->vector);
+        /* The first slot without a child must have a leaf, the next ones reuse it */
+        if (~node->vector && !(node->leafvec & up_to(__builtin_ctzll(~node->vector)))) {
+            result = -1;
+            break;
+        }
+        if ((uint64_t)node->base0 + __builtin_popcountll(node->leafvec) > trie->leaf_count) {
+            result = -1;
+            break;
+        }
+        if (!children)
+            continue;
+        if (depth[i] + 1 >= levels || node->base1 <= i || (uint64_t)node->base1 + children > trie->node_count) {
+            result = -1;
+            break;
+        }
+        for (uint32_t child = node->base1; child < node->base1 + children; ++child)
+            if (depth[child] < depth[i] + 1)
+                depth[child] = depth[i] + 1;
+    }
+    free(depth);
+    return result;
+}
+
+/**********************************************************************
+ * Free the Poptrie.
+ **********************************************************************/
+void poptrie_free(Poptrie *trie)
+{
+    if (!trie) return;
+    free(trie->nodes);
+    free(trie->leaves);
+    free(trie);
+}
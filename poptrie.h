@@ -0,0 +1,100 @@
+#ifndef POPTRIE_H
+#define POPTRIE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "node.h"
+#include "node6.h"
+
+#define POPTRIE_STRIDE 6
+#define POPTRIE_MAX_IFACE UINT16_MAX
+
+/**********************************************************************
+ * POPTRIE NODE (Asai & Ohara)
+ * A multibit node consumes POPTRIE_STRIDE bits of the IP, which choose
+ * one of its 64 slots. A slot holds either a child node or a leaf.
+ * Fields:
+ *  - vector: bit s is set if slot s is a child node.
+ *  - leafvec: bit s is set if slot s is a leaf whose next hop differs
+ *  from the previous leaf of the node. Leaves with the same next hop
+ *  in a row are stored once.
+ *  - base0: index of the first leaf of the node in the leaf array.
+ *  - base1: index of the first child of the node in the node array.
+ * The child of slot s is nodes[base1 + popcount(vector & bits 0..s) - 1]
+ * and a leaf is leaves[base0 + popcount(leafvec & bits 0..s) - 1].
+ **********************************************************************/
+typedef struct {
+    uint64_t vector;
+    uint64_t leafvec;
+    uint32_t base0;
+    uint32_t base1;
+} PoptrieNode;
+
+/**********************************************************************
+ * POPTRIE
+ * The IP is consumed in strides of 6 bits (the last one only has 2,
+ * padded with zeros), so a lookup reads at most 6 nodes and a leaf.
+ * Fields:
+ *  - nodes: the multibit nodes, the root is nodes[0]. The children of
+ *  a node are contiguous.
+ *  - leaves: the next hops, the leaves of a node are contiguous.
+ *  - node_count, leaf_count: size of the arrays.
+ **********************************************************************/
+typedef struct {
+    PoptrieNode *nodes;
+    uint16_t *leaves;
+    uint32_t node_count;
+    uint32_t leaf_count;
+} Poptrie;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Build a Poptrie from a (compressed) Patricia trie, pushing the next
+ * hops down to the leaves. Returns NULL if a next hop does not fit in a
+ * leaf.
+ * Args:
+ *  - Node *root: the root of the Patricia trie. It is not modified.
+ **********************************************************************/
+Poptrie *poptrie_create(Node *root);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP. Returns 0 if it
+ * did not find one.
+ * Args:
+ *  - const Poptrie *trie: the Poptrie.
+ *  - uint32_t ip: the IP for which to look up a next hop.
+ *  - int *accesses: variable declared outside the function to keep
+ *  track of the number of memory acesses (nodes and the leaf).
+ **********************************************************************/
+int poptrie_lookup(const Poptrie *trie, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Same as `poptrie_create`, from the IPv6 Patricia trie. The address
+ * is consumed in strides of 6 bits as well (the last one only has 2),
+ * so a lookup reads at most 22 nodes, and as many as the longest
+ * prefix needs: 8 for a /48.
+ **********************************************************************/
+Poptrie *poptrie6_create(const Node6 *root);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IPv6 address. Same contract
+ * as `poptrie_lookup`.
+ **********************************************************************/
+int poptrie6_lookup(const Poptrie *trie, Ip6 ip, int *accesses);
+
+/**********************************************************************
+ * Check that the children and the leaves of every node are inside their
+ * arrays, every slot without a child has a leaf, the children come
+ * after their parent and no path is deeper than the strides of an IPv4
+ * address, so a Poptrie read from a snapshot cannot make a lookup read
+ * out of bounds or loop. Returns 0, or -1 if it is broken.
+ **********************************************************************/
+int poptrie_validate(const Poptrie *trie);
+
+/**********************************************************************
+ * Free the Poptrie.
+ **********************************************************************/
+void poptrie_free(Poptrie *trie);
+
+#endif // POPTRIE_H
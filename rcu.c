@@ -0,0 +1,364 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdlib.h>
+#include <sched.h>
+#include "rcu.h"
+
+/**********************************************************************
+ * Epochs. global_epoch grows every time a new root is published. A
+ * reader stores the epoch it started in its own slot (0 when it is not
+ * reading), so nodes retired in epoch E can be reclaimed once no slot
+ * holds an epoch <= E. A thread takes a free slot on its first read and
+ * gives it back when it exits (see `release_slot`), so only the threads
+ * alive at the same time count against RCU_MAX_READERS. The slots are
+ * padded to avoid false sharing between reader threads.
+ **********************************************************************/
+typedef struct {
+    _Atomic uint64_t epoch;
+    atomic_int taken;
+    char padding[64 - sizeof(uint64_t) - sizeof(atomic_int)];
+} ReaderSlot;
+
+static _Atomic uint64_t global_epoch = 1;
+static ReaderSlot readers[RCU_MAX_READERS];
+static _Atomic int reader_count = 0;  // Slots ever taken, the reclamation looks at [0, reader_count)
+static _Thread_local int reader_slot = -1;
+static pthread_key_t reader_key;
+static pthread_once_t reader_key_once = PTHREAD_ONCE_INIT;
+
+/* Destructor of reader_key: the thread exits, its slot is free again */
+static void release_slot(void *slot)
+{
+    ReaderSlot *reader = slot;
+    atomic_store(&reader->epoch, 0);
+    atomic_store(&reader->taken, 0);
+}
+
+static void create_reader_key(void)
+{
+    if (pthread_key_create(&reader_key, release_slot)) {
+        fprintf(stderr, "ERROR: could not create the RCU reader key\n");
+        exit(1);
+    }
+}
+
+/* Take the first free slot for the calling thread */
+static int take_slot(void)
+{
+    pthread_once(&reader_key_once, create_reader_key);
+    for (int i = 0; i < RCU_MAX_READERS; ++i) {
+        int free_slot = 0;
+        if (!atomic_compare_exchange_strong(&readers[i].taken, &free_slot, 1))
+            continue;
+        int count = atomic_load(&reader_count);
+        while (count <= i && !atomic_compare_exchange_weak(&reader_count, &count, i + 1))
+            ;
+        pthread_setspecific(reader_key, &readers[i]);
+        return i;
+    }
+    fprintf(stderr, "ERROR: more than %d RCU reader threads at once\n", RCU_MAX_READERS);
+    exit(1);
+}
+
+#define netmask(length) ((length) ? 0xFFFFFFFFU << (32 - (length)) : 0)
+#define bit_at(prefix, pos) (((prefix) >> (31 - (pos))) & 1)
+
+/* Length of the common prefix of two prefixes */
+static int common_length(uint32_t a, int a_length, uint32_t b, int b_length)
+{
+    int common = a ^ b ? __builtin_clz(a ^ b) : 32;
+    if (common > a_length) common = a_length;
+    if (common > b_length) common = b_length;
+    return common;
+}
+
+/**********************************************************************
+ * Wrap a compressed trie.
+ **********************************************************************/
+RcuTrie *rcu_create(Node *root)
+{
+    RcuTrie *trie = calloc(1, sizeof(RcuTrie));
+    if (!trie) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    atomic_init(&trie->root, root);
+    atomic_init(&trie->generation, 0);
+    pthread_mutex_init(&trie->writer, NULL);
+    return trie;
+}
+
+/**********************************************************************
+ * Mark the calling thread as reading the trie.
+ **********************************************************************/
+void rcu_read_lock(void)
+{
+    if (reader_slot < 0)
+        reader_slot = take_slot();
+    atomic_store(&readers[reader_slot].epoch, atomic_load(&global_epoch));
+}
+
+void rcu_read_unlock(void)
+{
+    atomic_store(&readers[reader_slot].epoch, 0);
+}
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP, in the current version
+ * of the trie.
+ **********************************************************************/
+int rcu_lookup(RcuTrie *trie, uint32_t ip, int *accesses)
+{
+    rcu_read_lock();
+    int iface = lookup(atomic_load(&trie->root), ip, accesses);
+    rcu_read_unlock();
+    return iface;
+}
+
+/**********************************************************************
+ * Look up a batch of IPs in the same version of the trie.
+ **********************************************************************/
+void rcu_lookup_batch(RcuTrie *trie, const uint32_t *ips, int *ifaces, int *accesses, size_t n)
+{
+    rcu_read_lock();
+    Node *root = atomic_load(&trie->root);
+    if (root) {
+        lookup_batch(root, ips, ifaces, accesses, n);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            ifaces[i] = NO_IFACE;
+            accesses[i] = 0;
+        }
+    }
+    rcu_read_unlock();
+}
+
+/* Keep a replaced node until it can be reclaimed. Its epoch is set on publish */
+static void retire(RcuTrie *trie, Node *node)
+{
+    if (trie->retired_size == trie->retired_capacity) {
+        trie->retired_capacity = trie->retired_capacity ? 2 * trie->retired_capacity : 256;
+        trie->retired = realloc(trie->retired, trie->retired_capacity * sizeof(Node *));
+        trie->retired_epochs = realloc(trie->retired_epochs, trie->retired_capacity * sizeof(uint64_t));
+        if (!trie->retired || !trie->retired_epochs) {
+            fprintf(stderr, "Buy more RAM lol\n");
+            exit(1);
+        }
+    }
+    trie->retired[trie->retired_size++] = node;
+}
+
+static Node *copy_node(RcuTrie *trie, Node *node)
+{
+    Node *copy = node_alloc();
+    *copy = *node;
+    retire(trie, node);
+    return copy;
+}
+
+static Node *new_node(uint32_t prefix, int prefix_length, int out_iface)
+{
+    Node *node = node_alloc();
+    node->prefix = prefix & netmask(prefix_length);
+    node->prefix_length = prefix_length;
+    node->bit_shift = node_bit_shift(prefix_length);
+    node->out_iface = out_iface;
+    return node;
+}
+
+/* Find the node of a route. Returns NULL if the route does not exist */
+static Node *find_route(Node *node, uint32_t prefix, int prefix_length)
+{
+    while (node && node->prefix_length <= prefix_length &&
+           common_length(node->prefix, node->prefix_length, prefix, prefix_length) == node->prefix_length) {
+        if (node->prefix_length == prefix_length)
+            return node->out_iface != NO_IFACE ? node : NULL;
+        node = bit_at(prefix, node->prefix_length) ? node->right : node->left;
+    }
+    return NULL;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Copy-on-write insertion in a compressed trie. Same as `insert_node`,
+ * but the nodes on the path are copied, and only the node of the route
+ * and, if two prefixes diverge, the node where they split are created,
+ * so the path stays compressed. Returns the new root of the subtree.
+ **********************************************************************/
+static Node *cow_insert(RcuTrie *trie, Node *node, uint32_t prefix, int prefix_length, int out_iface)
+{
+    if (!node)
+        return new_node(prefix, prefix_length, out_iface);
+
+    int common = common_length(node->prefix, node->prefix_length, prefix, prefix_length);
+    if (common == node->prefix_length) {
+        Node *copy = copy_node(trie, node);
+        if (prefix_length == node->prefix_length)
+            copy->out_iface = out_iface;
+        else if (bit_at(prefix, node->prefix_length))
+            copy->right = cow_insert(trie, node->right, prefix, prefix_length, out_iface);
+        else
+            copy->left = cow_insert(trie, node->left, prefix, prefix_length, out_iface);
+        return copy;
+    }
+
+    /* The route is above the node, or they diverge: new node in between */
+    Node *parent = new_node(prefix, common, NO_IFACE);
+    Node *child = node;
+    if (common == prefix_length)
+        parent->out_iface = out_iface;
+    else if (bit_at(prefix, common))
+        parent->right = new_node(prefix, prefix_length, out_iface);
+    else
+        parent->left = new_node(prefix, prefix_length, out_iface);
+    if (bit_at(node->prefix, common))
+        parent->right = child;
+    else
+        parent->left = child;
+    return parent;
+}
+
+/**********************************************************************
+ * RECURSIVE FUNCTION
+ * Copy-on-write deletion of an existing route. The nodes left without
+ * next hop and with a single subtree are removed on the way back, which
+ * is all the recompression the path needs. Returns the new root of the
+ * subtree.
+ **********************************************************************/
+static Node *cow_delete(RcuTrie *trie, Node *node, uint32_t prefix, int prefix_length)
+{
+    if (node->prefix_length == prefix_length) {
+        if (node->left && node->right) {
+            Node *copy = copy_node(trie, node);
+            copy->out_iface = NO_IFACE;
+            return copy;
+        }
+        retire(trie, node);
+        return node->left ? node->left : node->right;
+    }
+
+    int right = bit_at(prefix, node->prefix_length);
+    Node *child = cow_delete(trie, right ? node->right : node->left, prefix, prefix_length);
+    Node *sibling = right ? node->left : node->right;
+    if (!child && node->out_iface == NO_IFACE) {
+        retire(trie, node);
+        return sibling;
+    }
+    Node *copy = copy_node(trie, node);
+    if (right) copy->right = child;
+    else copy->left = child;
+    return copy;
+}
+
+/* Publish a new root, and tag the nodes it replaced with the current epoch */
+static void publish(RcuTrie *trie, Node *root, size_t first_retired)
+{
+    atomic_store(&trie->root, root);
+    atomic_fetch_add(&trie->generation, 1);  // After the root: a reader of the new generation sees it
+    uint64_t epoch = atomic_fetch_add(&global_epoch, 1);
+    for (size_t i = first_retired; i < trie->retired_size; ++i)
+        trie->retired_epochs[i] = epoch;
+    rcu_reclaim(trie, 0);
+}
+
+/**********************************************************************
+ * Add a route, or change its next hop if it already exists.
+ **********************************************************************/
+int route_add(RcuTrie *trie, uint32_t prefix, int prefix_length, int out_iface)
+{
+    pthread_mutex_lock(&trie->writer);
+    size_t first_retired = trie->retired_size;
+    Node *root = cow_insert(trie, atomic_load(&trie->root), prefix & netmask(prefix_length),
+                            prefix_length, out_iface);
+    publish(trie, root, first_retired);
+    pthread_mutex_unlock(&trie->writer);
+    return 0;
+}
+
+/**********************************************************************
+ * Delete a route.
+ **********************************************************************/
+int route_del(RcuTrie *trie, uint32_t prefix, int prefix_length)
+{
+    pthread_mutex_lock(&trie->writer);
+    prefix &= netmask(prefix_length);
+    Node *root = atomic_load(&trie->root);
+    if (!find_route(root, prefix, prefix_length)) {
+        pthread_mutex_unlock(&trie->writer);
+        return -1;
+    }
+    size_t first_retired = trie->retired_size;
+    publish(trie, cow_delete(trie, root, prefix, prefix_length), first_retired);
+    pthread_mutex_unlock(&trie->writer);
+    return 0;
+}
+
+/**********************************************************************
+ * Change the next hop of a route.
+ **********************************************************************/
+int route_modify(RcuTrie *trie, uint32_t prefix, int prefix_length, int out_iface)
+{
+    pthread_mutex_lock(&trie->writer);
+    prefix &= netmask(prefix_length);
+    Node *root = atomic_load(&trie->root);
+    if (!find_route(root, prefix, prefix_length)) {
+        pthread_mutex_unlock(&trie->writer);
+        return -1;
+    }
+    size_t first_retired = trie->retired_size;
+    publish(trie, cow_insert(trie, root, prefix, prefix_length, out_iface), first_retired);
+    pthread_mutex_unlock(&trie->writer);
+    return 0;
+}
+
+/* Oldest epoch a reader is still in, or UINT64_MAX if none is reading */
+static uint64_t oldest_reader(void)
+{
+    uint64_t oldest = UINT64_MAX;
+    int count = atomic_load(&reader_count);
+    for (int i = 0; i < count; ++i) {
+        if (!atomic_load(&readers[i].taken))
+            continue;  // Its thread is gone
+        uint64_t epoch = atomic_load(&readers[i].epoch);
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+    return oldest;
+}
+
+/**********************************************************************
+ * Give back to the node pool the retired nodes no reader can see.
+ * The retired nodes are sorted by epoch.
+ **********************************************************************/
+void rcu_reclaim(RcuTrie *trie, int wait)
+{
+    size_t reclaimed = 0;
+    for (;;) {
+        uint64_t oldest = oldest_reader();
+        while (reclaimed < trie->retired_size && trie->retired_epochs[reclaimed] < oldest)
+            node_release(trie->retired[reclaimed++]);
+        if (!wait || reclaimed == trie->retired_size)
+            break;
+        sched_yield();
+    }
+    trie->retired_size -= reclaimed;
+    for (size_t i = 0; i < trie->retired_size; ++i) {
+        trie->retired[i] = trie->retired[reclaimed + i];
+        trie->retired_epochs[i] = trie->retired_epochs[reclaimed + i];
+    }
+}
+
+/**********************************************************************
+ * Free the wrapper and the retired nodes.
+ **********************************************************************/
+void rcu_free(RcuTrie *trie)
+{
+    if (!trie) return;
+    for (size_t i = 0; i < trie->retired_size; ++i)
+        node_release(trie->retired[i]);
+    pthread_mutex_destroy(&trie->writer);
+    free(trie->retired);
+    free(trie->retired_epochs);
+    free(trie);
+}
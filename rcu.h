@@ -0,0 +1,95 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "node.h"
+
+#define RCU_MAX_READERS 256  // Reader threads alive at the same time
+
+/**********************************************************************
+ * RCU TRIE
+ * A compressed Patricia trie that can be updated while other threads
+ * look it up. Lookups never take a lock: they read the current root.
+ * Updates copy the nodes of the path they change (the rest of the trie
+ * is shared), keep that path compressed and publish the new root with
+ * a single atomic store. The replaced nodes are given back to the node
+ * pool once every reader that could have seen them is done
+ * (epoch-based reclamation).
+ * Fields:
+ *  - root: the current root. NULL if the trie is empty.
+ *  - generation: grows after every new root is published, so caches
+ *  of lookup results can tell they are stale (see cache.h).
+ *  - writer: serializes the updates.
+ *  - retired, retired_epochs, retired_size, retired_capacity: nodes
+ *  waiting to be reclaimed, and the epoch in which they were replaced.
+ **********************************************************************/
+typedef struct {
+    _Atomic(Node *) root;
+    _Atomic uint32_t generation;
+    pthread_mutex_t writer;
+    Node **retired;
+    uint64_t *retired_epochs;
+    size_t retired_size;
+    size_t retired_capacity;
+} RcuTrie;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Wrap a compressed trie (see `compress_trie`). The nodes still belong
+ * to the node pool.
+ **********************************************************************/
+RcuTrie *rcu_create(Node *root);
+
+/**********************************************************************
+ * Mark the calling thread as reading the trie, until `rcu_read_unlock`.
+ * Nodes read in between are not reclaimed. Never blocks. The first
+ * call of a thread takes one of the RCU_MAX_READERS reader slots, given
+ * back when the thread exits.
+ **********************************************************************/
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+/**********************************************************************
+ * Look up the next hop corresponding to an IP, in the current version
+ * of the trie. Same contract as `lookup`.
+ **********************************************************************/
+int rcu_lookup(RcuTrie *trie, uint32_t ip, int *accesses);
+
+/**********************************************************************
+ * Look up a batch of IPs in the same version of the trie. Same contract
+ * as `lookup_batch`.
+ **********************************************************************/
+void rcu_lookup_batch(RcuTrie *trie, const uint32_t *ips, int *ifaces, int *accesses, size_t n);
+
+/**********************************************************************
+ * Add a route, or change its next hop if it already exists.
+ * Returns 0.
+ **********************************************************************/
+int route_add(RcuTrie *trie, uint32_t prefix, int prefix_length, int out_iface);
+
+/**********************************************************************
+ * Delete a route. Returns 0, or -1 if it does not exist.
+ **********************************************************************/
+int route_del(RcuTrie *trie, uint32_t prefix, int prefix_length);
+
+/**********************************************************************
+ * Change the next hop of a route. Returns 0, or -1 if it does not exist.
+ **********************************************************************/
+int route_modify(RcuTrie *trie, uint32_t prefix, int prefix_length, int out_iface);
+
+/**********************************************************************
+ * Give back to the node pool the retired nodes no reader can see.
+ * If `wait` is not 0, wait until all of them can be reclaimed.
+ **********************************************************************/
+void rcu_reclaim(RcuTrie *trie, int wait);
+
+/**********************************************************************
+ * Free the wrapper and the retired nodes. No thread may be reading.
+ * The nodes of the trie stay in the node pool.
+ **********************************************************************/
+void rcu_free(RcuTrie *trie);
+
+#endif // RCU_H
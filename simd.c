@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "simd.h"
+#if SIMD_HAS_X86
+#include <immintrin.h>
+#endif
+
+SimdKernel simd_kernel = SIMD_AUTO;
+
+static const char *const kernel_names[] = {
+    [SIMD_SCALAR] = "scalar",
+    [SIMD_AVX2] = "avx2",
+    [SIMD_AVX512] = "avx512",
+    [SIMD_AUTO] = "auto",
+};
+
+/* The kernels read a frozen node as four 32-bit words (x86 is little endian) */
+#define WORD_PREFIX 0
+#define WORD_CHILD 1
+#define WORD_META 3  // out_iface in the low 16 bits, prefix_length in the next 8
+_Static_assert(sizeof(FrozenNode) == 16, "a frozen node must be four words");
+_Static_assert(offsetof(FrozenNode, child) == 4 * WORD_CHILD, "bad child offset");
+_Static_assert(offsetof(FrozenNode, out_iface) == 4 * WORD_META, "bad out_iface offset");
+_Static_assert(offsetof(FrozenNode, prefix_length) == 4 * WORD_META + 2, "bad prefix_length offset");
+
+static int kernel_supported(SimdKernel kernel)
+{
+#if SIMD_HAS_X86
+    __builtin_cpu_init();
+    switch (kernel) {
+    case SIMD_AVX2: return __builtin_cpu_supports("avx2");
+    case SIMD_AVX512: return __builtin_cpu_supports("avx512f");
+    default: return kernel == SIMD_SCALAR;
+    }
+#else
+    return kernel == SIMD_SCALAR;
+#endif
+}
+
+/**********************************************************************
+ * Choose the kernel.
+ **********************************************************************/
+SimdKernel simd_init(SimdKernel requested)
+{
+    SimdKernel kernel = requested == SIMD_AUTO ? SIMD_AVX512 : requested;
+    while (kernel != SIMD_SCALAR && !kernel_supported(kernel))
+        kernel -= 1;
+    simd_kernel = kernel;
+    return kernel;
+}
+
+const char *simd_kernel_name(SimdKernel kernel)
+{
+    return kernel_names[kernel];
+}
+
+int simd_find_kernel(const char *name)
+{
+    for (int k = SIMD_SCALAR; k <= SIMD_AUTO; ++k)
+        if (!strcmp(kernel_names[k], name))
+            return k;
+    return -1;
+}
+
+#if SIMD_HAS_X86
+/**********************************************************************
+ * AVX2 kernel, 8 lanes. `live` has a bit per lane holding an IP; the
+ * other lanes keep walking the root, but are masked out.
+ **********************************************************************/
+__attribute__((target("avx2")))
+static void lookup_avx2(const FrozenTrie *trie, const uint32_t *ips, int *ifaces,
+                        int *accesses, size_t n)
+{
+    const int *words = (const int *)trie->nodes;
+    uint32_t lane_ip[8] = {0}, lane_best[8], lane_accesses[8];
+    size_t lane_index[8];
+    size_t next = 0;
+    unsigned live = 0;
+    for (int l = 0; l < 8 && next < n; ++l, ++next) {
+        lane_ip[l] = ips[next];
+        lane_index[l] = next;
+        live |= 1U << l;
+    }
+
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+    const __m256i ones = _mm256_set1_epi32(-1), max_length = _mm256_set1_epi32(32);
+    const __m256i lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i ip = _mm256_loadu_si256((const __m256i *)lane_ip);
+    __m256i node = zero, best = zero, count = zero;
+    __m256i alive = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(live), lane_bit), lane_bit);
+
+    while (live) {
+        __m256i word = _mm256_slli_epi32(node, 2);
+        __m256i prefix = _mm256_i32gather_epi32(words + WORD_PREFIX, word, 4);
+        __m256i meta = _mm256_i32gather_epi32(words + WORD_META, word, 4);
+        __m256i length = _mm256_and_si256(_mm256_srli_epi32(meta, 16), _mm256_set1_epi32(0xFF));
+        __m256i iface = _mm256_and_si256(meta, _mm256_set1_epi32(0xFFFF));
+        count = _mm256_sub_epi32(count, alive);  // alive lanes are -1
+
+        /* Shifts of 32 or more give 0: the mask of a /0 */
+        __m256i mask = _mm256_sllv_epi32(ones, _mm256_sub_epi32(max_length, length));
+        __m256i diff = _mm256_and_si256(_mm256_xor_si256(ip, prefix), mask);
+        __m256i match = _mm256_and_si256(_mm256_cmpeq_epi32(diff, zero), alive);
+        __m256i take = _mm256_andnot_si256(_mm256_cmpeq_epi32(iface, zero), match);
+        best = _mm256_blendv_epi8(best, iface, take);
+
+        __m256i shift = _mm256_sub_epi32(_mm256_set1_epi32(31), length);
+        __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(ip, shift), one);
+        __m256i child = _mm256_i32gather_epi32(words + WORD_CHILD, _mm256_add_epi32(word, bit), 4);
+        __m256i descend = _mm256_and_si256(match, _mm256_cmpgt_epi32(max_length, length));
+        node = _mm256_and_si256(child, descend);
+
+        unsigned retired = live & ~(unsigned)_mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(node, zero)));
+        if (!retired)
+            continue;
+
+        /* Write out the retired lanes and give them the next IPs */
+        _mm256_storeu_si256((__m256i *)lane_best, best);
+        _mm256_storeu_si256((__m256i *)lane_accesses, count);
+        for (; retired; retired &= retired - 1) {
+            int l = __builtin_ctz(retired);
+            ifaces[lane_index[l]] = lane_best[l];
+            accesses[lane_index[l]] = lane_accesses[l];
+            lane_best[l] = lane_accesses[l] = NO_IFACE;
+            if (next < n) {
+                lane_ip[l] = ips[next];
+                lane_index[l] = next++;
+            } else {
+                live &= ~(1U << l);
+            }
+        }
+        ip = _mm256_loadu_si256((const __m256i *)lane_ip);
+        best = _mm256_loadu_si256((const __m256i *)lane_best);
+        count = _mm256_loadu_si256((const __m256i *)lane_accesses);
+        alive = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(live), lane_bit), lane_bit);
+    }
+}
+
+/**********************************************************************
+ * AVX-512 kernel, 16 lanes, the same walk as `lookup_avx2` with mask
+ * registers instead of mask vectors.
+ **********************************************************************/
+__attribute__((target("avx512f")))
+static void lookup_avx512(const FrozenTrie *trie, const uint32_t *ips, int *ifaces,
+                          int *accesses, size_t n)
+{
+    const int *words = (const int *)trie->nodes;
+    uint32_t lane_ip[16] = {0}, lane_best[16], lane_accesses[16];
+    size_t lane_index[16];
+    size_t next = 0;
+    __mmask16 live = 0;
+    for (int l = 0; l < 16 && next < n; ++l, ++next) {
+        lane_ip[l] = ips[next];
+        lane_index[l] = next;
+        live |= 1U << l;
+    }
+
+    const __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi32(1);
+    const __m512i ones = _mm512_set1_epi32(-1), max_length = _mm512_set1_epi32(32);
+    __m512i ip = _mm512_loadu_si512(lane_ip);
+    __m512i node = zero, best = zero, count = zero;
+
+    while (live) {
+        __m512i word = _mm512_slli_epi32(node, 2);
+        __m512i prefix = _mm512_i32gather_epi32(word, words + WORD_PREFIX, 4);
+        __m512i meta = _mm512_i32gather_epi32(word, words + WORD_META, 4);
+        __m512i length = _mm512_and_si512(_mm512_srli_epi32(meta, 16), _mm512_set1_epi32(0xFF));
+        __m512i iface = _mm512_and_si512(meta, _mm512_set1_epi32(0xFFFF));
+        count = _mm512_mask_add_epi32(count, live, count, one);
+
+        __m512i mask = _mm512_sllv_epi32(ones, _mm512_sub_epi32(max_length, length));
+        __mmask16 match = _mm512_mask_testn_epi32_mask(live, _mm512_xor_si512(ip, prefix), mask);
+        __mmask16 take = _mm512_mask_test_epi32_mask(match, iface, iface);
+        best = _mm512_mask_mov_epi32(best, take, iface);
+
+        __m512i shift = _mm512_sub_epi32(_mm512_set1_epi32(31), length);
+        __m512i bit = _mm512_and_si512(_mm512_srlv_epi32(ip, shift), one);
+        __mmask16 descend = _mm512_mask_cmplt_epi32_mask(match, length, max_length);
+        node = _mm512_mask_i32gather_epi32(zero, descend, _mm512_add_epi32(word, bit),
+                                           words + WORD_CHILD, 4);
+
+        __mmask16 retired = live & ~_mm512_cmpneq_epi32_mask(node, zero);
+        if (!retired)
+            continue;
+
+        _mm512_storeu_si512(lane_best, best);
+        _mm512_storeu_si512(lane_accesses, count);
+        for (unsigned r = retired; r; r &= r - 1) {
+            int l = __builtin_ctz(r);
+            ifaces[lane_index[l]] = lane_best[l];
+            accesses[lane_index[l]] = lane_accesses[l];
+            lane_best[l] = lane_accesses[l] = NO_IFACE;
+            if (next < n) {
+                lane_ip[l] = ips[next];
+                lane_index[l] = next++;
+            } else {
+                live &= ~(1U << l);
+            }
+        }
+        ip = _mm512_loadu_si512(lane_ip);
+        best = _mm512_loadu_si512(lane_best);
+        count = _mm512_loadu_si512(lane_accesses);
+    }
+}
+#endif
+
+/**********************************************************************
+ * Look up a batch of IPs in a frozen trie with the chosen kernel.
+ **********************************************************************/
+void simd_lookup_batch(const FrozenTrie *trie, const uint32_t *ips, int *ifaces,
+                       int *accesses, size_t n)
+{
+    switch (simd_kernel) {
+#if SIMD_HAS_X86
+    case SIMD_AVX512:
+        lookup_avx512(trie, ips, ifaces, accesses, n);
+        break;
+    case SIMD_AVX2:
+        lookup_avx2(trie, ips, ifaces, accesses, n);
+        break;
+#endif
+    default:
+        frozen_lookup_batch(trie, ips, ifaces, accesses, n);
+        break;
+    }
+}
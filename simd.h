@@ -0,0 +1,59 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frozen.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_HAS_X86 1
+#else
+#define SIMD_HAS_X86 0
+#endif
+
+/**********************************************************************
+ * SIMD KERNEL
+ * Kernel used by `simd_lookup_batch` to walk a frozen trie:
+ *  - SIMD_SCALAR: `frozen_lookup_batch`, on any CPU.
+ *  - SIMD_AVX2: 8 IPs at a time, with gathers of 32-bit words.
+ *  - SIMD_AVX512: 16 IPs at a time, with gathers and mask registers.
+ *  - SIMD_AUTO: not chosen yet, `simd_init` takes the best one.
+ **********************************************************************/
+typedef enum {
+    SIMD_SCALAR,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    SIMD_AUTO,
+} SimdKernel;
+
+extern SimdKernel simd_kernel;
+
+/**********************************************************************
+ * Choose the kernel: the one requested, or the best one below it that
+ * the CPU supports (CPUID). SIMD_AUTO takes the best one there is.
+ * Returns the kernel actually used.
+ **********************************************************************/
+SimdKernel simd_init(SimdKernel requested);
+
+/**********************************************************************
+ * Name of a kernel ("scalar", "avx2", "avx512" or "auto").
+ **********************************************************************/
+const char *simd_kernel_name(SimdKernel kernel);
+
+/**********************************************************************
+ * Find a kernel by name. Returns -1 if there is none.
+ **********************************************************************/
+int simd_find_kernel(const char *name);
+
+/**********************************************************************
+ * Look up a batch of IPs in a frozen trie with the chosen kernel
+ * (`simd_init` must be called first). The vector kernels walk one IP
+ * per lane, all the lanes in lockstep: each round gathers the node of
+ * every lane, compares the prefixes with vector masks and gathers the
+ * next child. A lane retires as soon as its walk is over, and takes
+ * the next IP of the batch. Same results and accesses as `lookup`.
+ **********************************************************************/
+void simd_lookup_batch(const FrozenTrie *trie, const uint32_t *ips, int *ifaces,
+                       int *accesses, size_t n);
+
+#endif // SIMD_H
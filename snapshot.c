@@ -0,0 +1,160 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "io.h"
+
+#define CHECKSUM_PRIME 0x100000001B3ULL  // FNV-1a prime, on 64-bit words
+#define CHECKSUM_BASIS 0xCBF29CE484222325ULL
+
+#define align_up(offset) (((offset) + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1))
+
+/**********************************************************************
+ * 64-bit checksum of a buffer, 8 bytes per step.
+ **********************************************************************/
+uint64_t snapshot_checksum(uint64_t seed, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    uint64_t hash = seed ? seed : CHECKSUM_BASIS;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * CHECKSUM_PRIME;
+    }
+    for (; size; --size, ++p)
+        hash = (hash ^ *p) * CHECKSUM_PRIME;
+    return hash;
+}
+
+/**********************************************************************
+ * Write the lookup structure of an engine to a snapshot file.
+ **********************************************************************/
+int snapshot_save(const char *path, const Engine *engine, const void *table,
+                  const NextHopTable *nexthops)
+{
+    if (!engine->save || strlen(engine->name) >= sizeof(((SnapshotHeader *)0)->engine))
+        return BAD_SNAPSHOT;
+
+    /* The next hop table is written as one more section */
+    SnapshotSection sections[SNAPSHOT_MAX_SECTIONS + 1];
+    int count = engine->save(table, sections);
+    sections[count] = (SnapshotSection) { nexthops->entries, nexthops->size * sizeof(NextHop) };
+    SnapshotHeader header = {
+        .version = SNAPSHOT_VERSION,
+        .byte_order = SNAPSHOT_BYTE_ORDER,
+        .section_count = count,
+    };
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    strcpy(header.engine, engine->name);
+    uint64_t offset = align_up(sizeof(SnapshotHeader));
+    uint64_t offsets[SNAPSHOT_MAX_SECTIONS + 1] = {0};
+    for (int i = 0; i <= count; ++i) {
+        offsets[i] = offset;
+        header.checksum = snapshot_checksum(header.checksum, sections[i].data, sections[i].size);
+        offset = align_up(offset + sections[i].size);
+    }
+    for (int i = 0; i < count; ++i) {
+        header.offsets[i] = offsets[i];
+        header.sizes[i] = sections[i].size;
+    }
+    header.nexthop_offset = offsets[count];
+    header.nexthop_size = sections[count].size;
+    header.file_size = offset;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return CANNOT_CREATE_OUTPUT;
+    static const char padding[SNAPSHOT_ALIGNMENT];
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    for (int i = 0; ok && i <= count; ++i) {
+        ok = fwrite(padding, 1, offsets[i] - written, file) == offsets[i] - written &&
+             fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+        written = offsets[i] + sections[i].size;
+    }
+    ok = ok && fwrite(padding, 1, header.file_size - written, file) == header.file_size - written;
+    if (fclose(file) || !ok) {
+        remove(path);
+        return CANNOT_CREATE_OUTPUT;
+    }
+    return OK;
+}
+
+/* Check everything but the checksum. Returns the engine, or NULL */
+static const Engine *check_header(const SnapshotHeader *header, size_t size)
+{
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+        header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        header->file_size != size || header->section_count > SNAPSHOT_MAX_SECTIONS ||
+        !memchr(header->engine, '\0', sizeof(header->engine)))
+        return NULL;
+    for (uint32_t i = 0; i < header->section_count; ++i) {
+        if (header->offsets[i] < sizeof(SnapshotHeader) || header->offsets[i] > size ||
+            header->sizes[i] > size - header->offsets[i])
+            return NULL;
+    }
+    if (header->nexthop_offset < sizeof(SnapshotHeader) || header->nexthop_offset > size ||
+        header->nexthop_size > size - header->nexthop_offset ||
+        header->nexthop_size % sizeof(NextHop) || header->nexthop_offset % SNAPSHOT_ALIGNMENT)
+        return NULL;
+    const Engine *engine = find_engine(header->engine);
+    return engine && engine->attach ? engine : NULL;
+}
+
+/**********************************************************************
+ * Map a snapshot file and check it.
+ **********************************************************************/
+int snapshot_open(const char *path, Snapshot *snapshot)
+{
+    *snapshot = (Snapshot) {0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return SNAPSHOT_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return SNAPSHOT_NOT_FOUND;
+    }
+    if ((size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return BAD_SNAPSHOT;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping stays valid
+    if (map == MAP_FAILED) return SNAPSHOT_NOT_FOUND;
+
+    const SnapshotHeader *header = map;
+    const Engine *engine = check_header(header, st.st_size);
+    uint64_t checksum = 0;
+    for (uint32_t i = 0; engine && i < header->section_count; ++i)
+        checksum = snapshot_checksum(checksum, (char *)map + header->offsets[i], header->sizes[i]);
+    if (engine)
+        checksum = snapshot_checksum(checksum, (char *)map + header->nexthop_offset, header->nexthop_size);
+    if (!engine || checksum != header->checksum) {
+        munmap(map, st.st_size);
+        return BAD_SNAPSHOT;
+    }
+
+    snapshot->map = map;
+    snapshot->size = st.st_size;
+    snapshot->engine = engine;
+    snapshot->section_count = header->section_count;
+    for (int i = 0; i < snapshot->section_count; ++i)
+        snapshot->sections[i] = (SnapshotSection) { (char *)map + header->offsets[i], header->sizes[i] };
+    snapshot->nexthops = (SnapshotSection) { (char *)map + header->nexthop_offset, header->nexthop_size };
+    return OK;
+}
+
+/**********************************************************************
+ * Unmap a snapshot.
+ **********************************************************************/
+void snapshot_close(Snapshot *snapshot)
+{
+    if (snapshot->map) munmap(snapshot->map, snapshot->size);
+    *snapshot = (Snapshot) {0};
+}
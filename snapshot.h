@@ -0,0 +1,98 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "engine.h"
+#include "nexthop.h"
+
+#define SNAPSHOT_MAGIC "RLFIBSNP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+#define SNAPSHOT_ALIGNMENT 64
+
+/**********************************************************************
+ * SNAPSHOT HEADER
+ * A compiled FIB is this header followed by the sections of the lookup
+ * structure, each one aligned to SNAPSHOT_ALIGNMENT bytes. The sections
+ * only hold indexes, so the file is used as it is once mapped.
+ * Fields:
+ *  - magic, version: SNAPSHOT_MAGIC and SNAPSHOT_VERSION.
+ *  - byte_order: SNAPSHOT_BYTE_ORDER as written by the machine that
+ *  compiled the FIB. Snapshots do not move across byte orders.
+ *  - engine: name of the engine that built the structure.
+ *  - section_count, offsets, sizes: where the sections are, in bytes
+ *  from the start of the file.
+ *  - nexthop_offset, nexthop_size: the next hop table (an array of
+ *  NextHop), after the sections. The sections hold next hop indexes,
+ *  or the interfaces if the table is empty.
+ *  - file_size: size of the whole file.
+ *  - checksum: of the sections and the next hop table, in order (see
+ *  `snapshot_checksum`).
+ **********************************************************************/
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    char engine[32];
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t offsets[SNAPSHOT_MAX_SECTIONS];
+    uint64_t sizes[SNAPSHOT_MAX_SECTIONS];
+    uint64_t nexthop_offset;
+    uint64_t nexthop_size;
+    uint64_t file_size;
+    uint64_t checksum;
+} SnapshotHeader;
+
+/**********************************************************************
+ * SNAPSHOT
+ * A compiled FIB mapped read only. The pages are shared with every
+ * other process that maps the same file.
+ * Fields:
+ *  - map, size: the mapping.
+ *  - engine: engine of the structure.
+ *  - sections, section_count: the arrays, inside the mapping.
+ *  - nexthops: the next hop table, inside the mapping.
+ **********************************************************************/
+typedef struct {
+    void *map;
+    size_t size;
+    const Engine *engine;
+    SnapshotSection sections[SNAPSHOT_MAX_SECTIONS];
+    int section_count;
+    SnapshotSection nexthops;
+} Snapshot;
+
+/**********************************************************************
+ * Write the lookup structure of an engine and the next hop table its
+ * indexes refer to to a snapshot file.
+ * Returns OK, CANNOT_CREATE_OUTPUT or BAD_SNAPSHOT if the engine cannot
+ * be compiled (io.h).
+ **********************************************************************/
+int snapshot_save(const char *path, const Engine *engine, const void *table,
+                  const NextHopTable *nexthops);
+
+/**********************************************************************
+ * Map a snapshot file and check it: magic, version, byte order, bounds
+ * of the sections, checksum and engine.
+ * Returns OK, SNAPSHOT_NOT_FOUND or BAD_SNAPSHOT (io.h).
+ * Args:
+ *  - Snapshot *snapshot: output parameter. Unmap it with
+ *  `snapshot_close` once the structure attached to it is freed.
+ **********************************************************************/
+int snapshot_open(const char *path, Snapshot *snapshot);
+
+/**********************************************************************
+ * Unmap a snapshot.
+ **********************************************************************/
+void snapshot_close(Snapshot *snapshot);
+
+/**********************************************************************
+ * 64-bit checksum of a buffer, 8 bytes per step. Chain the buffers
+ * passing the checksum of the previous ones as `seed` (0 for the
+ * first one).
+ **********************************************************************/
+uint64_t snapshot_checksum(uint64_t seed, const void *data, size_t size);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "stats.h"
+#include "io.h"
+#include "timing.h"
+
+/* A node on the stack of a walk, its depth and the length of its parent */
+typedef struct {
+    const Node *node;
+    int depth;
+    int parent_length;
+} WalkFrame;
+
+/* A trie has at most 33 levels, and each one leaves one subtree behind */
+#define WALK_STACK_SIZE (IP_ADDRESS_LENGTH + 2)
+
+/**********************************************************************
+ * Shape of a compressed trie.
+ **********************************************************************/
+void stats_trie(TrieStats *stats, const Node *root)
+{
+    WalkFrame stack[WALK_STACK_SIZE];
+    int top = 0;
+    if (root)
+        stack[top++] = (WalkFrame) { root, 0, -1 };
+    while (top) {
+        WalkFrame frame = stack[--top];
+        const Node *node = frame.node;
+        stats->compressed_nodes += 1;
+        stats->depth_histogram[frame.depth] += 1;
+        if (frame.depth > stats->max_depth)
+            stats->max_depth = frame.depth;
+        if (node->out_iface != NO_IFACE) {
+            stats->routes += 1;
+            stats->length_histogram[node->prefix_length] += 1;
+        }
+        if (!node->left && !node->right)
+            stats->leaves += 1;
+        /* Uncompressed, there is a node per bit from the parent down to this one */
+        stats->uncompressed_nodes += node->prefix_length - frame.parent_length;
+        if (node->right) stack[top++] = (WalkFrame) { node->right, frame.depth + 1, node->prefix_length };
+        if (node->left) stack[top++] = (WalkFrame) { node->left, frame.depth + 1, node->prefix_length };
+    }
+}
+
+/**********************************************************************
+ * Build every engine and keep its size.
+ **********************************************************************/
+void stats_engines(TrieStats *stats, Node *root, const EngineOptions *options)
+{
+    stats->engines = calloc(engine_count, sizeof(EngineStats));
+    if (!stats->engines) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    for (int e = 0; e < engine_count; ++e) {
+        uint64_t start = timer_now();
+        void *table = engines[e].build(root, options);
+        uint64_t end = timer_now();
+        if (!table)
+            continue;  // Not for this FIB (e.g. too many next hops)
+        EngineStats *engine = &stats->engines[stats->engine_count++];
+        engine->name = engines[e].name;
+        engine->nodes = engines[e].node_count(table);
+        engine->memory = engines[e].memory(table);
+        engine->build_from_trie_time = timer_elapsed_ns(start, end);
+        engines[e].destroy(table);
+    }
+}
+
+/**********************************************************************
+ * Distribution of the memory accesses of the lookups.
+ **********************************************************************/
+void stats_accesses(TrieStats *stats, const int *accesses, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        int count = accesses[i] < STATS_MAX_ACCESSES ? accesses[i] : STATS_MAX_ACCESSES;
+        stats->access_histogram[count] += 1;
+        stats->total_accesses += accesses[i];
+        if (accesses[i] > stats->max_accesses)
+            stats->max_accesses = accesses[i];
+    }
+    stats->lookups += n;
+}
+
+/* Visits of a node, in an open-addressing hash by its address */
+typedef struct {
+    const Node *node;
+    long visits;
+    int depth;
+} VisitSlot;
+
+static VisitSlot *visit(VisitSlot *slots, size_t mask, const Node *node, int depth)
+{
+    size_t i = ((uintptr_t)node >> 4) * 0x9E3779B97F4A7C15ULL & mask;
+    while (slots[i].node && slots[i].node != node)
+        i = (i + 1) & mask;
+    slots[i].node = node;
+    slots[i].depth = depth;
+    return &slots[i];
+}
+
+/* Whether a is hotter than b: more visits, then shorter, then lower */
+static int hotter(const HotNode *a, const HotNode *b)
+{
+    if (a->visits != b->visits) return a->visits > b->visits;
+    if (a->prefix_length != b->prefix_length) return a->prefix_length < b->prefix_length;
+    return a->prefix < b->prefix;
+}
+
+/**********************************************************************
+ * Hottest nodes of the trie for a sample of the trace.
+ **********************************************************************/
+void stats_hot_nodes(TrieStats *stats, const Node *root, const uint32_t *ips, size_t n,
+                     const NextHopTable *nexthops)
+{
+    size_t step = n > STATS_MAX_SAMPLES ? (n + STATS_MAX_SAMPLES - 1) / STATS_MAX_SAMPLES : 1;
+    size_t samples = (n + step - 1) / step;
+    /* A sample visits at most one node per level */
+    size_t slot_count = 1024;
+    while (slot_count < 2 * samples * (IP_ADDRESS_LENGTH + 1))
+        slot_count *= 2;
+    VisitSlot *slots = calloc(slot_count, sizeof(VisitSlot));
+    if (!slots) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+
+    for (size_t s = 0; s < samples; ++s) {
+        uint32_t ip = ips[s * step];
+        const Node *node = root;
+        int depth = 0;
+        while (node) {
+            visit(slots, slot_count - 1, node, depth)->visits += 1;
+            uint32_t mask = node->prefix_length ? 0xFFFFFFFFU << (32 - node->prefix_length) : 0;
+            if ((ip & mask) != (node->prefix & mask) || node->prefix_length == IP_ADDRESS_LENGTH)
+                break;
+            node = node->child[(ip >> (31 - node->prefix_length)) & 1];
+            depth += 1;
+        }
+    }
+    stats->sampled = samples;
+
+    /* Insertion into the short list of the hottest ones */
+    stats->hot_count = 0;
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (!slots[i].node)
+            continue;
+        const Node *node = slots[i].node;
+        HotNode hot = {
+            .prefix = node->prefix,
+            .prefix_length = node->prefix_length,
+            .out_iface = nexthops ? nexthop_iface(nexthops, node->out_iface) : node->out_iface,
+            .depth = slots[i].depth,
+            .visits = slots[i].visits,
+        };
+        if (stats->hot_count == STATS_HOT_NODES && !hotter(&hot, &stats->hot[STATS_HOT_NODES - 1]))
+            continue;
+        int j = stats->hot_count < STATS_HOT_NODES ? stats->hot_count++ : STATS_HOT_NODES - 1;
+        for (; j > 0 && hotter(&hot, &stats->hot[j - 1]); --j)
+            stats->hot[j] = stats->hot[j - 1];
+        stats->hot[j] = hot;
+    }
+    free(slots);
+}
+
+static void format_prefix(char *text, uint32_t prefix, int prefix_length)
+{
+    sprintf(text, "%u.%u.%u.%u/%d", prefix >> 24, (prefix >> 16) & 0xFF, (prefix >> 8) & 0xFF,
+            prefix & 0xFF, prefix_length);
+}
+
+static void export_json(FILE *file, const TrieStats *stats)
+{
+    fprintf(file, "{\n  \"trie\": {\n");
+    fprintf(file, "    \"uncompressed_nodes\": %ld,\n", stats->uncompressed_nodes);
+    fprintf(file, "    \"compressed_nodes\": %ld,\n", stats->compressed_nodes);
+    fprintf(file, "    \"routes\": %ld,\n", stats->routes);
+    fprintf(file, "    \"leaves\": %ld,\n", stats->leaves);
+    fprintf(file, "    \"max_depth\": %d,\n", stats->max_depth);
+    fprintf(file, "    \"depth_histogram\": [");
+    for (int d = 0; d <= stats->max_depth; ++d)
+        fprintf(file, "%s%ld", d ? ", " : "", stats->depth_histogram[d]);
+    fprintf(file, "],\n    \"prefix_length_histogram\": [");
+    for (int l = 0; l <= IP_ADDRESS_LENGTH; ++l)
+        fprintf(file, "%s%ld", l ? ", " : "", stats->length_histogram[l]);
+    fprintf(file, "]\n  },\n  \"engines\": [");
+    for (int e = 0; e < stats->engine_count; ++e) {
+        const EngineStats *engine = &stats->engines[e];
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"nodes\": %ld, \"memory\": %zu, \"build_from_trie_ns\": %.0f}",
+                e ? "," : "", engine->name, engine->nodes, engine->memory, engine->build_from_trie_time);
+    }
+    fprintf(file, "%s],\n  \"lookups\": {\n", stats->engine_count ? "\n  " : "");
+    fprintf(file, "    \"count\": %ld,\n", stats->lookups);
+    fprintf(file, "    \"average_accesses\": %.4f,\n",
+            stats->lookups ? stats->total_accesses / stats->lookups : 0);
+    fprintf(file, "    \"max_accesses\": %d,\n", stats->max_accesses);
+    fprintf(file, "    \"access_histogram\": [");
+    int last = stats->max_accesses < STATS_MAX_ACCESSES ? stats->max_accesses : STATS_MAX_ACCESSES;
+    for (int a = 0; a <= last; ++a)
+        fprintf(file, "%s%ld", a ? ", " : "", stats->access_histogram[a]);
+    fprintf(file, "]\n  },\n  \"hot_nodes\": {\n    \"sampled\": %ld,\n    \"nodes\": [", stats->sampled);
+    for (int h = 0; h < stats->hot_count; ++h) {
+        const HotNode *hot = &stats->hot[h];
+        char prefix[IP_ADDRESS_LENGTH];
+        format_prefix(prefix, hot->prefix, hot->prefix_length);
+        fprintf(file, "%s\n      {\"prefix\": \"%s\", \"depth\": %d, \"out_iface\": %d, \"visits\": %ld}",
+                h ? "," : "", prefix, hot->depth, hot->out_iface, hot->visits);
+    }
+    fprintf(file, "%s]\n  }\n}\n", stats->hot_count ? "\n    " : "");
+}
+
+static void export_prometheus(FILE *file, const TrieStats *stats)
+{
+    fprintf(file, "# HELP fib_trie_nodes Nodes of the Patricia trie, before and after compression.\n");
+    fprintf(file, "# TYPE fib_trie_nodes gauge\n");
+    fprintf(file, "fib_trie_nodes{trie=\"uncompressed\"} %ld\n", stats->uncompressed_nodes);
+    fprintf(file, "fib_trie_nodes{trie=\"compressed\"} %ld\n", stats->compressed_nodes);
+    fprintf(file, "# HELP fib_trie_routes Nodes of the compressed trie with a next hop.\n");
+    fprintf(file, "# TYPE fib_trie_routes gauge\nfib_trie_routes %ld\n", stats->routes);
+    fprintf(file, "# HELP fib_trie_leaves Nodes of the compressed trie without subtrees.\n");
+    fprintf(file, "# TYPE fib_trie_leaves gauge\nfib_trie_leaves %ld\n", stats->leaves);
+    fprintf(file, "# HELP fib_trie_depth_nodes Nodes of the compressed trie by depth.\n");
+    fprintf(file, "# TYPE fib_trie_depth_nodes gauge\n");
+    for (int d = 0; d <= stats->max_depth; ++d)
+        fprintf(file, "fib_trie_depth_nodes{depth=\"%d\"} %ld\n", d, stats->depth_histogram[d]);
+    fprintf(file, "# HELP fib_trie_prefix_length_routes Routes by prefix length.\n");
+    fprintf(file, "# TYPE fib_trie_prefix_length_routes gauge\n");
+    for (int l = 0; l <= IP_ADDRESS_LENGTH; ++l)
+        fprintf(file, "fib_trie_prefix_length_routes{length=\"%d\"} %ld\n", l, stats->length_histogram[l]);
+
+    fprintf(file, "# HELP fib_engine_nodes Nodes (or entries) of each engine.\n");
+    fprintf(file, "# TYPE fib_engine_nodes gauge\n");
+    for (int e = 0; e < stats->engine_count; ++e)
+        fprintf(file, "fib_engine_nodes{engine=\"%s\"} %ld\n", stats->engines[e].name, stats->engines[e].nodes);
+    fprintf(file, "# HELP fib_engine_memory_bytes Memory of each engine.\n");
+    fprintf(file, "# TYPE fib_engine_memory_bytes gauge\n");
+    for (int e = 0; e < stats->engine_count; ++e)
+        fprintf(file, "fib_engine_memory_bytes{engine=\"%s\"} %zu\n", stats->engines[e].name,
+                stats->engines[e].memory);
+    fprintf(file, "# HELP fib_engine_build_from_trie_seconds Build time of each engine from the compressed trie, without building the trie.\n");
+    fprintf(file, "# TYPE fib_engine_build_from_trie_seconds gauge\n");
+    for (int e = 0; e < stats->engine_count; ++e)
+        fprintf(file, "fib_engine_build_from_trie_seconds{engine=\"%s\"} %.9f\n", stats->engines[e].name,
+                stats->engines[e].build_from_trie_time / 1e9);
+
+    fprintf(file, "# HELP fib_lookup_accesses Memory accesses per lookup.\n");
+    fprintf(file, "# TYPE fib_lookup_accesses histogram\n");
+    long cumulative = 0;
+    int last = stats->max_accesses < STATS_MAX_ACCESSES ? stats->max_accesses : STATS_MAX_ACCESSES - 1;
+    for (int a = 0; a <= last; ++a) {
+        cumulative += stats->access_histogram[a];
+        fprintf(file, "fib_lookup_accesses_bucket{le=\"%d\"} %ld\n", a, cumulative);
+    }
+    fprintf(file, "fib_lookup_accesses_bucket{le=\"+Inf\"} %ld\n", stats->lookups);
+    fprintf(file, "fib_lookup_accesses_sum %.0f\n", stats->total_accesses);
+    fprintf(file, "fib_lookup_accesses_count %ld\n", stats->lookups);
+
+    fprintf(file, "# HELP fib_hot_nodes_sampled IPs of the trace walked to find the hottest nodes.\n");
+    fprintf(file, "# TYPE fib_hot_nodes_sampled gauge\nfib_hot_nodes_sampled %ld\n", stats->sampled);
+    fprintf(file, "# HELP fib_hot_node_visits Sampled lookups through each of the hottest nodes.\n");
+    fprintf(file, "# TYPE fib_hot_node_visits gauge\n");
+    for (int h = 0; h < stats->hot_count; ++h) {
+        char prefix[IP_ADDRESS_LENGTH];
+        format_prefix(prefix, stats->hot[h].prefix, stats->hot[h].prefix_length);
+        fprintf(file, "fib_hot_node_visits{prefix=\"%s\",depth=\"%d\",out_iface=\"%d\"} %ld\n", prefix,
+                stats->hot[h].depth, stats->hot[h].out_iface, stats->hot[h].visits);
+    }
+}
+
+/**********************************************************************
+ * Write the statistics.
+ **********************************************************************/
+int stats_export(const TrieStats *stats, const char *path, StatsFormat format)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return CANNOT_CREATE_OUTPUT;
+    if (format == STATS_JSON)
+        export_json(file, stats);
+    else
+        export_prometheus(file, stats);
+    if (fclose(file) != 0)
+        return CANNOT_CREATE_OUTPUT;
+    return OK;
+}
+
+void stats_free(TrieStats *stats)
+{
+    free(stats->engines);
+    stats->engines = NULL;
+    stats->engine_count = 0;
+}
@@ -0,0 +1,116 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "node.h"
+#include "engine.h"
+#include "nexthop.h"
+#include "utils.h"
+
+#define STATS_MAX_ACCESSES 64     // Last bucket of the access distribution: 64 or more
+#define STATS_HOT_NODES 10
+#define STATS_MAX_SAMPLES 65536   // IPs of the trace walked to find the hottest nodes
+
+typedef enum {
+    STATS_JSON,
+    STATS_PROMETHEUS,
+} StatsFormat;
+
+/* A node of the trie and the sampled lookups that went through it */
+typedef struct {
+    uint32_t prefix;
+    int prefix_length;
+    int out_iface;  // The interface, NO_IFACE for a branching node
+    int depth;
+    long visits;
+} HotNode;
+
+/* An engine built from the trie */
+typedef struct {
+    const char *name;
+    long nodes;
+    size_t memory;
+    double build_from_trie_time;  // nsecs, without building the trie
+} EngineStats;
+
+/**********************************************************************
+ * TRIE STATISTICS
+ * What the FIB looks like as a trie and how it is looked up, to choose
+ * the engine and its parameters. Every part is filled by its own
+ * function, the rest stays zeroed.
+ * Fields:
+ *  - uncompressed_nodes: nodes the trie has before compression, one
+ *  per bit of the path of every route. Counted from the compressed
+ *  trie, which has the same paths.
+ *  - compressed_nodes, routes, leaves: nodes of the compressed trie,
+ *  those with a next hop and those without subtrees.
+ *  - max_depth, depth_histogram: nodes of the compressed trie by depth
+ *  (the root is 0).
+ *  - length_histogram: routes by prefix length.
+ *  - engines, engine_count: every engine built from the trie.
+ *  - lookups, access_histogram, total_accesses, max_accesses: lookups
+ *  of the trace by the number of memory accesses they took.
+ *  - sampled, hot, hot_count: the nodes most visited by the sampled
+ *  IPs of the trace, the most visited first.
+ **********************************************************************/
+typedef struct {
+    long uncompressed_nodes;
+    long compressed_nodes;
+    long routes;
+    long leaves;
+    int max_depth;
+    long depth_histogram[IP_ADDRESS_LENGTH + 1];
+    long length_histogram[IP_ADDRESS_LENGTH + 1];
+    EngineStats *engines;
+    int engine_count;
+    long lookups;
+    long access_histogram[STATS_MAX_ACCESSES + 1];
+    double total_accesses;
+    int max_accesses;
+    long sampled;
+    HotNode hot[STATS_HOT_NODES];
+    int hot_count;
+} TrieStats;
+
+/**********************************************************************
+ * Shape of a compressed trie: node counts, depths and prefix lengths.
+ **********************************************************************/
+void stats_trie(TrieStats *stats, const Node *root);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Build every engine from the compressed trie, one after another, and
+ * keep its node count, memory and build time. The time only covers
+ * `build` on the given trie, not the trie itself. The timer must be
+ * initialized (see `timer_init`). Free them with `stats_free`.
+ **********************************************************************/
+void stats_engines(TrieStats *stats, Node *root, const EngineOptions *options);
+
+/**********************************************************************
+ * Distribution of the memory accesses of `n` lookups.
+ **********************************************************************/
+void stats_accesses(TrieStats *stats, const int *accesses, size_t n);
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Walk the trie as `lookup` does with up to STATS_MAX_SAMPLES IPs of
+ * the trace, evenly spaced, and keep the STATS_HOT_NODES nodes they
+ * visit the most.
+ * Args:
+ *  - const NextHopTable *nexthops: to give the interfaces of the nodes
+ *  instead of their next hop indexes.
+ **********************************************************************/
+void stats_hot_nodes(TrieStats *stats, const Node *root, const uint32_t *ips, size_t n,
+                     const NextHopTable *nexthops);
+
+/**********************************************************************
+ * Write the statistics as a JSON object or in the Prometheus text
+ * format.
+ * Returns OK or CANNOT_CREATE_OUTPUT (io.h).
+ **********************************************************************/
+int stats_export(const TrieStats *stats, const char *path, StatsFormat format);
+
+void stats_free(TrieStats *stats);
+
+#endif // STATS_H
@@ -0,0 +1,313 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "stream.h"
+#include "fib.h"
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int signal)
+{
+    (void)signal;
+    stopping = 1;
+}
+
+/* Everything a stream needs besides its LookupStream */
+typedef struct {
+    char buffer[STREAM_BUFFER];
+    size_t used;
+    uint32_t ips[STREAM_BATCH];
+    int ifaces[STREAM_BATCH];
+    int accesses[STREAM_BATCH];
+    double times[STREAM_BATCH];
+    LookupChunk batch;
+    LookupChunk interval;       // Accumulators since the last interval stats
+    struct timespec interval_start;
+} Server;
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_stats(const char *label, const LookupChunk *stats, double seconds)
+{
+    double packets = stats->processed_packets;
+    fprintf(stderr, "%s: %.1f s, packets= %zu, pps= %.0f, average accesses= %.2f, "
+            "average time= %.0f ns, p50= %lu ns, p99= %lu ns, max= %lu ns\n",
+            label, seconds, stats->processed_packets, seconds > 0 ? packets / seconds : 0,
+            packets ? stats->total_accesses / packets : 0, packets ? stats->total_time / packets : 0,
+            (unsigned long)histogram_percentile(&stats->latencies, 0.50),
+            (unsigned long)histogram_percentile(&stats->latencies, 0.99),
+            (unsigned long)stats->latencies.max);
+}
+
+static void add_stats(LookupChunk *to, const LookupChunk *from)
+{
+    to->total_accesses += from->total_accesses;
+    to->total_time += from->total_time;
+    to->processed_packets += from->processed_packets;
+    histogram_merge(&to->latencies, &from->latencies);
+}
+
+static void reset_stats(LookupChunk *stats)
+{
+    stats->total_accesses = 0;
+    stats->total_time = 0;
+    stats->processed_packets = 0;
+    histogram_reset(&stats->latencies);
+}
+
+/* Print the interval stats if it is time to */
+static void tick(LookupStream *stream, Server *server)
+{
+    double seconds = seconds_since(&server->interval_start);
+    if (stream->interval <= 0 || seconds < stream->interval)
+        return;
+    print_stats("Interval", &server->interval, seconds);
+    reset_stats(&server->interval);
+    clock_gettime(CLOCK_MONOTONIC, &server->interval_start);
+}
+
+/* Milliseconds to wait for input before the next interval stats */
+static int poll_timeout(const LookupStream *stream, const Server *server)
+{
+    if (stream->interval <= 0)
+        return -1;
+    double left = stream->interval - seconds_since(&server->interval_start);
+    return left > 0 ? (int)(left * 1e3) + 1 : 0;
+}
+
+/* Look up and answer the n IPs of the server */
+static int answer(LookupStream *stream, Server *server, size_t n, int out_fd)
+{
+    server->batch.count = n;
+    run_chunk(&server->batch);
+    add_stats(&server->interval, &server->batch);
+    add_stats(&stream->lookups, &server->batch);
+    nexthop_translate(stream->nexthops, server->ifaces, n);
+    return write_results(out_fd, stream->output_format, server->ips, server->ifaces,
+                         server->accesses, server->times, n);
+}
+
+/**********************************************************************
+ * Answer the complete records of the buffer, and keep the rest for the
+ * next read. At the end of the input, a last line without '\n' is
+ * complete too.
+ * Returns 0, or -1 if the input is malformed or the answer cannot be
+ * written.
+ **********************************************************************/
+static int consume(LookupStream *stream, Server *server, int out_fd, int at_end)
+{
+    if (at_end && stream->input_format == STREAM_TEXT && server->used &&
+        server->buffer[server->used - 1] != '\n') {
+        if (server->used == STREAM_BUFFER) {
+            fprintf(stderr, "ERROR: line too long in the stream\n");
+            return -1;
+        }
+        server->buffer[server->used++] = '\n';
+    }
+    const char *p = server->buffer, *end = server->buffer + server->used;
+    for (;;) {
+        size_t n;
+        if (stream->input_format == STREAM_BINARY) {
+            n = (end - p) / 4;
+            if (n > STREAM_BATCH) n = STREAM_BATCH;
+            for (size_t i = 0; i < n; ++i, p += 4) {
+                const unsigned char *bytes = (const unsigned char *)p;
+                server->ips[i] = (uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+            }
+        } else {
+            p = parse_trace(p, end, server->ips, STREAM_BATCH, &n);
+        }
+        if (n && answer(stream, server, n, out_fd) < 0) {
+            fprintf(stderr, "ERROR: could not write the answers\n");
+            return -1;
+        }
+        if (!p) {
+            fprintf(stderr, "ERROR: malformed address in the stream\n");
+            return -1;
+        }
+        if (!n)
+            break;
+    }
+    server->used = end - p;
+    memmove(server->buffer, p, server->used);
+    if (server->used == STREAM_BUFFER) {
+        fprintf(stderr, "ERROR: line too long in the stream\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Answer everything that comes from in_fd until its end.
+ * Returns 0, or -1 on error (already reported).
+ **********************************************************************/
+static int serve(LookupStream *stream, Server *server, int in_fd, int out_fd)
+{
+    server->used = 0;
+    if (stream->output_format == OUTPUT_BINARY) {
+        const char *magic = OUTPUT_BINARY_MAGIC;
+        for (size_t written = 0; written < 8;) {
+            ssize_t n = write(out_fd, magic + written, 8 - written);
+            if (n < 0 && errno != EINTR) return -1;
+            if (n > 0) written += n;
+        }
+    }
+    while (!stopping) {
+        struct pollfd input = { .fd = in_fd, .events = POLLIN };
+        int ready = poll(&input, 1, poll_timeout(stream, server));
+        tick(stream, server);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            return -1;
+        }
+        if (ready <= 0)
+            continue;
+        ssize_t n = read(in_fd, server->buffer + server->used, STREAM_BUFFER - server->used);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("read");
+            return -1;
+        }
+        if (!n)
+            return consume(stream, server, out_fd, 1);
+        server->used += n;
+        if (consume(stream, server, out_fd, 0) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Listen to a UNIX socket. Returns its descriptor, or -1 */
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "ERROR: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct stat status;
+    if (!stat(path, &status) && S_ISSOCK(status.st_mode))
+        unlink(path);  // Left by a previous run
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 8) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Serve the clients of a UNIX socket, one after another */
+static int serve_unix(LookupStream *stream, Server *server, const char *path)
+{
+    int listen_fd = listen_unix(path);
+    if (listen_fd < 0)
+        return -1;
+    fprintf(stderr, "Listening on %s\n", path);
+    while (!stopping) {
+        struct pollfd input = { .fd = listen_fd, .events = POLLIN };
+        int ready = poll(&input, 1, poll_timeout(stream, server));
+        tick(stream, server);
+        if (ready <= 0)
+            continue;
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0)
+            continue;
+        /* A client that goes away only ends its own connection */
+        serve(stream, server, client, client);
+        close(client);
+    }
+    close(listen_fd);
+    unlink(path);
+    return 0;
+}
+
+/* Serve a file, or a FIFO until there is no writer left and a signal comes */
+static int serve_path(LookupStream *stream, Server *server, const char *path)
+{
+    struct stat status;
+    if (stat(path, &status) < 0) {
+        perror(path);
+        return -1;
+    }
+    int result = 0;
+    do {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            if (errno == EINTR) continue;  // Waiting for a writer
+            perror(path);
+            return -1;
+        }
+        result = serve(stream, server, fd, STDOUT_FILENO);
+        close(fd);
+    } while (!result && S_ISFIFO(status.st_mode) && !stopping);
+    return result;
+}
+
+/**********************************************************************
+ * Serve a stream until its end, or until SIGINT or SIGTERM.
+ **********************************************************************/
+int stream_run(LookupStream *stream, const char *source)
+{
+    Server *server = malloc(sizeof(Server));
+    if (!server) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    server->batch = stream->lookups;
+    server->batch.ips = server->ips;
+    server->batch.ifaces = server->ifaces;
+    server->batch.accesses = server->accesses;
+    server->batch.times = server->times;
+    reset_stats(&server->interval);
+    reset_stats(&stream->lookups);
+
+    /* No SA_RESTART: a signal wakes up the poll, the read or the open */
+    struct sigaction action = { .sa_handler = on_signal }, old_int, old_term, old_pipe;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    action.sa_handler = SIG_IGN;  // Writing to a client that left fails with EPIPE instead
+    sigaction(SIGPIPE, &action, &old_pipe);
+    stopping = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    server->interval_start = start;
+    int result;
+    if (!strcmp(source, "-"))
+        result = serve(stream, server, STDIN_FILENO, STDOUT_FILENO);
+    else if (!strncmp(source, STREAM_UNIX_PREFIX, strlen(STREAM_UNIX_PREFIX)))
+        result = serve_unix(stream, server, source + strlen(STREAM_UNIX_PREFIX));
+    else
+        result = serve_path(stream, server, source);
+    print_stats("Total", &stream->lookups, seconds_since(&start));
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    free(server);
+    return result;
+}
@@ -0,0 +1,59 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "worker.h"
+#include "output.h"
+#include "nexthop.h"
+
+#define STREAM_BATCH 4096           // IPs looked up and answered at once
+#define STREAM_BUFFER (1 << 16)     // Bytes read at once
+#define STREAM_UNIX_PREFIX "unix:"  // Source that is a UNIX socket
+
+/**********************************************************************
+ * STREAM FORMAT
+ *  - STREAM_TEXT: one "a.b.c.d" address per line, like a trace.
+ *  - STREAM_BINARY: 4 bytes per address, in network byte order.
+ **********************************************************************/
+typedef enum {
+    STREAM_TEXT,
+    STREAM_BINARY,
+} StreamFormat;
+
+/**********************************************************************
+ * LOOKUP STREAM
+ * A lookup service: the destinations are read as they come, and every
+ * batch is answered as soon as it is looked up, in the output format
+ * of the result files.
+ * Fields:
+ *  - lookups: engine, table, batch_size and cache of the lookups (see
+ *  LookupChunk). Its accumulators get the totals of the whole stream.
+ *  - nexthops: to translate the results.
+ *  - input_format, output_format: see StreamFormat and OutputFormat.
+ *  - interval: seconds between two interval stats on stderr, 0 for
+ *  none.
+ **********************************************************************/
+typedef struct {
+    LookupChunk lookups;
+    const NextHopTable *nexthops;
+    StreamFormat input_format;
+    OutputFormat output_format;
+    double interval;
+} LookupStream;
+
+/**********************************************************************
+ * Serve a stream until its end, or until SIGINT or SIGTERM.
+ * The source can be:
+ *  - "-": the standard input. The answers go to the standard output.
+ *  - STREAM_UNIX_PREFIX path: a UNIX socket that is created and
+ *  listened to. Clients are served one after another, and their
+ *  answers go back through the socket.
+ *  - a path: a file, or a FIFO that is opened again every time its
+ *  writer closes it. The answers go to the standard output.
+ * Returns 0, or -1 on error.
+ * THIS FUNCTION PRODUCES LOGS.
+ **********************************************************************/
+int stream_run(LookupStream *stream, const char *source);
+
+#endif // STREAM_H
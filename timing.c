@@ -0,0 +1,160 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "timing.h"
+#if TIMER_HAS_TSC
+#include <cpuid.h>
+#endif
+
+#define TIMER_CALIBRATION_NS 20000000  // 20 ms
+#define TIMER_OVERHEAD_SAMPLES 1001
+
+TimerSource timer_source = TIMER_CLOCK;
+static double ticks_per_ns = 1;
+static uint64_t overhead_ticks = 0;
+
+/* Invariant TSC: constant rate in every P-state, C-state and core */
+static int has_invariant_tsc(void)
+{
+#if TIMER_HAS_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1U << 27)))
+        return 0;  // No rdtscp
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx >> 8) & 1;
+#else
+    return 0;
+#endif
+}
+
+static int by_ticks(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**********************************************************************
+ * Choose and calibrate the timer.
+ **********************************************************************/
+TimerSource timer_init(TimerSource source)
+{
+    timer_source = source == TIMER_TSC && has_invariant_tsc() ? TIMER_TSC : TIMER_CLOCK;
+    ticks_per_ns = 1;
+    if (timer_source == TIMER_TSC) {
+        struct timespec start, end, pause = { 0, TIMER_CALIBRATION_NS };
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        uint64_t ticks = timer_now();
+        nanosleep(&pause, NULL);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        ticks = timer_now() - ticks;
+        double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        ticks_per_ns = ticks / ns;
+    }
+
+    /* Median of back-to-back reads */
+    uint64_t samples[TIMER_OVERHEAD_SAMPLES];
+    for (int i = 0; i < TIMER_OVERHEAD_SAMPLES; ++i) {
+        uint64_t start = timer_now();
+        samples[i] = timer_now() - start;
+    }
+    qsort(samples, TIMER_OVERHEAD_SAMPLES, sizeof(uint64_t), by_ticks);
+    overhead_ticks = samples[TIMER_OVERHEAD_SAMPLES / 2];
+    return timer_source;
+}
+
+/**********************************************************************
+ * Nsecs between two timestamps, without the cost of reading them.
+ **********************************************************************/
+double timer_elapsed_ns(uint64_t start, uint64_t end)
+{
+    uint64_t ticks = end - start;
+    return ticks > overhead_ticks ? (ticks - overhead_ticks) / ticks_per_ns : 0;
+}
+
+/* Bucket of a value: exact below HISTOGRAM_EXACT, then 2^SUB_BITS per power of two */
+static int bucket_of(uint64_t value)
+{
+    if (value < HISTOGRAM_EXACT)
+        return value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    return HISTOGRAM_EXACT + (msb - HISTOGRAM_SUB_BITS - 1) * (1 << HISTOGRAM_SUB_BITS) +
+           (int)(value >> shift) - (1 << HISTOGRAM_SUB_BITS);
+}
+
+/* Largest value of a bucket */
+static uint64_t bucket_max(int bucket)
+{
+    if (bucket < HISTOGRAM_EXACT)
+        return bucket;
+    int k = bucket - HISTOGRAM_EXACT;
+    int shift = k / (1 << HISTOGRAM_SUB_BITS) + 1;
+    uint64_t top = (1 << HISTOGRAM_SUB_BITS) + k % (1 << HISTOGRAM_SUB_BITS);
+    return ((top + 1) << shift) - 1;
+}
+
+/**********************************************************************
+ * Empty a histogram.
+ **********************************************************************/
+void histogram_reset(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(Histogram));
+    histogram->min = UINT64_MAX;
+}
+
+/**********************************************************************
+ * Record a latency (nsecs).
+ **********************************************************************/
+void histogram_record(Histogram *histogram, double ns)
+{
+    uint64_t value = ns > 0 ? (uint64_t)(ns + 0.5) : 0;
+    histogram->counts[bucket_of(value)] += 1;
+    histogram->count += 1;
+    histogram->sum += ns;
+    if (value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+/**********************************************************************
+ * Add the values of `from` to `to`.
+ **********************************************************************/
+void histogram_merge(Histogram *to, const Histogram *from)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        to->counts[i] += from->counts[i];
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->min < to->min) to->min = from->min;
+    if (from->max > to->max) to->max = from->max;
+}
+
+/**********************************************************************
+ * Value of the bucket where a fraction p of the values is reached.
+ **********************************************************************/
+uint64_t histogram_percentile(const Histogram *histogram, double p)
+{
+    if (!histogram->count) return 0;
+    uint64_t rank = p * histogram->count;
+    if (rank < p * histogram->count || rank < 1) rank += 1;  // ceil, at least the first
+    if (rank > histogram->count) rank = histogram->count;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_max(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**********************************************************************
+ * Average of the values.
+ **********************************************************************/
+double histogram_mean(const Histogram *histogram)
+{
+    return histogram->count ? histogram->sum / histogram->count : 0;
+}
@@ -0,0 +1,110 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TIMER_HAS_TSC 1
+#else
+#define TIMER_HAS_TSC 0
+#endif
+
+/**********************************************************************
+ * TIMER
+ * Timestamps in ticks, read with `timer_now`:
+ *  - TIMER_TSC: the time stamp counter (rdtscp), a few ns per read.
+ *  Only used if the CPU has an invariant TSC.
+ *  - TIMER_CLOCK: clock_gettime(CLOCK_MONOTONIC_RAW), ticks are nsecs.
+ * `timer_init` calibrates the ticks per nsec against the clock, and the
+ * cost of a pair of reads, which `timer_elapsed_ns` takes out.
+ **********************************************************************/
+typedef enum {
+    TIMER_CLOCK,
+    TIMER_TSC,
+} TimerSource;
+
+extern TimerSource timer_source;
+
+/**********************************************************************
+ * Choose and calibrate the timer. Takes a few tens of milliseconds.
+ * Returns the source actually used (TIMER_CLOCK if there is no TSC).
+ **********************************************************************/
+TimerSource timer_init(TimerSource source);
+
+/**********************************************************************
+ * Current timestamp. The reads are fenced, so the code being timed
+ * cannot move across them.
+ **********************************************************************/
+static inline uint64_t timer_now(void)
+{
+#if TIMER_HAS_TSC
+    if (timer_source == TIMER_TSC) {
+        unsigned int aux;
+        uint64_t ticks = __rdtscp(&aux);
+        _mm_lfence();
+        return ticks;
+    }
+#endif
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**********************************************************************
+ * Nsecs between two timestamps, without the cost of reading them.
+ * Never negative.
+ **********************************************************************/
+double timer_elapsed_ns(uint64_t start, uint64_t end);
+
+/**********************************************************************
+ * HISTOGRAM
+ * HDR histogram of latencies in nsecs: exact below 128 ns, and then 64
+ * buckets per power of two, so every value is known within 1.6%. The
+ * memory and the cost of a record do not depend on the number of
+ * values.
+ * Fields:
+ *  - counts: values per bucket.
+ *  - count, sum, min, max: of all the values recorded.
+ **********************************************************************/
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_EXACT (1 << (HISTOGRAM_SUB_BITS + 1))
+#define HISTOGRAM_BUCKETS (HISTOGRAM_EXACT + (64 - HISTOGRAM_SUB_BITS - 1) * (1 << HISTOGRAM_SUB_BITS))
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    double sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+/**********************************************************************
+ * Empty a histogram.
+ **********************************************************************/
+void histogram_reset(Histogram *histogram);
+
+/**********************************************************************
+ * Record a latency (nsecs, rounded to the nearest one).
+ **********************************************************************/
+void histogram_record(Histogram *histogram, double ns);
+
+/**********************************************************************
+ * Add the values of `from` to `to`.
+ **********************************************************************/
+void histogram_merge(Histogram *to, const Histogram *from);
+
+/**********************************************************************
+ * Smallest value v such that a fraction p of the values is <= v,
+ * within the precision of its bucket. 0 if the histogram is empty.
+ * Args:
+ *  - double p: in [0, 1], e.g. 0.999 for the 99.9th percentile.
+ **********************************************************************/
+uint64_t histogram_percentile(const Histogram *histogram, double p);
+
+/**********************************************************************
+ * Average of the values, 0 if the histogram is empty.
+ **********************************************************************/
+double histogram_mean(const Histogram *histogram);
+
+#endif // TIMING_H
@@ -0,0 +1,175 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "io.h"
+#include "node.h"
+#include "fib.h"
+#include "export.h"
+#include "utils.h"
+
+/**********************************************************************
+ * TRIE EXPORT
+ * Builds the compressed trie of a FIB, as my_route_lookup does, and
+ * writes it (or the subtree of a prefix) as a Graphviz digraph, a JSON
+ * table of nodes or a binary dump (see export.h). Large FIBs are made
+ * readable with -d, which stops at a depth, and -c, which collapses the
+ * chains of nodes with a single subtree and no route. The output goes
+ * to stdout unless a file is given.
+ *
+ *      trie_export [-o dot|json|binary] [-p a.b.c.d/len] [-d depth]
+ *                  [-c] [-a] <FIB> [output]
+ **********************************************************************/
+
+typedef struct {
+    char *fib_file;
+    char *output_file;
+    ExportOptions options;
+    uint32_t prefix;
+    int prefix_length;
+    int aggregate;
+} Args;
+
+static void usage(char *cmd, char *errmsg)
+{
+    fprintf(stderr, "Usage: %s [-o dot|json|binary] [-p a.b.c.d/len] [-d depth] [-c] [-a] <FIB> [output]\n", cmd);
+    fputs(errmsg, stderr);
+}
+
+static char *shift(int *ac, char ***av)
+{
+    char *result = **av;
+    *av += 1;
+    *ac -= 1;
+    return result;
+}
+
+/* a.b.c.d/len, returns 0 or -1 */
+static int parse_prefix(const char *text, uint32_t *prefix, int *prefix_length)
+{
+    unsigned a, b, c, d;
+    int length;
+    char end;
+    if (sscanf(text, "%u.%u.%u.%u/%d%c", &a, &b, &c, &d, &length, &end) != 5 || a > 255 || b > 255 ||
+        c > 255 || d > 255 || length < 0 || length > IP_ADDRESS_LENGTH)
+        return -1;
+    *prefix = a << 24 | b << 16 | c << 8 | d;
+    *prefix_length = length;
+    return 0;
+}
+
+static int parse_cmdline_opts(int argc, char **argv, Args *args)
+{
+    char *command = shift(&argc, &argv);
+    args->options.format = EXPORT_GRAPHVIZ;
+    args->options.max_depth = -1;
+    while (argc && argv[0][0] == '-') {
+        char *flag = shift(&argc, &argv);
+        if (strlen(flag) != 2 || !strchr("opdca", flag[1])) {
+            usage(command, "ERROR: unknown option\n");
+            return -1;
+        }
+        if (flag[1] == 'c') {  // The options without value
+            args->options.collapse_chains = 1;
+            continue;
+        }
+        if (flag[1] == 'a') {
+            args->aggregate = 1;
+            continue;
+        }
+        if (!argc) {
+            usage(command, "ERROR: option without value\n");
+            return -1;
+        }
+        char *value = shift(&argc, &argv);
+        switch (flag[1]) {
+        case 'o':
+            if (!strcmp(value, "dot")) args->options.format = EXPORT_GRAPHVIZ;
+            else if (!strcmp(value, "json")) args->options.format = EXPORT_JSON;
+            else if (!strcmp(value, "binary")) args->options.format = EXPORT_BINARY;
+            else {
+                usage(command, "ERROR: unknown output format\n");
+                return -1;
+            }
+            break;
+        case 'p':
+            if (parse_prefix(value, &args->prefix, &args->prefix_length) < 0) {
+                usage(command, "ERROR: invalid prefix\n");
+                return -1;
+            }
+            break;
+        case 'd':
+            args->options.max_depth = atoi(value);
+            if (args->options.max_depth < 0) {
+                usage(command, "ERROR: invalid depth\n");
+                return -1;
+            }
+            break;
+        }
+    }
+    if (!argc) {
+        usage(command, "ERROR: no FIB provided\n");
+        return -1;
+    }
+    args->fib_file = shift(&argc, &argv);
+    if (argc)
+        args->output_file = shift(&argc, &argv);
+    if (argc) {
+        usage(command, "ERROR: too many arguments\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Args args = {0};
+    if (parse_cmdline_opts(argc, argv, &args) < 0)
+        return 1;
+
+    Fib fib;
+    int result = load_fib(args.fib_file, &fib);
+    if (result < 0) {
+        printIOExplanationError(result);
+        return 1;
+    }
+    /* No next hop table: the trie stores the interfaces themselves */
+    Node *root = args.aggregate ? compress_trie(aggregate_trie(create_trie_from_fib(fib.entries, fib.size)))
+                                : create_compressed_trie_from_fib(fib.entries, fib.size);
+    fib_free(&fib);
+
+    int return_value = 0;
+    const Node *subtree = find_subtree(root, args.prefix, args.prefix_length);
+    int fd = args.output_file ? open(args.output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if (fd < 0) {
+        printIOExplanationError(CANNOT_CREATE_OUTPUT);
+        return_value = 1;
+    } else {
+        if (!subtree)
+            fprintf(stderr, "WARNING: no routes inside the prefix\n");
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        long nodes = export_trie(fd, subtree, &args.options);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        if (nodes < 0) {
+            fprintf(stderr, "ERROR: could not write the trie\n");
+            return_value = 1;
+        } else {
+            fprintf(stderr, "Exported %ld nodes in %.1f ms\n", nodes,
+                    ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e6);
+        }
+        if (args.output_file && close(fd) < 0) {
+            fprintf(stderr, "ERROR: could not write the trie\n");
+            return_value = 1;
+        }
+    }
+
+    node_pool_destroy();
+    return return_value;
+}
@@ -5,7 +5,8 @@
  ********************************************************************/
 void getNetmask(int prefixLength, int *netmask){
 
-	*netmask = (0xFFFFFFFF << (IP_ADDRESS_LENGTH - prefixLength));
+	//Shifting a 32-bit value by 32 is undefined: /0 is handled apart
+	*netmask = prefixLength ? (int)(0xFFFFFFFF << (IP_ADDRESS_LENGTH - prefixLength)) : 0;
 
 }
 
@@ -0,0 +1,227 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "worker.h"
+
+/**********************************************************************
+ * Look up every IP of the chunk in the calling thread.
+ **********************************************************************/
+void run_chunk(LookupChunk *chunk)
+{
+    uint64_t start, end;
+    chunk->total_accesses = 0;
+    chunk->total_time = 0;
+    chunk->processed_packets = 0;
+    histogram_reset(&chunk->latencies);
+
+    if (!chunk->batch_size) {
+        for (size_t i = 0; i < chunk->count; ++i) {
+            int accesses = 0;
+            start = timer_now();
+            chunk->ifaces[i] = chunk->cache ? cache_lookup(chunk->cache, chunk->engine, chunk->table,
+                                                           chunk->ips[i], &accesses)
+                                            : chunk->engine->lookup(chunk->table, chunk->ips[i], &accesses);
+            end = timer_now();
+            chunk->accesses[i] = accesses;
+            chunk->times[i] = timer_elapsed_ns(start, end);
+        }
+    } else {
+        /* The batch is timed as a whole, every packet gets the average */
+        for (size_t first = 0; first < chunk->count; first += chunk->batch_size) {
+            size_t n = chunk->count - first;
+            if (n > (size_t)chunk->batch_size) n = chunk->batch_size;
+            start = timer_now();
+            if (chunk->cache)
+                cache_lookup_batch(chunk->cache, chunk->engine, chunk->table, chunk->ips + first,
+                                   chunk->ifaces + first, chunk->accesses + first, n);
+            else
+                engine_lookup_batch(chunk->engine, chunk->table, chunk->ips + first,
+                                    chunk->ifaces + first, chunk->accesses + first, n);
+            end = timer_now();
+            double time = timer_elapsed_ns(start, end) / n;
+            for (size_t i = first; i < first + n; ++i)
+                chunk->times[i] = time;
+        }
+    }
+
+    for (size_t i = 0; i < chunk->count; ++i) {
+        chunk->total_accesses += chunk->accesses[i];
+        chunk->total_time += chunk->times[i];
+        histogram_record(&chunk->latencies, chunk->times[i]);
+    }
+    chunk->processed_packets = chunk->count;
+}
+
+/* A thread of a pool and the chunk it takes */
+typedef struct {
+    LookupPool *pool;
+    int index;
+} PoolThread;
+
+struct LookupPool {
+    int threads;
+    LookupChunk *chunks;
+    PoolThread *members;
+    pthread_t *ids;
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // A new round, or the pool is closing
+    pthread_cond_t done;    // The last thread of the round is done
+    unsigned round;
+    int pending;
+    int closing;
+};
+
+/* Wait for every round and look up its chunk, until the pool closes */
+static void *pool_thread(void *arg)
+{
+    PoolThread *self = arg;
+    LookupPool *pool = self->pool;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->round == seen && !pool->closing)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->round == seen)
+            break;
+        seen = pool->round;
+        pthread_mutex_unlock(&pool->lock);
+        run_chunk(&pool->chunks[self->index]);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Stop and join the first `started` threads */
+static void stop_threads(LookupPool *pool, int started)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < started; ++t)
+        pthread_join(pool->ids[t], NULL);
+}
+
+static void free_pool(LookupPool *pool)
+{
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->chunks);
+    free(pool->members);
+    free(pool->ids);
+    free(pool);
+}
+
+/**********************************************************************
+ * Start the threads of a pool.
+ **********************************************************************/
+LookupPool *lookup_pool_create(int threads)
+{
+    if (threads < 1) threads = 1;
+    LookupPool *pool = calloc(1, sizeof(LookupPool));
+    if (!pool) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    pool->threads = threads;
+    pool->chunks = malloc(threads * sizeof(LookupChunk));
+    pool->members = malloc(threads * sizeof(PoolThread));
+    pool->ids = malloc(threads * sizeof(pthread_t));
+    if (!pool->chunks || !pool->members || !pool->ids) {
+        fprintf(stderr, "Buy more RAM lol\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    /* The calling thread takes the first chunk */
+    for (int t = 1; t < threads; ++t) {
+        pool->members[t] = (PoolThread) { pool, t };
+        if (pthread_create(&pool->ids[t], NULL, pool_thread, &pool->members[t])) {
+            fprintf(stderr, "ERROR: could not create lookup thread\n");
+            stop_threads(pool, t);
+            free_pool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+/**********************************************************************
+ * Look up the IPs with the threads of the pool, in contiguous chunks.
+ **********************************************************************/
+int lookup_pool_run(LookupPool *pool, LookupChunk *total)
+{
+    int threads = pool->threads;
+    size_t first = 0;
+    for (int t = 0; t < threads; ++t) {
+        size_t count = total->count / threads + ((size_t)t < total->count % threads);
+        LookupChunk *chunk = &pool->chunks[t];
+        *chunk = *total;
+        chunk->ips += first;
+        chunk->count = count;
+        chunk->ifaces += first;
+        chunk->accesses += first;
+        chunk->times += first;
+        if (total->cache)
+            chunk->cache = total->cache + t;
+        first += count;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->round += 1;
+    pool->pending = threads - 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    run_chunk(&pool->chunks[0]);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    total->total_accesses = 0;
+    total->total_time = 0;
+    total->processed_packets = 0;
+    histogram_reset(&total->latencies);
+    for (int t = 0; t < threads; ++t) {
+        histogram_merge(&total->latencies, &pool->chunks[t].latencies);
+        total->total_accesses += pool->chunks[t].total_accesses;
+        total->total_time += pool->chunks[t].total_time;
+        total->processed_packets += pool->chunks[t].processed_packets;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Stop the threads and free the pool.
+ **********************************************************************/
+void lookup_pool_destroy(LookupPool *pool)
+{
+    if (!pool) return;
+    stop_threads(pool, pool->threads);
+    free_pool(pool);
+}
+
+/**********************************************************************
+ * Look up the IPs with `threads` threads, in contiguous chunks.
+ **********************************************************************/
+int run_chunks(LookupChunk *total, int threads)
+{
+    if (threads < 1) threads = 1;
+    if ((size_t)threads > total->count) threads = total->count ? total->count : 1;
+
+    LookupPool *pool = lookup_pool_create(threads);
+    if (!pool)
+        return -1;
+    lookup_pool_run(pool, total);
+    lookup_pool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "engine.h"
+#include "timing.h"
+#include "cache.h"
+
+/**********************************************************************
+ * LOOKUP CHUNK
+ * A contiguous part of the input packet file, looked up by one thread.
+ * Fields:
+ *  - engine, table: the lookup engine. The table is only read.
+ *  - ips, count: the IPs of the chunk.
+ *  - batch_size: 0 to time every lookup, otherwise the number of IPs
+ *  looked up at once with `engine_lookup_batch`. Only the batches are
+ *  timestamped, every IP gets the average of its batch.
+ *  - cache: front cache of the results, NULL for none. In `run_chunks`
+ *  it is an array, one cache per thread.
+ *  - ifaces, accesses, times: output parameters, the next hop, the
+ *  number of accesses and the time (nsecs) of every IP. The times are
+ *  taken with `timer_now`, so `timer_init` must be called first.
+ *  - total_accesses, total_time, processed_packets, latencies:
+ *  accumulators of this chunk, for the summary.
+ **********************************************************************/
+typedef struct {
+    const Engine *engine;
+    const void *table;
+    const uint32_t *ips;
+    size_t count;
+    int batch_size;
+    FrontCache *cache;
+    int *ifaces;
+    int *accesses;
+    double *times;
+    double total_accesses;
+    double total_time;
+    size_t processed_packets;
+    Histogram latencies;
+} LookupChunk;
+
+/**********************************************************************
+ * Look up every IP of the chunk in the calling thread.
+ **********************************************************************/
+void run_chunk(LookupChunk *chunk);
+
+/**********************************************************************
+ * Look up the IPs with `threads` threads (the calling one included),
+ * splitting them in contiguous chunks. The outputs stay in the order
+ * of the IPs, and the accumulators are added up in `total`.
+ * Returns 0, or -1 if a thread could not be created.
+ * Args:
+ *  - LookupChunk *total: the whole input. Its output arrays must have
+ *  room for `total->count` elements.
+ *  - int threads: number of threads.
+ **********************************************************************/
+int run_chunks(LookupChunk *total, int threads);
+
+/**********************************************************************
+ * LOOKUP POOL
+ * Threads that look up one input after another, so a run made of many
+ * inputs (e.g. the blocks of results of my_route_lookup) creates them
+ * only once. Thread t always takes chunk t, and cache t if there is one.
+ **********************************************************************/
+typedef struct LookupPool LookupPool;
+
+/**********************************************************************
+ * WARNING: THIS FUNCTION ALLOCATES MEMORY
+ * Start `threads - 1` threads, the calling one being the last.
+ * Returns the pool, or NULL if a thread could not be created.
+ **********************************************************************/
+LookupPool *lookup_pool_create(int threads);
+
+/**********************************************************************
+ * Same as `run_chunks`, with the threads of the pool. Returns 0.
+ **********************************************************************/
+int lookup_pool_run(LookupPool *pool, LookupChunk *total);
+
+/**********************************************************************
+ * Stop the threads and free the pool.
+ **********************************************************************/
+void lookup_pool_destroy(LookupPool *pool);
+
+#endif // WORKER_H